@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+namespace audio_plugin {
+/**
+ * @brief Map with fixed capacity that stores its items in place (no heap allocations)
+ * @tparam Key Type of keys
+ * @tparam Value Type of values
+ * @tparam Capacity Max number of items
+ * @note Items are unordered, erase() moves the last item to the place of erased one. Lookup is
+ *       linear, so it's meant for small maps (like currently playing voices).
+ */
+template <typename Key, typename Value, size_t Capacity> class FixedCapacityMap {
+  public:
+    using Item = std::pair<Key, Value>;
+    using iterator = Item *;
+    using const_iterator = const Item *;
+
+    iterator begin() { return items.data(); }
+    iterator end() { return items.data() + count; }
+    const_iterator begin() const { return items.data(); }
+    const_iterator end() const { return items.data() + count; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == Capacity; }
+    void clear() { count = 0; }
+
+    iterator find(const Key &key) {
+        for (iterator it = begin(); it != end(); ++it) {
+            if (it->first == key) {
+                return it;
+            }
+        }
+        return end();
+    }
+
+    const_iterator find(const Key &key) const {
+        return const_cast<FixedCapacityMap *>(this)->find(key);
+    }
+
+    bool contains(const Key &key) const { return find(key) != end(); }
+
+    /**
+     * @brief Insert new item or assign value of existing one
+     * @return false if there is no such key and map is full
+     */
+    bool insert(const Key &key, const Value &value) {
+        iterator it = find(key);
+        if (it != end()) {
+            it->second = value;
+            return true;
+        }
+        if (full()) {
+            return false;
+        }
+        items[count++] = {key, value};
+        return true;
+    }
+
+    /**
+     * @brief Erase item
+     * @return Iterator to the item that took place of erased one (so it can be used while
+     *         iterating like with std::map)
+     */
+    iterator erase(iterator it) {
+        --count;
+        if (it != end()) {
+            *it = std::move(items[count]);
+        }
+        return it;
+    }
+
+    void erase(const Key &key) {
+        iterator it = find(key);
+        if (it != end()) {
+            erase(it);
+        }
+    }
+
+  private:
+    std::array<Item, Capacity> items;
+    size_t count = 0;
+};
+} // namespace audio_plugin
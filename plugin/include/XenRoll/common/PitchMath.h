@@ -0,0 +1,122 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Fast conversions between cents and frequency ratios for the audio thread.
+ *
+ * exp2/log2 are computed with polynomials (no std::pow/std::log2 calls), the code is branch-free,
+ * so loops of batch functions are auto-vectorised by the compiler (SSE2/AVX/NEON).
+ *
+ * Max error (checked by PitchMathTest over the whole range of piano roll, 10 octaves around A4):
+ *  - centsToRatio(): relative error < 1e-14, that is < 1e-10 cents
+ *  - ratioToCents(): absolute error < 1e-10 cents
+ *
+ * @note Arguments must be in "musical" range: |cents| < 1e6 and ratio must be positive, normal
+ *       and finite. There are no checks for NaN, infinity or denormals.
+ */
+namespace audio_plugin {
+namespace pitch_math_detail {
+constexpr double ln2 = 0.693147180559945309417;
+///< Adding it to double rounds it to integer, that is stored in the low bits of mantissa
+constexpr double roundMagic = 6755399441055744.0; // 1.5 * 2^52
+constexpr double two52 = 4503599627370496.0;      // 2^52
+constexpr uint64_t oneBits = 0x3FF0000000000000ull;      // bits of 1.0
+constexpr uint64_t sqrtHalfBits = 0x3FE6A09E667F3BCDull; // bits of sqrt(1/2)
+} // namespace pitch_math_detail
+
+/**
+ * @brief 2^x
+ * Taylor polynomial of degree 11 for 2^f, f in [-0.5, 0.5] (relative error < 7e-15), multiplied
+ * by 2^n that is built directly in exponent bits.
+ */
+inline double fastExp2(double x) {
+    using namespace pitch_math_detail;
+    const double shifted = x + roundMagic;
+    const double n = shifted - roundMagic; // round(x)
+    const double f = (x - n) * ln2;        // 2^(x - n) = e^f, |f| <= ln2 / 2
+
+    double p = 1.0 / 39916800.0; // 1 / 11!
+    p = p * f + 1.0 / 3628800.0;
+    p = p * f + 1.0 / 362880.0;
+    p = p * f + 1.0 / 40320.0;
+    p = p * f + 1.0 / 5040.0;
+    p = p * f + 1.0 / 720.0;
+    p = p * f + 1.0 / 120.0;
+    p = p * f + 1.0 / 24.0;
+    p = p * f + 1.0 / 6.0;
+    p = p * f + 0.5;
+    p = p * f + 1.0;
+    p = p * f + 1.0;
+
+    // Low bits of shifted contain n, so 2^n is (n + 1023) << 52
+    const uint64_t scaleBits = (std::bit_cast<uint64_t>(shifted) + 1023) << 52;
+    return p * std::bit_cast<double>(scaleBits);
+}
+
+/**
+ * @brief log2(x), x > 0
+ * x = m * 2^e with m in [sqrt(1/2), sqrt(2)), log2(m) = 2 / ln2 * atanh((m - 1) / (m + 1)), atanh
+ * series is cut after s^19 term (error < 1e-15).
+ */
+inline double fastLog2(double x) {
+    using namespace pitch_math_detail;
+    const uint64_t bits = std::bit_cast<uint64_t>(x);
+    // Shifting bits by bits of sqrt(1/2) makes exponent field of tmp equal to e + 1023
+    const uint64_t tmp = bits - sqrtHalfBits + oneBits;
+    const uint64_t biasedE = tmp >> 52;
+    const double m = std::bit_cast<double>(bits - (biasedE << 52) + oneBits);
+    // Biased e put into mantissa of 2^52, so it's converted without int -> double conversion
+    const double e =
+        std::bit_cast<double>(biasedE | std::bit_cast<uint64_t>(two52)) - two52 - 1023.0;
+
+    const double s = (m - 1.0) / (m + 1.0); // |s| <= 0.1716
+    const double s2 = s * s;
+    double p = 1.0 / 19.0;
+    p = p * s2 + 1.0 / 17.0;
+    p = p * s2 + 1.0 / 15.0;
+    p = p * s2 + 1.0 / 13.0;
+    p = p * s2 + 1.0 / 11.0;
+    p = p * s2 + 1.0 / 9.0;
+    p = p * s2 + 1.0 / 7.0;
+    p = p * s2 + 1.0 / 5.0;
+    p = p * s2 + 1.0 / 3.0;
+    p = p * s2 + 1.0;
+    return e + (2.0 / ln2) * s * p;
+}
+
+///< Frequency ratio of interval in cents: 2^(cents / 1200)
+inline double centsToRatio(double cents) { return fastExp2(cents / 1200.0); }
+
+///< Interval in cents of frequency ratio: 1200 * log2(ratio)
+inline double ratioToCents(double ratio) { return 1200.0 * fastLog2(ratio); }
+
+/**
+ * @brief Convert array of cents to frequencies: freqs[i] = refFreq * 2^(cents[i] / 1200)
+ * @param cents Intervals from refFreq in cents
+ * @param freqs Output, may be the same array as cents
+ * @param count Size of arrays
+ * @param refFreq Frequency of 0 cents in Hz
+ */
+inline void centsToFreqs(const double *cents, double *freqs, size_t count, double refFreq) {
+    for (size_t i = 0; i < count; ++i) {
+        freqs[i] = refFreq * centsToRatio(cents[i]);
+    }
+}
+
+/**
+ * @brief Convert array of frequencies to cents: cents[i] = 1200 * log2(freqs[i] / refFreq)
+ * @param freqs Frequencies in Hz, must be > 0
+ * @param cents Output, may be the same array as freqs
+ * @param count Size of arrays
+ * @param refFreq Frequency of 0 cents in Hz
+ */
+inline void freqsToCents(const double *freqs, double *cents, size_t count, double refFreq) {
+    const double invRefFreq = 1.0 / refFreq;
+    for (size_t i = 0; i < count; ++i) {
+        cents[i] = ratioToCents(freqs[i] * invRefFreq);
+    }
+}
+} // namespace audio_plugin
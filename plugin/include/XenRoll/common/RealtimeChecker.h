@@ -0,0 +1,83 @@
+#pragma once
+
+/**
+ * Real-time safety checker for the audio thread (enabled by XENROLL_REALTIME_CHECKS cmake option)
+ *
+ * processBlock() marks the audio thread with XENROLL_REALTIME_SCOPE(). While it's marked:
+ *  - every heap allocation/deallocation is recorded (global operator new/delete are replaced,
+ *    call site is the return address of operator new/delete, resolved to a symbol in report)
+ *  - every mutex lock, interprocess mutex lock or other blocking call, annotated with
+ *    XENROLL_REALTIME_MUTEX(), XENROLL_REALTIME_IPC_MUTEX(), XENROLL_REALTIME_BLOCKING_CALL(), is
+ *    recorded with it's file and line
+ *
+ * getReport() lists offending call sites with total count, number of blocks where they happened
+ * and max count per block. With XENROLL_REALTIME_CHECKS_TRAP the first violation at every call
+ * site also triggers jassertfalse.
+ *
+ * If the option is disabled all macros are empty, so there is no overhead.
+ */
+#if XENROLL_REALTIME_CHECKS
+
+    #include <string>
+
+namespace audio_plugin {
+class RealtimeChecker {
+  public:
+    enum class Violation {
+        HeapAllocation,
+        HeapDeallocation,
+        MutexLock,
+        IpcMutexLock,
+        BlockingCall
+    };
+
+    /**
+     * @brief Marks current thread as real-time while it's alive, every scope is one block
+     * @note Scopes may be nested (then only the outer one counts as block)
+     */
+    class Scope {
+      public:
+        Scope();
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    ///< Is current thread inside Scope
+    static bool isRealtimeThread();
+
+    /**
+     * @brief Record violation if current thread is real-time, doesn't allocate
+     * @param violation Kind of violation
+     * @param site Call site, string literal or code address (must stay valid forever)
+     */
+    static void record(Violation violation, const void *site);
+
+    ///< Human readable report of all recorded violations (allocates, don't call on audio thread)
+    static std::string getReport();
+
+    ///< Forget all recorded violations
+    static void reset();
+};
+} // namespace audio_plugin
+
+    #define XENROLL_REALTIME_STRINGIFY_IMPL(x) #x
+    #define XENROLL_REALTIME_STRINGIFY(x) XENROLL_REALTIME_STRINGIFY_IMPL(x)
+    #define XENROLL_REALTIME_RECORD(violation, name)                                              \
+        audio_plugin::RealtimeChecker::record(                                                    \
+            audio_plugin::RealtimeChecker::Violation::violation,                                  \
+            name " (" __FILE__ ":" XENROLL_REALTIME_STRINGIFY(__LINE__) ")")
+
+    #define XENROLL_REALTIME_SCOPE() audio_plugin::RealtimeChecker::Scope xenrollRealtimeScope
+    #define XENROLL_REALTIME_MUTEX(name) XENROLL_REALTIME_RECORD(MutexLock, name)
+    #define XENROLL_REALTIME_IPC_MUTEX(name) XENROLL_REALTIME_RECORD(IpcMutexLock, name)
+    #define XENROLL_REALTIME_BLOCKING_CALL(name) XENROLL_REALTIME_RECORD(BlockingCall, name)
+
+#else
+
+    #define XENROLL_REALTIME_SCOPE()
+    #define XENROLL_REALTIME_MUTEX(name)
+    #define XENROLL_REALTIME_IPC_MUTEX(name)
+    #define XENROLL_REALTIME_BLOCKING_CALL(name)
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace audio_plugin {
+/**
+ * @brief Fixed array of values with one wait-free writer and any number of readers (seqlock)
+ * @tparam T Trivially copyable type, std::atomic<T> must be lock-free
+ * @tparam N Number of values
+ *
+ * Writer makes sequence odd, stores values and makes sequence even again, it never waits, so it
+ * can write from the audio thread. Reader copies values and retries if sequence was odd or has
+ * changed meanwhile. There are only lock-free atomics inside, so it can be placed in shared
+ * memory and used by different processes.
+ *
+ * @note Only one thread at a time may write.
+ */
+template <typename T, size_t N> class SeqLockArray {
+  public:
+    static_assert(std::atomic<T>::is_always_lock_free, "SeqLockArray needs lock-free atomics");
+
+    /**
+     * @brief Wait-free, values must point to N values
+     * @note If previous writer crashed in the middle of write() (sequence is odd), array becomes
+     * consistent again after this write
+     */
+    void write(const T *values) {
+        const uint32_t seq = sequence.load(std::memory_order_relaxed) & ~1u;
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < N; ++i) {
+            data[i].store(values[i], std::memory_order_relaxed);
+        }
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy consistent values (written by one write() call)
+     * @param values Destination for N values
+     * @param maxAttempts Give up after this number of attempts (writer in other process could
+     * crash in the middle of write())
+     * @return false if values weren't copied consistently
+     */
+    bool tryRead(T *values, int maxAttempts = 64) const {
+        for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+            const uint32_t seq = sequence.load(std::memory_order_acquire);
+            if ((seq & 1) == 0) {
+                for (size_t i = 0; i < N; ++i) {
+                    values[i] = data[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence.load(std::memory_order_relaxed) == seq) {
+                    return true;
+                }
+            }
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+  private:
+    std::atomic<uint32_t> sequence{0}; ///< Odd while writing
+    std::array<std::atomic<T>, N> data{};
+};
+} // namespace audio_plugin
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace audio_plugin {
+/**
+ * @brief Publishes immutable snapshots to one real-time reader and any number of other readers
+ * @tparam T Type of snapshot
+ *
+ * Writers (and non real-time readers) use a mutex, the real-time reader (audio thread) never
+ * locks, allocates or frees: it marks the snapshot it reads with a hazard pointer, and writers
+ * keep replaced snapshots alive until the hazard pointer doesn't point to them anymore. So the
+ * last reference to an old snapshot is always released by a writer.
+ *
+ * @note Only one thread at a time may use RealtimeReader.
+ */
+template <typename T> class SnapshotPublisher {
+  public:
+    using Ptr = std::shared_ptr<const T>;
+
+    /**
+     * @brief Construct a SnapshotPublisher
+     * @param initial First snapshot, must not be nullptr
+     */
+    explicit SnapshotPublisher(Ptr initial) : current(std::move(initial)) {
+        live.store(current.get());
+    }
+
+    /**
+     * @brief Make new snapshot visible to all readers
+     * @param snapshot New snapshot, must not be nullptr
+     * @note May free old snapshots, so don't call it from the audio thread
+     */
+    void publish(Ptr snapshot) {
+        std::scoped_lock lock(writerMutex);
+        retired.push_back(std::move(current));
+        current = std::move(snapshot);
+        live.store(current.get());
+
+        const T *inUse = hazard.load();
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                     [inUse](const Ptr &p) { return p.get() != inUse; }),
+                      retired.end());
+    }
+
+    ///< Get latest snapshot (for non real-time readers)
+    Ptr get() const {
+        std::scoped_lock lock(writerMutex);
+        return current;
+    }
+
+    /**
+     * @brief Gives the audio thread access to latest snapshot while it's alive (wait-free)
+     */
+    class RealtimeReader {
+      public:
+        explicit RealtimeReader(SnapshotPublisher &owner) : publisher(owner) {
+            const T *p = publisher.live.load();
+            while (true) {
+                publisher.hazard.store(p);
+                // If live wasn't changed after hazard was set, writer will see our hazard
+                const T *check = publisher.live.load();
+                if (check == p) {
+                    break;
+                }
+                p = check;
+            }
+            snapshot = p;
+        }
+        ~RealtimeReader() { publisher.hazard.store(nullptr, std::memory_order_release); }
+
+        RealtimeReader(const RealtimeReader &) = delete;
+        RealtimeReader &operator=(const RealtimeReader &) = delete;
+
+        const T &get() const { return *snapshot; }
+
+      private:
+        SnapshotPublisher &publisher;
+        const T *snapshot;
+    };
+
+  private:
+    mutable std::mutex writerMutex;
+    Ptr current;               ///< Latest snapshot (under writerMutex)
+    std::vector<Ptr> retired;  ///< Replaced snapshots that may be still read (under writerMutex)
+    std::atomic<const T *> live{nullptr};   ///< current.get(), for the real-time reader
+    std::atomic<const T *> hazard{nullptr}; ///< Snapshot that real-time reader is reading now
+};
+} // namespace audio_plugin
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace audio_plugin {
+/**
+ * @brief Bounded lock-free queue for one producer thread and one consumer thread
+ * @tparam T Copyable type of items
+ * @tparam Capacity Max number of items in the queue, power of 2
+ *
+ * Items are stored in place (ring buffer), so push() and pop() never allocate or wait and can be
+ * used from the audio thread.
+ *
+ * @note Only one thread at a time may push and only one thread at a time may pop.
+ */
+template <typename T, size_t Capacity> class SpscQueue {
+  public:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of 2");
+
+    ///< For producer. Returns false if queue is full (item isn't pushed)
+    bool push(const T &item) {
+        const size_t pos = writePos.load(std::memory_order_relaxed);
+        if (pos - readPos.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        items[pos & mask] = item;
+        writePos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///< For consumer. Returns false if queue is empty
+    bool pop(T &item) {
+        const size_t pos = readPos.load(std::memory_order_relaxed);
+        if (pos == writePos.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[pos & mask];
+        readPos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    static constexpr size_t mask = Capacity - 1;
+
+    // Positions only grow (wrap around is fine for unsigned), they are on different cache lines
+    //   so producer and consumer don't invalidate each other's line on every operation
+    alignas(64) std::atomic<size_t> writePos{0};
+    alignas(64) std::atomic<size_t> readPos{0};
+    std::array<T, Capacity> items{};
+};
+} // namespace audio_plugin
@@ -4,6 +4,7 @@
 #include "XenRoll/data/PartialsTypes.h"
 #include "XenRoll/data/RatioMark.h"
 #include "XenRoll/data/Theme.h"
+#include "XenRoll/data/VoiceStealingMPE.h"
 #include "XenRoll/data/Zones.h"
 #include <atomic>
 #include <juce_core/juce_core.h>
@@ -34,8 +35,28 @@ class Parameters {
         return {"+diverse intervals", "random"};
     }
 
-    enum TuningType { MPE = 1, MTS_ESP = 2 };
-    static const juce::Array<juce::String> getTuningTypeNames() { return {"MPE", "MTS"}; }
+    ///< MTS_SYSEX: tuning is sent in the midi stream (MTS real-time SysEx), without MTS-ESP
+    enum TuningType { MPE = 1, MTS_ESP = 2, MTS_SYSEX = 3 };
+    static const juce::Array<juce::String> getTuningTypeNames() {
+        return {"MPE", "MTS", "MTS SysEx"};
+    }
+
+    using VoiceStealingMPE = audio_plugin::VoiceStealingMPE;
+    static const juce::Array<juce::String> getVoiceStealingMPENames() {
+        return {"don't steal (drop note)", "oldest", "quietest", "lowest", "highest",
+                "same bend (else oldest)"};
+    }
+
+    ///< How incoming midi notes (from a controller) are mapped to pitches
+    enum MidiInputMapping {
+        MidiInputOff = 1,
+        MidiInputKeysScale = 2,
+        MidiInputNearestKey = 3,
+        MidiInputSclScale = 4
+    };
+    static const juce::Array<juce::String> getMidiInputMappingNames() {
+        return {"off", "keys as scale", "nearest key (12-EDO input)", "loaded .scl scale"};
+    }
 
     // ~~~~~~~~~~~~~~~~~~~~~~~~~~~ HOTKEYS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     enum hotkeys {
@@ -95,6 +116,7 @@ class Parameters {
     static constexpr float min_pitchMemoryTVminNonzero = 0.0f;
     // ================= Vocal to melody =================
     static constexpr int min_vocalToMelodyDCents = 10;
+    static constexpr float min_vocalToMelodyHopMs = 1.0f;
 
     // ~~~~~~~~~~~~~~~~~~~~~~~~ Maximum values ~~~~~~~~~~~~~~~~~~~~~~~~
     static constexpr int max_editorWidth = 10000;
@@ -123,6 +145,7 @@ class Parameters {
     static constexpr float max_pitchMemoryTVminNonzero = 0.5f;
     // ================= Vocal to melody =================
     static constexpr int max_vocalToMelodyDcents = 90;
+    static constexpr float max_vocalToMelodyHopMs = 50.0f;
 
     // ~~~~~~~~~~~~~~~~~~~~~~~~~ Saved params ~~~~~~~~~~~~~~~~~~~~~~~~~
     int editorWidth = 1430;
@@ -153,10 +176,22 @@ class Parameters {
     ///< For MPE. -1 means uninited state, range: [0, 1, 2, ...]
     int instanceId = -1;
     float maxChordDtimeClockDiagram = 1.0f / 32;       ///< in bars
+    std::atomic<MidiInputMapping> midiInputMapping = MidiInputOff;
     std::atomic<bool> resetPitchBendOnNoteOff = false; ///< setting for MPE tuning
     ///< Possible values: {12, 24, 48, 96}. Setting for MPE tuning
     std::atomic<int> semiBendRangeMPE = 48;
     bool channelsEconomyModeMPE = false; ///< Setting for MPE tuning
+    ///< Note bend is sent every bendControlRateMPE samples. Possible values: {16, 32, ..., 512}.
+    ///< Setting for MPE tuning
+    std::atomic<int> bendControlRateMPE = 64;
+    ///< Which note loses it's midi channel if all channels are busy. Setting for MPE tuning
+    std::atomic<VoiceStealingMPE> voiceStealingMPE = VoiceStealingMPE::NoStealing;
+    ///< Note bend tuning is updated at most every bendControlRateMTS samples (1 is every block).
+    ///< Possible values: {1, 256, 512, ..., 4096}. Setting for MTS-ESP tuning
+    std::atomic<int> bendControlRateMTS = 1;
+    ///< Number of midi channels of instance (128 pitches per channel), 1-4. Setting for MTS-ESP
+    ///< tuning
+    std::atomic<int> numChannelsMTS = 1;
     // ================== Intellectual ==================
     // Partials/dissonance
     std::atomic<int> findPartialsFFTSize = 8192;
@@ -172,6 +207,8 @@ class Parameters {
     // ================= Vocal to melody =================
     std::atomic<bool> vocalToMelodyGenCurve = true;
     std::atomic<bool> vocalToMelodyGenNotes = true;
+    ///< Time between two pitch analyses of vocal input (doesn't depend on block size), in ms
+    std::atomic<float> vocalToMelodyHopMs = 10.0f;
     // Params for vocalToMelodyGenNotes:
     std::atomic<float> vocalToMelodyMinNoteDuration = 1.0f / 128; ///< in bars
     std::atomic<int> vocalToMelodyDCents = 50;
@@ -250,11 +287,12 @@ class Parameters {
     int minDistExistNewKeys = 20;
     int minDistBetweenNewKeys = 40;
     GenNewKeysTactics genNewKeysTactics = GenNewKeysTactics::DiverseIntervals;
-    bool recordManuallyPlayedNotes = false;
+    std::atomic<bool> recordManuallyPlayedNotes = false; ///< Notes are recorded by processor
     bool showClockDiagram = false;
     bool showDebugOverlay = false;
     // ================== Intellectual ==================
     // Partials/dissonance
+    ///< Use AudioPluginAudioProcessor::setFindPartialsMode() to change it
     std::atomic<bool> findPartialsMode = false;
     int plotPartialsTotalCents = 4 * 1200 + 900;
     int plotDissonanceTotalCents = 4 * 1200 + 900;
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace audio_plugin {
+///< What to do with a new MPE note if all midi channels are busy
+enum class VoiceStealingMPE {
+    NoStealing = 1,
+    StealOldest = 2,
+    StealQuietest = 3,
+    StealLowest = 4,
+    StealHighest = 5,
+    StealSameBend = 6 ///< Channel with same pitch bend, else oldest
+};
+} // namespace audio_plugin
@@ -347,7 +347,7 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
     void setManuallyPlayedKeys(const std::map<int, float> &manuallyPlayedKeys,
                                const std::string &mode);
 
-    const std::vector<Note> &getNotes() { return processorRef.getNotes(); }
+    NotesSnapshotPtr getNotesSnapshot() { return processorRef.getNotesSnapshot(); }
 
     void showVelocityPanel(float minVel, float maxVel) {
         velocityPanel->setVelocityRange(minVel, maxVel);
@@ -366,6 +366,9 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
      */
     void timerCallback();
 
+    ///< Text of indexLabel: instance id (MPE) or midi channel (MTS), "-" if there is none
+    juce::String getIndexText();
+
     /**
      * @brief Bring keyboard focus back to viewed panel
      */
@@ -420,6 +423,10 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
     std::set<int> getAllInstancesIndexes() { return processorRef.getAllInstancesIndexes(); }
 
     void changedChannelsEconomyModeMPE() { processorRef.changedChannelsEconomyModeMPE(); }
+    void changedNumChannelsMTS() { processorRef.changedNumChannelsMTS(); }
+    void changedMidiInputMapping() { processorRef.updateMidiInputMap(); }
+    ///< Ask for .scl file for Parameters::MidiInputSclScale
+    void chooseMidiInputScale();
 
     void sendOSCTransportPosition(float timeInBars);
     void reconnectOSCSender();
@@ -477,6 +484,7 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
     std::unique_ptr<ClockDiagramPanel> clockDiagramPanel;
 
     std::unique_ptr<juce::FileChooser> importFileChooser, exportFileChooser;
+    std::unique_ptr<juce::FileChooser> midiInputScaleFileChooser;
 
     std::unique_ptr<PopupMessage> popup;
     std::unique_ptr<DragAndDropPopup> dragAndDropPopup;
@@ -501,6 +509,7 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
     const int ghostNotesUpdMs = 500;
     const int ghostNotesTimerTicks = ghostNotesUpdMs / timerMs;
     int ghostNotesTicker = 0;
+    bool instanceSyncErrorShown = false;
     float playHeadTime = 0.0f;
 
     const int leftPanel_width_px = 150;
@@ -542,9 +551,12 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
     // ===== recording manually played notes =====
     ///< isSelected = note has already been played (not pressed rn)
     std::vector<Note> recordedManuallyPlayedNotes;
+    ///< id of RecordedNoteEvent -> index in recordedManuallyPlayedNotes of notes that are held
+    std::map<int, size_t> openRecordedNotes;
     void startRecordingManuallyPlayedNotes();
     void endRecordingManuallyPlayedNotes();
-    bool wasPlayingRMPN = false;
+    ///< Show recording progress (events from processor), returns true if there were new events
+    bool popRecordedNoteEvents();
     // ===========================================
 
     const int velocity_width_px = 200;
@@ -559,6 +571,8 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
     void parseMidiSclFiles(const juce::File &midiFile, const juce::File &sclFile = juce::File{});
     void importMidiSclFiles();
     void exportMidiSclFiles();
+    ///< Offline bounce of notes with current tuning settings (MPE or MTS SysEx)
+    void exportRetunedMidiFile();
     void parseNotesFile(const juce::File &notesFile);
     void importNotesFile();
     void exportNotesFile();
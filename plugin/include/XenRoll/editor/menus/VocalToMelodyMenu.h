@@ -40,9 +40,10 @@ class VocalToMelodyMenu : public juce::Component {
 
     std::unique_ptr<juce::Label> vocalToMelodyGenCurveLabel, vocalToMelodyGenNotesLabel,
         vocalToMelodyMinNoteDurationLabel, vocalToMelodyDcentsLabel, vocalToMelodyKeySnapLabel,
-        vocalToMelodyMakeBendsLabel, micGain_dBLabel;
+        vocalToMelodyMakeBendsLabel, micGain_dBLabel, vocalToMelodyHopMsLabel;
     std::unique_ptr<juce::ComboBox> vocalToMelodyMinNoteDurationCombo;
-    std::unique_ptr<juce::Slider> vocalToMelodyDcentsSlider, micGain_dBSlider;
+    std::unique_ptr<juce::Slider> vocalToMelodyDcentsSlider, micGain_dBSlider,
+        vocalToMelodyHopMsSlider;
     std::unique_ptr<juce::ToggleButton> vocalToMelodyGenCurveCheckbox,
         vocalToMelodyGenNotesCheckbox, vocalToMelodyKeySnapCheckbox, vocalToMelodyMakeBendsCheckbox;
     std::unique_ptr<juce::Button> vocalToMelodyDeleteCurveButton;
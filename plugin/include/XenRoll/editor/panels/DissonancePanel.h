@@ -6,6 +6,7 @@
 #include "XenRoll/editor/models/DissonanceMeter.h"
 #include "XenRoll/editor/panels/DissonancePlot.h"
 #include "XenRoll/editor/panels/PartialsPlot.h"
+#include <functional>
 #include <juce_gui_basics/juce_gui_basics.h>
 
 namespace audio_plugin {
@@ -15,8 +16,10 @@ class DissonancePanel : public juce::Component {
      * @brief Construct a DissonancePanel
      * @param params Pointer to parameters
      * @param dissonanceMeter Shared pointer to DissonanceMeter for calculations
+     * @param setFindPartialsMode Turns partials finding mode on/off (in processor)
      */
-    DissonancePanel(Parameters &params, std::shared_ptr<DissonanceMeter> dissonanceMeter);
+    DissonancePanel(Parameters &params, std::shared_ptr<DissonanceMeter> dissonanceMeter,
+                    std::function<void(bool)> setFindPartialsMode);
     ~DissonancePanel() override;
 
     void resized() override;
@@ -25,6 +28,7 @@ class DissonancePanel : public juce::Component {
   private:
     Parameters &params;
     std::shared_ptr<DissonanceMeter> dissonanceMeter;
+    std::function<void(bool)> setFindPartialsMode;
     std::unique_ptr<PartialsPlot> partialsPlot;
     std::unique_ptr<DissonancePlot> dissonancePlot;
 
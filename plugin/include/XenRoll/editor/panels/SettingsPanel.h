@@ -51,6 +51,7 @@ class SettingsPanel : public juce::Component {
     std::unique_ptr<juce::Label> basicSettingsHeader;
     std::unique_ptr<juce::Label> visualSettingsHeader;
     std::unique_ptr<juce::Label> mpeSettingsHeader;
+    std::unique_ptr<juce::Label> mtsSettingsHeader;
 
     // Basic settings
     std::unique_ptr<juce::Label> startingOctaveLabel;
@@ -68,6 +69,9 @@ class SettingsPanel : public juce::Component {
     std::unique_ptr<juce::Label> horZoomOnCursorLabel;
     std::unique_ptr<juce::ToggleButton> horZoomOnCursorCheckbox;
 
+    std::unique_ptr<juce::Label> midiInputMappingLabel;
+    std::unique_ptr<juce::ComboBox> midiInputMappingCombo;
+
     // Visual settings
     std::unique_ptr<juce::Label> themeTypeLabel;
     std::unique_ptr<juce::ComboBox> themeTypeCombo;
@@ -91,6 +95,19 @@ class SettingsPanel : public juce::Component {
     std::unique_ptr<juce::Label> channelsEconomyModeMPELabel;
     std::unique_ptr<juce::ToggleButton> channelsEconomyModeMPECheckbox;
 
+    std::unique_ptr<juce::Label> bendControlRateMPELabel;
+    std::unique_ptr<juce::ComboBox> bendControlRateMPECombo;
+
+    std::unique_ptr<juce::Label> voiceStealingMPELabel;
+    std::unique_ptr<juce::ComboBox> voiceStealingMPECombo;
+
+    // MTS-ESP tuning mode settings
+    std::unique_ptr<juce::Label> bendControlRateMTSLabel;
+    std::unique_ptr<juce::ComboBox> bendControlRateMTSCombo;
+
+    std::unique_ptr<juce::Label> numChannelsMTSLabel;
+    std::unique_ptr<juce::ComboBox> numChannelsMTSCombo;
+
     const int padding = 8;
     const int rowHeight = 28;
     const int headerRowHeight = 34;
@@ -1,6 +1,10 @@
 #pragma once
 
-#include "XenRoll/common/RelevanceQueue.h"
+#include "XenRoll/common/FixedCapacityMap.h"
+#include "XenRoll/common/PitchMath.h"
+#include "XenRoll/common/SeqLockArray.h"
+#include "XenRoll/common/SnapshotPublisher.h"
+#include "XenRoll/common/SpscQueue.h"
 #include "XenRoll/data/GlobalSettings.h"
 #include "XenRoll/data/Note.h"
 #include "XenRoll/data/Parameters.h"
@@ -8,12 +12,21 @@
 #include "XenRoll/processor/audio/dsp/PartialsFinder.h"
 #include "XenRoll/processor/audio/dsp/PitchDetectorMPM.h"
 #include "XenRoll/processor/managers/ChannelsManagerMPE.h"
+#include "XenRoll/processor/managers/FreqSlotsManagerMTS.h"
 #include "XenRoll/processor/managers/NotesSharingMPE.h"
 #include "XenRoll/processor/managers/PluginInstanceManager.h"
+#include "XenRoll/processor/playback/BlockScheduler.h"
+#include "XenRoll/processor/playback/NotesSnapshot.h"
+#include "XenRoll/processor/playback/PitchBendMPE.h"
+#include "XenRoll/processor/playback/PlayheadTracker.h"
+#include "XenRoll/processor/playback/TuningSysEx.h"
+#include "XenRoll/processor/playback/VoicesMPE.h"
+#include <bitset>
 #include <juce_audio_processors/juce_audio_processors.h>
+#include <thread>
 
 namespace audio_plugin {
-class AudioPluginAudioProcessor : public juce::AudioProcessor {
+class AudioPluginAudioProcessor : public juce::AudioProcessor, private juce::AsyncUpdater {
   public:
     AudioPluginAudioProcessor();
     ~AudioPluginAudioProcessor() override;
@@ -42,6 +55,20 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     const juce::String getProgramName(int index) override;
     void changeProgramName(int index, const juce::String &newName) override;
 
+    // ======================================== MIDI INPUT ========================================
+    /**
+     * @brief Rebuild mapping of incoming midi notes to pitches (from params.midiInputMapping, keys
+     * and midi input scale)
+     * @note Audio thread reads the mapping without locks
+     */
+    void updateMidiInputMap();
+    /**
+     * @brief Set scale for Parameters::MidiInputSclScale
+     * @param scaleCents Degrees of .scl scale in cents (without 0, the last one is period)
+     */
+    void setMidiInputScale(const std::vector<int> &scaleCents);
+    // ============================================================================================
+
     void getStateInformation(juce::MemoryBlock &destData) override;
     void setStateInformation(const void *data, int sizeInBytes) override;
 
@@ -50,12 +77,42 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     /**
      * @brief Set the Manually Played Notes ( = Manually Played Keys in Plugin Editor)
      * @param newManuallyPlayedNotes {totalCents -> velocity}
+     * @param notRecordedNotes totalCents of new notes that aren't recorded even if
+     *                         params.recordManuallyPlayedNotes (for example played by dragging)
+     * @note Only differences from the previous call are sent to the audio thread (as note on/off
+     * events), nothing is locked. Call it only from the message thread.
      */
-    void setManuallyPlayedNotes(const std::map<int, float> newManuallyPlayedNotes);
+    void setManuallyPlayedNotes(const std::map<int, float> newManuallyPlayedNotes,
+                                const std::set<int> &notRecordedNotes = {});
+
+    // ================================= RECORDING OF PLAYED NOTES ================================
+    ///< Note on or note off of recorded note (played manually or from midi input)
+    struct RecordedNoteEvent {
+        int id = 0; ///< Same for note on and note off of one note
+        int totalCents = 0;
+        float velocity = 0.0f;
+        bool isNoteOn = false;
+        double time = 0.0; ///< In bars, at exact sample of the event
+    };
+    /**
+     * @brief Pop next recorded note event, only to show recording progress in the editor
+     * @return false if there are no events
+     * @note Events that don't fit the queue are dropped, the take itself is kept by processor (see
+     * takeRecordedNotes()).
+     */
+    bool popRecordedNoteEvent(RecordedNoteEvent &event) { return recordedNoteEvents.pop(event); }
+    /**
+     * @brief Take notes recorded since params.recordManuallyPlayedNotes was turned on
+     * @note Notes are recorded in processBlock, so their timing doesn't depend on the editor.
+     * Held notes are ended when playback stops and are restarted after loop or seek, notes that are
+     * still held have isSelected == false. Call it from the message thread after recording was
+     * turned off (it locks changeInstanceSyncMutex).
+     */
+    std::vector<Note> takeRecordedNotes();
+    // ============================================================================================
 
-    // This method is called by editor on startup so i think that it is safe to do this
-    //      without any mutexes, by reference
-    const std::vector<Note> &getNotes();
+    ///< Latest notes, the snapshot stays valid while it is held
+    NotesSnapshotPtr getNotesSnapshot();
     std::vector<Note> getOtherInstancesNotes();
 
     /**
@@ -80,17 +137,42 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     Parameters params;
 
     /**
-     * @brief Check if plugin instance manager is active
-     * @return true if active
+     * @brief Check if plugin instance can play
+     * @return true if active (MTS-ESP needs a channel from the instance manager, MPE plays also
+     * while notes sharing isn't ready)
      */
     bool getIsActive() { return isActive; }
 
+    ///< Instance manager's init is done, but it has failed (there is no channel / id)
+    bool hasInstanceSyncFailed() { return instanceSyncFailed; }
+
     bool isPlaying() { return wasPlaying; }
 
+    /**
+     * @brief Memory and threads of the heavy subsystems of this instance (pitch detector, partials
+     *        finder, their buffers and threads), to check that unused ones aren't allocated
+     * @return Multiline report
+     * @note Call it from the message thread
+     */
+    juce::String getFootprintReport();
+
+    // ===================================== PARTIALS FINDING =====================================
+    /**
+     * @brief Turn partials finding mode on or off
+     * Partials finder (with it's FFT and buffer) is created when the mode is turned on and
+     * released when it's turned off, so instances that don't use it don't pay for it. It's thread
+     * is created once and kept. Turning off doesn't wait for jobs, their results are dropped.
+     * @note Call it from the message thread
+     */
+    void setFindPartialsMode(bool newFindPartialsMode);
+
     // ====================================== VOCAL TO MELODY =====================================
     void updateKeys(const std::set<int> &newKeys) {
-        std::scoped_lock lock(keysMutex);
-        keys = newKeys;
+        {
+            std::scoped_lock lock(keysMutex);
+            keys = newKeys;
+        }
+        updateMidiInputMap();
     }
 
     std::vector<Note> getRecordedNotesFromVocal() {
@@ -164,6 +246,9 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
         }
     }
 
+    ///< Claim midi channels for params.numChannelsMTS and prepare notes again (for MTS-ESP)
+    void changedNumChannelsMTS();
+
     void startAuditioning(double newAuditionTime) {
         auditionTime = newAuditionTime;
         stopAuditioning = false;
@@ -192,19 +277,65 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     // atomic because changeInstanceSync is called from setStateInformation
     std::atomic<bool> isActive = false;
     std::unique_ptr<NotesSharingMPE> notesSharingMPE; ///< For MPE
+    std::atomic<bool> instanceSyncFailed = false;
 
     ///< Should be called only from constructor or setStateInformation!
     void changeInstanceSync(Parameters::TuningType newTuningType);
+    /**
+     * @brief Take channel index / instance id when the instance manager's init is done (it's
+     * triggered from the init thread), then share notes and claim extra channels. Also prepares
+     * notes when processBlock() leaves partials finding mode (needPrepareNotes)
+     */
+    void handleAsyncUpdate() override;
+    // ============================================================================================
+
+    // ======================================== MIDI INPUT ========================================
+    ///< Input midi note -> totalCents (-1 if note isn't played), written by updateMidiInputMap()
+    SeqLockArray<int, 128> midiInputMap;
+    std::mutex midiInputMapMutex; ///< For updateMidiInputMap() (only one writer of midiInputMap)
+    std::vector<int> midiInputScale; ///< Under midiInputMapMutex, see setMidiInputScale()
+    ///< Copy of midiInputMap for processBlock (kept if it can't be read consistently)
+    std::array<int, 128> midiInputMapCopy;
+
+    ///< Note on/off from midi input, collected before midiMessages are cleared
+    struct LiveInputEvent {
+        int inputNote = 0;
+        int totalCents = -1;
+        float velocity = 0.0f;
+        bool isNoteOn = false;
+        int sample = 0; ///< Original sample position in the block
+    };
+    std::array<LiveInputEvent, 256> liveInputEvents;
+    int numLiveInputEvents = 0;
+    ///< First events of liveInputEvents that came in a skipped block (see playBlock())
+    int numDeferredLiveInputEvents = 0;
+    ///< Start (in bars) of blocks skipped by playBlock() of MTS, -1 if the last one wasn't
+    double skippedFromMTS = -1.0;
+    ///< Playhead jumped in one of the skipped blocks
+    bool skippedJumpMTS = false;
+    ///< Id of note from midi input for recordPlayedNote() (manual notes use totalCents)
+    static int liveInputRecordId(int inputNote) { return -1 - inputNote; }
+    /**
+     * @brief Collect note events of midi input (for processBlock). Note ons are mapped with
+     * midiInputMap, note offs are collected even if mapping is off (for notes that still play)
+     */
+    void collectLiveInputEvents(const juce::MidiBuffer &midiMessages);
     // ============================================================================================
 
     // ===================================== PARTIALS FINDING =====================================
     double freqs12EDO[128]{0.0};
     std::array<bool, 128> activeMidiNotes{false};
     bool wasPianoRoll = true;
+    ///< Set by audio thread when partials finding mode is left, see handleAsyncUpdate()
+    std::atomic<bool> needPrepareNotes = false;
     int recordingMidiNote = -1;
     bool isRecording = false;
+    // Exist only while findPartialsMode is on (see setFindPartialsMode())
     std::unique_ptr<AccumulatingBuffer> partialsFinderBuffer;
     std::shared_ptr<PartialsFinder> partialsFinder;
+    ///< Incremented when findPartialsMode is turned off, jobs of older generations drop results
+    std::atomic<uint32_t> partialsGeneration = 0;
+    ///< Created with the first partials finder and kept, so turning the mode off doesn't wait
     std::unique_ptr<juce::ThreadPool> threadPool;
 
     void startPartialsFinding();
@@ -227,7 +358,9 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     std::mutex pitchCurveMutex;
     PitchCurve pitchCurve;
 
-    // Pitch detector for vocal input
+    // Pitch detector for vocal input. It, vocalRingBuffer, vocalChunks and vocalAnalysisThread
+    //   exist only while vocal to melody is on (they are created in startRecordingVocal() and
+    //   released in stopRecordingVocal()). Only vocalAnalysisThread uses the detector
     std::unique_ptr<PitchDetectorMPM> pitchDetector;
 
     // Keys from UI. Are needed only for `key snap` mode
@@ -245,15 +378,59 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     ///< Time when max pitch was recorded for the note that is currently being recorded (in bars)
     float noteMaxPitchTime = 0.0f;
 
-    // Buffer for accumulating samples for FFT analysis
+    // Ring buffer with the last vocalFFTSize samples of vocal input. Pitch is analysed every
+    //   vocalToMelodyHopMs, no matter what the block size is, and the buffer is never shifted
     static constexpr int vocalFFTSize = 4096;
-    std::vector<float> vocalAccumBuffer; ///< Accumulation buffer for vocal input
-    int vocalAccumCount = 0;             ///< Number of samples currently in buffer
-    ///< It is playHeadTime but with delay that is caused by vocalAccumBuffer, in bars
+    ///< Decimated analysis has the same accuracy as full rate and is a few times cheaper
+    static constexpr auto vocalAnalysisMode = PitchDetectorMPM::AnalysisMode::Decimated;
+    std::vector<float> vocalRingBuffer; ///< Ring buffer for vocal input
+    int vocalRingWritePos = 0;          ///< Where the next sample goes (= the oldest sample)
+    int vocalRingCount = 0;             ///< Number of valid samples in buffer (<= vocalFFTSize)
+    int vocalSamplesSinceAnalysis = 0;  ///< Number of samples written since the last analysis
+    ///< Time of the oldest sample in vocalRingBuffer (taken from the chunks, so the delay of the
+    ///< ring and of the analysis thread is compensated), in bars
     double pitchTime = 0.0;
 
-    void processVocalInput(const juce::AudioBuffer<float> &buffer, int numSamples,
-                           double sampleRate);
+    ///< Piece of vocal input (or playback stop), from audio thread to vocal analysis thread
+    struct VocalChunk {
+        static constexpr int maxNumSamples = 256;
+        enum Type { Samples, PlaybackStopped };
+
+        Type type = Samples;
+        bool isAfterGap = false; ///< Some chunks before this one were dropped (queue was full)
+        double time = 0.0;       ///< playHeadTime of the first sample, in bars
+        double samplesPerBar = 0.0;
+        double sampleRate = 0.0;
+        int numSamples = 0;
+        std::array<float, maxNumSamples> samples; ///< Mic gain is already applied
+    };
+    std::unique_ptr<SpscQueue<VocalChunk, 256>> vocalChunks; ///< About 1.3 s of input at 48 kHz
+    bool isVocalChunkDropped = false;                         ///< Used only on audio thread
+    std::thread vocalAnalysisThread;
+    std::atomic<bool> stopVocalAnalysis = false;
+    static constexpr int vocalAnalysisPollTimeMs = 2; ///< Sleep time when there is no input
+
+    /**
+     * @brief Split vocal input into chunks (applying mic gain) and push them to vocalChunks
+     * @param blockStartTime playHeadTime of the block, in bars
+     * @param samplesPerBar Needed to get time of every chunk inside of the block
+     * @note Audio thread, doesn't allocate or lock
+     */
+    void pushVocalInput(const juce::AudioBuffer<float> &buffer, int numSamples,
+                        double sampleRate, double blockStartTime, double samplesPerBar);
+    void pushVocalChunk(const VocalChunk &chunk); ///< Audio thread
+    ///< Loop of vocalAnalysisThread: pops and processes chunks until stopVocalAnalysis is set
+    void runVocalAnalysis();
+    void stopVocalAnalysisThread(); ///< Processes the remaining chunks and joins the thread
+
+    /**
+     * @brief Write vocal input to vocalRingBuffer and analyse its pitch every hop (detection, note
+     * segmentation and pitch curve generation)
+     * @note Vocal analysis thread
+     */
+    void processVocalChunk(const VocalChunk &chunk);
+    void vocalPlaybackStopped(); ///< Fixate current note and reset analysis state
+    void resetVocalRing();       ///< Next analysis waits until the ring is full again
     void updateRecordingNote();
     void fixateRecordingNote(); ///< Before calling make sure that isRecNote == true
     void startRecordingNote();
@@ -294,24 +471,138 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
      *      Prepare notes for playback (assign MIDI note numbers and calculate frequencies)
      * If using MPE tuning:
      *      Just set editorKnowsAboutOverflow and pitchesOverflow to false
-     * @note Uses prepareNotesMutex, and in MTS-ESP: notesMutex & manPlNotesMutex.
+     * @param onlyChanges Only notes (and manually played notes) that were added, removed or
+     *                    changed since last preparation get MIDI note numbers, others keep them.
+     *                    Use false if frequencies of all notes could change (A4, state loading)
+     * @note Uses prepareNotesMutex.
      *       SO DON'T USE ANY MUTEX FOR THIS METHOD!
      */
-    void prepareNotes();
+    void prepareNotes(bool onlyChanges = false);
+
+    /**
+     * Notes from piano roll. Every change publishes a new snapshot, so processBlock reads notes
+     * without locking (see SnapshotPublisher)
+     */
+    SnapshotPublisher<NotesSnapshot> notesPublisher{std::make_shared<const NotesSnapshot>()};
+
+    ///< Make snapshot from new notes and publish it (grows playbackScratch first if needed)
+    NotesSnapshotPtr publishNotes(std::vector<Note> newNotes);
+
+    /**
+     * @brief Buffers for playback queries of the audio thread
+     * @note They are reserved in publishNotes() for the largest published snapshot, so the audio
+     *       thread doesn't allocate. Only the audio thread may use them!
+     */
+    struct PlaybackScratch {
+        std::vector<int> sustainedNotesInds;  ///< Indexes of notes that sound at the block end
+        std::vector<int> bendingNotesInds;    ///< Indexes of notes with bend under the playhead
+        std::vector<int> auditionedNotesInds; ///< Indexes of notes under the audition time
+    };
+    PlaybackScratch playbackScratch;
+    size_t playbackScratchCapacity = 0; ///< Reserved size of playbackScratch (message thread)
 
-    std::vector<Note> notes;
+    /**
+     * @brief Fill playbackScratch for current block
+     * @param notesSnapshot Snapshot that is used in current block
+     * @param isPlaying Is host playing now
+     * @param barsInBlock Block duration in bars
+     */
+    void queryScheduledNotes(const NotesSnapshot &notesSnapshot, bool isPlaying,
+                             double barsInBlock);
+
+    ///< Note offs and note ons of piano roll in the block (used only in processBlock)
+    BlockScheduler blockScheduler;
+
+    ///< Current block for tuning backends (playHeadTime is it's start)
+    struct PlaybackBlock {
+        double barsInBlock = 0.0;
+        double barsToSchedule = 0.0; ///< Until the loop end if it is inside the block
+        int numSamples = 0;
+        double sampleRate = 0.0;
+        bool isPlaying = false;
+        bool playheadJumped = false; ///< Loop, seek or time signature change
+    };
+    /**
+     * @brief Play notes (from piano roll, manually played and from midi input) in current block
+     * with tuning backend
+     *
+     * Backends are specialised at compile time: processBlock checks tuning type once per block,
+     * so there are no tuning type checks inside. MPE is explicitly specialised, MTS_ESP and
+     * MTS_SYSEX share slots of freqSlotsManagerMTS and differ only in how freqs are published
+     * (see publishFreqsMTS()).
+     * @note MTS backends don't wait for prepareNotesMutex, the block is skipped if it's locked.
+     */
+    template <Parameters::TuningType tuningType>
+    void playBlock(const PlaybackBlock &block, juce::MidiBuffer &midiMessages);
+    ///< Looks one block ahead for MTS-ESP "PRE Note on"
+    NoteTimeline::Cursor preNoteOnCursor;
+    ///< Detects loops and seeks of the host (used only in processBlock)
+    PlayheadTracker playheadTracker;
 
     std::atomic<bool> wasPlaying = false;
 
-    ///< {totalCents -> velocity} of notes(keys) that are currently played manually
+    ///< Note on or note off of manually played note, from editor to audio thread
+    struct ManualNoteEvent {
+        int totalCents = 0;
+        float velocity = 0.0f;
+        bool isNoteOn = false;
+        double timeMs = 0.0; ///< juce::Time::getMillisecondCounterHiRes() when it was sent
+        bool isRecorded = true; ///< Note on is recorded if params.recordManuallyPlayedNotes
+    };
+    SpscQueue<ManualNoteEvent, 256> manualNoteEvents;
+    /**
+     * {totalCents -> velocity} of notes(keys) that are currently played manually, as they were
+     * sent to manualNoteEvents (used only on the message thread)
+     */
     std::map<int, float> manuallyPlayedNotes;
-    std::mutex manPlNotesMutex; ///< For operations with manually played notes
-    std::mutex notesMutex;      ///< For operations with notes
     /**
-     * For prepareNotes(), mostly needed for MTS-ESP.
-     * While prepareNotesMutex is locked, manPlNotesMutex and notesMutex can be locked too, not
-     *    vice versa!
+     * @brief Pop next manual note event (for processBlock)
+     * @param sample Set to sample of the block for event, events keep distances between them
+     *               (first event of the block is at sample 0)
      */
+    bool popManualNoteEvent(ManualNoteEvent &event, int &sample, int numSamples,
+                            double sampleRate);
+    double firstManualNoteEventMs = -1.0; ///< Time of first event popped in current block
+
+    // ================================= RECORDING OF PLAYED NOTES ================================
+    ///< From audio thread to editor, only for progress display
+    SpscQueue<RecordedNoteEvent, 1024> recordedNoteEvents;
+    static constexpr size_t maxRecordedNotes = 8192;
+    /**
+     * Notes of current take, reserved for maxRecordedNotes (notes that don't fit aren't
+     * recorded). Audio thread appends to it, it's taken under changeInstanceSyncMutex
+     */
+    std::vector<Note> recordedTake;
+    struct RecordingNote {
+        int totalCents;
+        float velocity;
+        size_t takeInd; ///< Index in recordedTake
+    };
+    ///< id -> note that is held and recorded now (used in processBlock and takeRecordedNotes())
+    FixedCapacityMap<int, RecordingNote, 256> recordingNotes;
+    bool wasRecordingPlayedNotes = false; ///< Was recording on in previous block
+    // Current block (set by updateRecording())
+    bool isRecordingBlock = false;
+    double recordingBlockTime = 0.0;
+    double recordingBarsInBlock = 0.0;
+    int recordingNumSamples = 1;
+    double recordingEndTime = 0.0; ///< End of previous block in bars
+    /**
+     * @brief Start block of recording: end held notes on stop, restart them at the new position
+     * after loop or seek, record notes from midi input
+     */
+    void updateRecording(double playHeadTime, double barsInBlock, double barsToSchedule,
+                         int numSamples, bool isPlaying, bool playheadJumped);
+    ///< Record note on or note off at sample of current block (if recording is on)
+    void recordPlayedNote(int id, int totalCents, float velocity, bool isNoteOn, int sample);
+    ///< End all recording notes at time and (if restart) start them again at newTime
+    void cutRecordingNotes(double time, bool restart, double newTime);
+    ///< Append note that starts at time to recordedTake (check that it has room first)
+    void startTakeNote(int totalCents, float velocity, double time);
+    void endTakeNote(size_t takeInd, double time);
+    // ============================================================================================
+
+    ///< For prepareNotes(), mostly needed for MTS-ESP.
     std::mutex prepareNotesMutex;
     ///< if for some reason setStateInformation() was called not on plugin startup
     std::mutex changeInstanceSyncMutex;
@@ -331,12 +622,21 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
         int noteInd; // == midiNote
     };
 
-    ///< Contains midi note number (0-127) for each note from notes vector
+    ///< Notes that notesIndexes were made for (under prepareNotesMutex)
+    NotesSnapshotPtr preparedNotes = std::make_shared<const NotesSnapshot>();
+    ///< Contains slot of freqSlotsManagerMTS for each note from preparedNotes
     std::vector<int> notesIndexes;
-    ///< Manually played note's totalCents -> midi note number (0-127)
-    std::map<int, int> manPlNoteToMidiNoteMTS;
-    ///< Audition note's id -> PlAudNoteDataMTS
-    std::map<uint64_t, PlAudNoteDataMTS> auditioningNotesMTS;
+    ///< Was prepareNotes() called in MTS-ESP mode (so prepareNotes(true) can be used)
+    bool notesPreparedMTS = false;
+    /**
+     * Manually played note's totalCents -> acquired slot. Is changed by processBlock (and slots
+     * are retained by prepareNotes()) under prepareNotesMutex
+     */
+    FixedCapacityMap<int, int, FreqSlotsManagerMTS::maxSlots> manPlNoteToMidiNoteMTS;
+    ///< Max number of notes from piano roll that are auditioned at once
+    static constexpr size_t maxAuditioningNotesMTS = 128;
+    ///< Audition note's id -> PlAudNoteDataMTS (notes that don't fit aren't auditioned)
+    FixedCapacityMap<uint64_t, PlAudNoteDataMTS, maxAuditioningNotesMTS> auditioningNotesMTS;
     /**
      * Is used to indicate that this frequency is not being used. Freq in Hz.
      * And if it is still used for a veeery short period of time (by mistake?), then there will be
@@ -344,42 +644,131 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
      * XT).
      */
     const double noFreq = 1e-2;
-    ///< Contains frequency in Hz for each midi note
-    double freqs[128]{noFreq};
+    ///< Contains frequency in Hz for each slot of freqSlotsManagerMTS (midi note of our channel)
+    double freqs[FreqSlotsManagerMTS::maxSlots]{noFreq};
     ///< if midi note is bending it has != -1 original totalCents here
-    int beforeBendTotalCents[128];
+    int beforeBendTotalCents[FreqSlotsManagerMTS::maxSlots];
+    ///< Frequencies of bending notes in current block (reserved in prepareNotes())
+    std::vector<double> bendingNotesFreqs;
+    ///< Samples since bends were updated last time (for Parameters::bendControlRateMTS)
+    int samplesSinceBendUpdateMTS = 0;
 
     /**
      * TotalCents of notes from notes vector (so from piano roll) that are currently played (bends
-     * are not taken into account)
+     * are not taken into account). Use isPlayedTotalCentsMTS() and setPlayedTotalCentsMTS()
      */
-    std::set<int> currPlayedNotesTotalCents;
+    std::bitset<Parameters::num_octaves * 1200> currPlayedNotesTotalCents;
+    bool isPlayedTotalCentsMTS(int totalCents) const {
+        return totalCents >= 0 && totalCents < static_cast<int>(currPlayedNotesTotalCents.size()) &&
+               currPlayedNotesTotalCents[totalCents];
+    }
+    void setPlayedTotalCentsMTS(int totalCents, bool isPlayed) {
+        if (totalCents >= 0 && totalCents < static_cast<int>(currPlayedNotesTotalCents.size())) {
+            currPlayedNotesTotalCents[totalCents] = isPlayed;
+        }
+    }
 
     /**
-     * Midi note numbers of all notes that are playing now (including notes and
-     * manuallyPlayedNotes)
+     * Midi note numbers (slots of freqSlotsManagerMTS) of all notes that are playing now
+     * (including notes and manuallyPlayedNotes)
      */
-    std::set<int> currPlayedNotesIndexes;
+    std::bitset<FreqSlotsManagerMTS::maxSlots> currPlayedNotesIndexes;
 
     /**
-     * We need to save as much as possible frequencies in freqs[128] for notes that were played
-     * manually (and there are no notes with same pitch in piano roll), because if we will change
-     * frequency of the note that was just played, then the residual sound (for example from reverb)
-     * will also change frequency.
+     * Assigns frequencies to midi notes. We need to save as much as possible frequencies in
+     * freqs for notes that were played (manually too), because if we will change frequency
+     * of the note that was just played, then the residual sound (for example from reverb) will
+     * also change frequency. So least recently used midi notes are retuned first.
+     */
+    FreqSlotsManagerMTS freqSlotsManagerMTS;
+    static_assert(FreqSlotsManagerMTS::maxChannels == PluginInstanceManager::maxChannels);
+    /**
+     * Extra midi channels (0-15) that instance has in addition to params.channelIndex, slot s of
+     * freqSlotsManagerMTS is played in channel extraChannelsMTS[s / 128 - 1] if s >= 128.
+     * Entries of released channels are kept, so note offs of playing notes still go there.
+     */
+    std::array<int, PluginInstanceManager::maxChannels - 1> extraChannelsMTS{};
+    ///< Claim extra channels and set number of slots (prepareNotesMutex must be locked)
+    void applyNumChannelsMTS();
+    ///< Midi messages for slot of freqSlotsManagerMTS
+    juce::MidiMessage noteOnMTS(int slot, float velocity) const;
+    juce::MidiMessage noteOffMTS(int slot) const;
+    /**
+     * @brief Mark freqs to be published at the end of the next block (prepareNotesMutex must be
+     * locked). Audio thread is the only writer of tuning tables, so freqs of prepareNotes() are
+     * handed over to it under the same lock.
+     */
+    void updateFreqsMTS();
+    /**
+     * @brief Publish freqs (if they were changed) with backend: MTS_ESP updates tuning of our
+     * channels in MTS-ESP master, MTS_SYSEX sends them with midiMessages (see sendFreqsSysEx())
+     * @note For the audio thread (under prepareNotesMutex)
      */
-    RelevanceQueue<double> manPlNotesTotCentsHistory;
+    template <Parameters::TuningType tuningType>
+    void publishFreqsMTS(juce::MidiBuffer &midiMessages);
+    ///< Freqs were changed since they were published last time (under prepareNotesMutex)
+    bool freqsChangedMTS = true;
+
+    // For MTS_SYSEX (under prepareNotesMutex): notes are played in midi channel 1
+    ///< Frequencies that synth has now (0.0 if it wasn't sent)
+    std::array<double, FreqSlotsManagerMTS::slotsPerChannel> sentFreqsSysEx{};
+    std::array<uint8_t, tuning_sysex::maxMessageSize> sysExData;
+    ///< Bytes that tuning messages of one block take in MidiBuffer (each key in own message)
+    static constexpr int maxSysExBytesPerBlock =
+        FreqSlotsManagerMTS::slotsPerChannel *
+        (6 + tuning_sysex::headerSize + tuning_sysex::bytesPerChange + 1);
+    ///< Reserved size of sysExMidiBuffers in bytes (events of the block and tuning messages)
+    static constexpr int sysExMidiBufferSize = 65536;
+    /**
+     * Events of the block merged with tuning messages (reserved in prepareToPlay()). The merged
+     * buffer is swapped with midiMessages, so one of them may hold the host's buffer then
+     */
+    std::array<juce::MidiBuffer, 2> sysExMidiBuffers;
+    /**
+     * @brief Send changed frequencies (if freqsChangedMTS) as single note tuning changes
+     *
+     * Key is retuned right before its first note on in the block, so notes that end earlier
+     * keep their tuning. Keys without note on are retuned at the block start.
+     * @note Nothing is allocated, and the host's buffer doesn't grow: events are merged into one
+     * of sysExMidiBuffers, that is swapped with midiMessages. If none of them has room for the
+     * events, tuning is sent in the next block.
+     */
+    void sendFreqsSysEx(const double *newFreqs, juce::MidiBuffer &midiMessages);
+
+    ///< Acquire midi notes for all notes (and manually played notes), for prepareNotes()
+    void prepareAllNotesMTS();
+    ///< Acquire midi notes only for changed notes, for prepareNotes()
+    void prepareChangedNotesMTS();
+    /**
+     * @brief Acquire midi note (slot of freqSlotsManagerMTS) for frequency
+     * @return Slot or -1 (then pitchesOverflow is set)
+     */
+    int acquireFreqSlotMTS(double freq);
 
     double getNoteFreq(const Note &note);
     double getNoteFreqAtTime(const Note &note, double time);
+    ///< Interval from A4 in cents of the note (with bend) at time (in bars)
+    double getNoteCentsFromA4(const Note &note, double time);
     double getFreqFromTotalCents(float totalCents);
     int getTotalCentsFromFreq(double freq);
 
     /**
-     * @brief Find index in freqs array for a given frequency
+     * @brief Find index in freqs array for a given frequency (O(1), with freqSlotsManagerMTS)
      * @param freq Frequency to find
-     * @return Index (0-127) or -1 if not found
+     * @return Index (slot) or -1 if not found
      */
     int findFreqInd(double freq);
+
+    /**
+     * @brief Start voice of note that is played live (manually or from midi input)
+     * @param needUpdateFreqs Is set to true if slot was retuned (freqs must be published)
+     * @return Slot or -1 if there are no free slots
+     */
+    int startLiveVoiceMTS(int totalCents, float velocity, juce::MidiBuffer &midiMessages,
+                          int sample, bool &needUpdateFreqs);
+    void stopLiveVoiceMTS(int slot, juce::MidiBuffer &midiMessages, int sample);
+    ///< Input midi note -> slot of notes from midi input
+    FixedCapacityMap<int, int, 128> liveInputNotesMTS;
     // ============================================================================================
 
     // ========================================= USING MPE ========================================
@@ -387,76 +776,81 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     // In contrast to MTS-ESP, there 2+ notes with same totalCents can be played simultaneously
     //      (useful if these notes have different bend)
 
+    ///< Midi note + pitch bend of pitches. Is updated in processBlock().
+    PitchBendMPE pitchBendMPE;
+
     /**
-     * No pitch bend = 8192; 0 and 16383 are -semiBendRangeMPE and +semiBendRangeMPE semitones
-     * respectively. Is updated in processBlock().
+     * Max number of simultaneously playing live voices. Without economy mode there are max 15
+     * voices (one per midi channel), in economy mode several voices share a channel.
+     * If voices table is full, it's treated like there are no free midi channels.
      */
-    double centsPerBendMPE = 48 * 100.0 / 8192;
-
-    ///< Is used to correct totalCents taking into account A4 freq. Is updated in processBlock().
-    double corrTotalCentsMPE = 0;
-
-    struct PlNoteDataMPE {
-        int totalCents;
-        bool hasBend;
-        int channel;
-        int midiNote;
-    };
+    static constexpr size_t maxVoicesMPE = 128;
 
-    ///< note's id -> PlNoteDataMPE
-    std::map<uint64_t, PlNoteDataMPE> playingNotesMPE, auditioningNotesMPE;
+    // Voices tables are flat arrays, so processBlock() doesn't allocate on note on/off
+    ///< Voices of notes from piano roll, indexed by midi channel (note's id -> voice)
+    VoicesMPE playingNotesMPE, auditioningNotesMPE;
     ///< Manually played note's totalCents -> {midi channel (2-16), midi note number}
-    std::map<int, std::pair<int, int>> manPlNoteToChAndMidiNoteMPE;
+    FixedCapacityMap<int, std::pair<int, int>, maxVoicesMPE> manPlNoteToChAndMidiNoteMPE;
+    ///< Input midi note -> {midi channel (2-16), midi note number} of notes from midi input
+    FixedCapacityMap<int, std::pair<int, int>, 128> liveInputNotesMPE;
     std::unique_ptr<ChannelsManagerMPE> channelsManagerMPE;
 
+    /**
+     * @brief Get midi channel for a new voice (with channelsManagerMPE). If the channel was stolen
+     * (voice stealing), voices that were playing in it are silenced first.
+     * @param sample Sample offset of the new voice's note on in the block
+     * @param voices Table the voice goes to (if any), it's channel must have space for it
+     * @return Midi channel 2-16 or -1 if there are no free channels
+     */
+    int allocateChannelMPE(int bendMPE, bool noteWithBend, int totalCents, float velocity,
+                           juce::MidiBuffer &midiMessages, int sample,
+                           VoicesMPE *voices = nullptr);
+    /**
+     * Send note off for all voices in midi channel ch. Their entries stay in voices tables with
+     * channel -1, so they aren't played again until they end (or are released)
+     */
+    void silenceChannelMPE(int ch, juce::MidiBuffer &midiMessages, int sample);
+    /**
+     * @brief Start voice of note that is played live (manually or from midi input)
+     * @return {midi channel (2-16), midi note number}, channel is -1 if there are no free channels
+     */
+    std::pair<int, int> startLiveVoiceMPE(int totalCents, float velocity,
+                                          juce::MidiBuffer &midiMessages, int sample);
+    ///< Channel -1 means that voice was already silenced (stolen)
+    void stopLiveVoiceMPE(std::pair<int, int> chAndMidiNote, juce::MidiBuffer &midiMessages,
+                          int sample);
+
     /**
      * totalcents of notes that are currently played from piano roll -> number of that notes
-     * We need map instead of set because there can be several notes that are been played with
-     * same totalCents (but with different note bend, for example)
+     * We need counters instead of set because there can be several notes that are been played
+     * with same totalCents (but with different note bend, for example)
      */
-    std::map<int, int> currPlayedNotesTotalCentsMPE;
+    std::array<int, Parameters::num_octaves * 1200> currPlayedNotesTotalCentsMPE{};
 
     void addCurrPlayedNotesTotalCentsMPE(int totalCents) {
-        if (currPlayedNotesTotalCentsMPE.contains(totalCents)) {
+        if (totalCents >= 0 && totalCents < currPlayedNotesTotalCentsMPE.size()) {
             currPlayedNotesTotalCentsMPE[totalCents]++;
-        } else {
-            currPlayedNotesTotalCentsMPE[totalCents] = 1;
         }
     }
 
     void delCurrPlayedNotesTotalCentsMPE(int totalCents) {
-        if (currPlayedNotesTotalCentsMPE.contains(totalCents)) {
+        if (totalCents >= 0 && totalCents < currPlayedNotesTotalCentsMPE.size() &&
+            currPlayedNotesTotalCentsMPE[totalCents] > 0) {
             currPlayedNotesTotalCentsMPE[totalCents]--;
-            if (currPlayedNotesTotalCentsMPE[totalCents] == 0) {
-                currPlayedNotesTotalCentsMPE.erase(totalCents);
-            }
         }
     }
 
-    /**
-     * @brief Calculate midi note and midi pitch bend from totalCents
-     * @param totalCents octave*1200 + cents
-     * @return std::pair<int, int>: first value is midi note in range [0...127] and
-     * second value is MPE bend in range [0...16383], where 8192 is no bend
-     */
-    std::pair<int, int> calcMidiNoteAndBendMPE(int totalCents) {
-        double correctedTotalCents = totalCents + corrTotalCentsMPE;
-        // 0 totalCents = C0 = 12th midi note
-        int midiNote = juce::jlimit(0, 127, 12 + juce::roundToInt(correctedTotalCents / 100.0));
-        double bendCents = correctedTotalCents - (midiNote - 12) * 100;
-        int bendMPE = juce::jlimit(0, 16383, 8192 + juce::roundToInt(bendCents / centsPerBendMPE));
-        return std::make_pair(midiNote, bendMPE);
+    std::pair<int, int> calcMidiNoteAndBendMPE(int totalCents) const {
+        return pitchBendMPE.midiNoteAndBend(totalCents);
     }
-
-    ///< Calculate midi bend based on Note.bend while playing it
-    int calcBendMPE(const Note &note, double currTime) {
-        double totalCents = note.octave * 1200 + note.cents + corrTotalCentsMPE;
-        double bendCentsBase = totalCents - juce::roundToInt(totalCents / 100.0) * 100;
-        double bendCents = bendCentsBase + note.bend * (currTime - note.time) / note.duration;
-        int bendMPE = juce::jlimit(0, 16383, 8192 + juce::roundToInt(bendCents / centsPerBendMPE));
-        return bendMPE;
+    int calcBendMPE(const Note &note, double currTime) const {
+        return pitchBendMPE.noteBend(note, currTime);
     }
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioPluginAudioProcessor)
 };
+
+template <>
+void AudioPluginAudioProcessor::playBlock<Parameters::MPE>(const PlaybackBlock &block,
+                                                           juce::MidiBuffer &midiMessages);
 } // namespace audio_plugin
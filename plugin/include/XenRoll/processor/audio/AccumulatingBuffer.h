@@ -69,6 +69,15 @@ class AccumulatingBuffer {
         writePos = 0;
     }
 
+    /**
+     * @brief Heap memory in bytes (buffer grows while samples are added and isn't shrunk)
+     * @note Thread-safe
+     */
+    size_t getMemoryUsage() {
+        const juce::ScopedLock lock(mutex); // Thread-safe
+        return static_cast<size_t>(buffer.getNumSamples()) * sizeof(float);
+    }
+
   private:
     juce::AudioBuffer<float> buffer;
     int writePos = 0;
@@ -15,6 +15,7 @@
 
 #include "XenRoll/data/PartialsTypes.h"
 #include <juce_audio_basics/juce_audio_basics.h>
+#include <complex>
 #include <juce_dsp/juce_dsp.h>
 
 namespace audio_plugin {
@@ -27,6 +28,8 @@ class PartialsFinder {
     void setSampleRate_(double newSampleRate);
     void setFFTSize(int newFFTSize);
     partialsVec findPartials(juce::AudioBuffer<float> buffer);
+    ///< Heap memory in bytes (FFT tables are estimated as fftSize complex numbers)
+    size_t getMemoryUsage() const { return fftSize * sizeof(std::complex<float>); }
 
   private:
     PartialsFindPosStrat posFindStrat = PartialsFindPosStrat::maxSpectralFlatness;
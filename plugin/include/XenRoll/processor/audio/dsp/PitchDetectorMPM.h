@@ -18,9 +18,33 @@ using PrevPitches = std::pair<std::pair<long long, float>, std::pair<long long,
  */
 class PitchDetectorMPM {
   public:
-    PitchDetectorMPM(int fftSize = 4096);
+    enum class AnalysisMode {
+        FullRate, ///< Window of windowSize samples is analysed at host sample rate
+        /// Window is low-pass filtered and decimated to 11-16 kHz before analysis, FFT size is
+        /// chosen from voice range (fundamentals are <= 1500 Hz, so nothing is lost)
+        Decimated
+    };
+
+    /**
+     * @param windowSize Max number of input samples that are analysed (at host sample rate),
+     * power of 2. It is also FFT size for AnalysisMode::FullRate
+     */
+    PitchDetectorMPM(int windowSize = 4096);
     ~PitchDetectorMPM();
 
+    /**
+     * @brief Allocate FFT and buffers for current analysis mode and voice range
+     * @note Allocates. detectPitch() calls it itself if sample rate changes
+     */
+    void prepare(double sampleRate);
+
+    ///< Call prepare() after changing it
+    void setAnalysisMode(AnalysisMode newAnalysisMode) {
+        analysisMode = newAnalysisMode;
+        preparedSampleRate = -1.0;
+    }
+    AnalysisMode getAnalysisMode() const { return analysisMode; }
+
     /**
      * @brief Detect pitch from audio buffer
      * @param audioBuffer Audio buffer to analyze (mono)
@@ -30,6 +54,20 @@ class PitchDetectorMPM {
      */
     float detectPitch(const std::vector<float> &audioBuffer, double sampleRate, bool wasSilence);
 
+    /**
+     * @brief Detect pitch from audio that is stored in two parts, so a ring buffer can be
+     * analysed without shifting it
+     * @param firstPart Older samples (mono)
+     * @param firstSize Number of older samples
+     * @param secondPart Newer samples (mono), can be nullptr if secondSize is 0
+     * @param secondSize Number of newer samples
+     * @param sampleRate Sample rate in Hz
+     * @param wasSilence If was silence before
+     * @return Detected frequency in Hz, or 0.0f if no clear pitch detected
+     */
+    float detectPitch(const float *firstPart, int firstSize, const float *secondPart,
+                      int secondSize, double sampleRate, bool wasSilence);
+
     /**
      * @brief Reset the detector state
      */
@@ -39,15 +77,31 @@ class PitchDetectorMPM {
      * @brief Set voice frequency range for filtering
      * @param minFreq Minimum frequency in Hz (default: 70 Hz)
      * @param maxFreq Maximum frequency in Hz (default: 1500 Hz)
+     * @note Call prepare() after changing it (FFT size of decimated analysis depends on it)
      */
     void setVoiceRange(float minFreq, float maxFreq);
 
+    ///< Heap memory in bytes (FFT tables are estimated as fftSize complex numbers)
+    size_t getMemoryUsage() const;
+
   private:
     // FFT configuration
+    const int windowSize;
     int fftSize;
     std::unique_ptr<juce::dsp::FFT> fft;
     std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
 
+    // Decimation (AnalysisMode::Decimated)
+    AnalysisMode analysisMode = AnalysisMode::FullRate;
+    ///< Sample rate of the last prepare() (0 for full rate), -1 if settings changed after it
+    double preparedSampleRate = -1.0;
+    double analysisRate = 0.0;       ///< Sample rate of analysed signal (after decimation)
+    int decimationFactor = 1;
+    static constexpr double minDecimatedRate = 11000.0; ///< Decimated rate is >= it
+    static constexpr float minPeriodsInWindow = 4.0f;   ///< Of min voice freq, sets FFT size
+    std::vector<float> antiAliasTaps; ///< Low-pass FIR (windowed sinc), odd number of taps
+    std::vector<float> inputBuffer;   ///< Contiguous input, padded with zeros for the FIR
+
     // Voice range filtering (in Hz)
     float minVoiceFreq;
     float maxVoiceFreq;
@@ -57,7 +111,7 @@ class PitchDetectorMPM {
     static constexpr float MPM_SMALL_CUTOFF = 0.5f;
 
     // Buffers for autocorrelation (pre-allocated for real-time)
-    std::vector<float> fftBuffer;
+    std::vector<float> fftBuffer; ///< Analysed window, then spectrum, then autocorrelation
     std::vector<float> nsdfBuffer; // Normalized Square Difference Function
     std::vector<int> peakBuffer;   // Reusable buffer for peak positions
     int peakCount;                 // Actual number of peaks in peakBuffer
@@ -70,12 +124,20 @@ class PitchDetectorMPM {
 
     void resetJumpsDetection();
 
+    ///< Copy input (both parts one after another) to fftBuffer at host sample rate
+    void copyInput(const float *firstPart, int firstSize, const float *secondPart,
+                   int secondSize);
+
+    ///< Low-pass filter the newest fftSize * decimationFactor samples of input and write every
+    ///< decimationFactor-th of them to fftBuffer
+    void decimateInput(const float *firstPart, int firstSize, const float *secondPart,
+                       int secondSize);
+
     /**
-     * @brief Calculate Normalized Square Difference Function (NSDF)
-     * @param audioBuffer Input audio buffer
+     * @brief Calculate Normalized Square Difference Function (NSDF) of the window in fftBuffer
      * @return NSDF values (stored in nsdfBuffer, returns reference)
      */
-    const std::vector<float> &calculateNSDF(const std::vector<float> &audioBuffer);
+    const std::vector<float> &calculateNSDF();
 
     /**
      * @brief Find peaks in NSDF
@@ -1,54 +1,80 @@
 #pragma once
 
+#include "XenRoll/data/VoiceStealingMPE.h"
 #include <array>
 #include <atomic>
-#include <vector>
+#include <bit>
+#include <cstdint>
+#include <utility>
 
 namespace audio_plugin {
+/**
+ * @brief Allocates MPE midi channels (2-16) for notes
+ *
+ * Channels are tracked with bitmasks, free channels are kept in a fixed LRU list (released
+ * channels go to it's end), so allocate and release are O(1) (searches are bounded by 15 channels
+ * and use bit scans). If there are no free channels, a channel can be stolen from playing notes
+ * according to the voice stealing policy.
+ *
+ * @note Not thread safe (except setEconomyMode()), use it from the audio thread.
+ */
 class ChannelsManagerMPE {
   public:
+    static constexpr int numChannels = 15;
+
     ChannelsManagerMPE(bool economyMode = false) : economyMode(economyMode) {
         channelsNumMPE.fill(0);
         channelsBendMPE.fill(-1);
+        releaseStamps.fill(0);
+        voices.fill({});
+        for (int ind = 0; ind < numChannels; ++ind) {
+            pushBackFree(ind);
+        }
     }
 
     void setEconomyMode(bool newEconomyMode) { economyMode = newEconomyMode; }
+    void setVoiceStealing(VoiceStealingMPE newVoiceStealing) {
+        voiceStealing = newVoiceStealing;
+    }
 
     /**
      * @brief Get midi channel
      * @param bendMPE Midi pitch bend of candidate note
      * @param noteWithBend Candidate note has bend (Note.bend != 0 cents)
-     * @return Midi channel 2-16, or -1 if there are no free channels.
+     * @param totalCents Pitch of candidate note (for voice stealing)
+     * @param velocity Velocity of candidate note (for voice stealing)
+     * @return std::pair<int, bool>: first value is midi channel 2-16, or -1 if there are no free
+     * channels (and voice stealing is off), second value is true if channel was stolen: all notes
+     * that were playing in it must be stopped (without calling noteReleasedMPE())
      */
-    int allocateChannelMPE(int bendMPE, bool noteWithBend) {
+    std::pair<int, bool> allocateChannelMPE(int bendMPE, bool noteWithBend, int totalCents,
+                                            float velocity) {
         // First priority - find midi channel with same midi pitch bend
-        // We'll start searching starting with most recently used midi channels.
-        for (int i = 14; i >= 0; --i) {
-            int ind = channelsIndexesMPE[i];
-            if ((channelsNumMPE[ind] == 0 || !noteWithBend) && (channelsBendMPE[ind] == bendMPE) &&
-                (economyMode || (channelsNumMPE[ind] == 0))) {
-                channelsNumMPE[ind]++;
-                if (noteWithBend) {
-                    channelsBendMPE[ind] = -1;
-                }
-                return ind + 2;
-            }
-        }
-        // Second priority - find free midi channel
-        // We'll start searching starting with least recently used midi channels.
-        for (int i = 0; i < 15; ++i) {
-            int ind = channelsIndexesMPE[i];
+        // Most recently released midi channels are preferred.
+        uint16_t candidates = noteWithBend ? freeMask : (economyMode ? ~bentMask : freeMask);
+        int ind = findMostRecentlyReleased(candidates & channelsMask, bendMPE);
+        if (ind != -1) {
             if (channelsNumMPE[ind] == 0) {
-                if (noteWithBend) {
-                    channelsBendMPE[ind] = -1;
-                } else {
-                    channelsBendMPE[ind] = bendMPE;
-                }
-                channelsNumMPE[ind] = 1;
-                return ind + 2;
+                unlinkFree(ind);
             }
+            occupy(ind, bendMPE, noteWithBend, totalCents, velocity);
+            return {ind + 2, false};
+        }
+        // Second priority - least recently released free midi channel
+        if (freeHead != -1) {
+            ind = freeHead;
+            unlinkFree(ind);
+            occupy(ind, bendMPE, noteWithBend, totalCents, velocity);
+            return {ind + 2, false};
         }
-        return -1;
+        // No free channels - steal one
+        ind = findChannelToSteal(bendMPE);
+        if (ind == -1) {
+            return {-1, false};
+        }
+        channelsNumMPE[ind] = 0;
+        occupy(ind, bendMPE, noteWithBend, totalCents, velocity);
+        return {ind + 2, true};
     }
 
     /**
@@ -61,11 +87,10 @@ class ChannelsManagerMPE {
             channelsNumMPE[ind]--;
         } else if (channelsNumMPE[ind] == 1) {
             channelsNumMPE[ind] = 0;
+            freeMask |= bit(ind);
             // Send the midi channel to the end of the "relevance queue"
-            auto it = std::find(channelsIndexesMPE.begin(), channelsIndexesMPE.end(), ch - 2);
-            if (it != channelsIndexesMPE.end()) {
-                std::rotate(it, it + 1, channelsIndexesMPE.end());
-            }
+            releaseStamps[ind] = ++releaseCounter;
+            pushBackFree(ind);
         }
     }
 
@@ -75,25 +100,148 @@ class ChannelsManagerMPE {
     }
 
   private:
+    static constexpr uint16_t channelsMask = (1u << numChannels) - 1;
+    static uint16_t bit(int ind) { return static_cast<uint16_t>(1u << ind); }
+
     ///< Value represents number of currently playing notes in midi channel (2-16)
-    std::array<int, 15> channelsNumMPE;
+    std::array<int, numChannels> channelsNumMPE;
     /**
      * If false: Each note must have is't own midi channel, so max number in channelsNumMPE
      *           is 1.
      */
     std::atomic<bool> economyMode = false;
+    VoiceStealingMPE voiceStealing = VoiceStealingMPE::NoStealing;
     /**
      * Value represents midi pitch bend (0-16383) for midi channel (2-16) that is currently
      * used. Value -1 means that this midi channel has note with bend, so other notes should
      * not occupy this channel (because in this midi channel pitch bend is not constant).
      */
-    std::array<int, 15> channelsBendMPE;
+    std::array<int, numChannels> channelsBendMPE;
+
+    uint16_t freeMask = channelsMask; ///< Channels without notes
+    uint16_t bentMask = channelsMask; ///< Channels with channelsBendMPE == -1
+
     /**
      * When the same channel is reused almost immediately for another note with a different
-     * pitch bend, artifacts may appear in some synthesizers. Therefore, this vector serves as
-     * a queue. When the channel is released, it is moved to the end of the queue to be used
-     * last.
+     * pitch bend, artifacts may appear in some synthesizers. Therefore free channels are kept in
+     * a doubly linked list, a released channel goes to it's end to be used last.
      */
-    std::vector<int> channelsIndexesMPE = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14};
+    std::array<int8_t, numChannels> freePrev, freeNext;
+    int freeHead = -1, freeTail = -1;
+    std::array<uint32_t, numChannels> releaseStamps; ///< When channel was released last time
+    uint32_t releaseCounter = 0;
+
+    ///< Last note that got the channel (for voice stealing)
+    struct Voice {
+        uint32_t stamp = 0; ///< Allocation order
+        int totalCents = 0;
+        float velocity = 0.0f;
+    };
+    std::array<Voice, numChannels> voices;
+    uint32_t allocCounter = 0;
+
+    void occupy(int ind, int bendMPE, bool noteWithBend, int totalCents, float velocity) {
+        channelsNumMPE[ind]++;
+        freeMask &= ~bit(ind);
+        if (noteWithBend) {
+            channelsBendMPE[ind] = -1;
+            bentMask |= bit(ind);
+        } else if (channelsNumMPE[ind] == 1) {
+            channelsBendMPE[ind] = bendMPE;
+            bentMask &= ~bit(ind);
+        }
+        voices[ind] = {++allocCounter, totalCents, velocity};
+    }
+
+    uint16_t sameBendMask(int bendMPE) const {
+        uint16_t mask = 0;
+        for (int ind = 0; ind < numChannels; ++ind) {
+            mask |= static_cast<uint16_t>(channelsBendMPE[ind] == bendMPE) << ind;
+        }
+        return mask;
+    }
+
+    ///< Channel from mask with channelsBendMPE == bendMPE that was released last, or -1
+    int findMostRecentlyReleased(uint16_t mask, int bendMPE) const {
+        int best = -1;
+        for (; mask != 0; mask &= mask - 1) {
+            const int ind = std::countr_zero(mask);
+            if (channelsBendMPE[ind] != bendMPE) {
+                continue;
+            }
+            if (best == -1 || releaseStamps[ind] >= releaseStamps[best]) {
+                best = ind;
+            }
+        }
+        return best;
+    }
+
+    ///< Busy channel chosen by voiceStealing policy, -1 if stealing is off
+    int findChannelToSteal(int bendMPE) const {
+        if (voiceStealing == VoiceStealingMPE::NoStealing) {
+            return -1;
+        }
+        uint16_t mask = channelsMask;
+        if (voiceStealing == VoiceStealingMPE::StealSameBend) {
+            // Channel with same pitch bend, so synth doesn't get pitch bend jump
+            const uint16_t sameBend = sameBendMask(bendMPE) & ~bentMask;
+            if (sameBend != 0) {
+                mask = sameBend;
+            }
+        }
+        int best = -1;
+        for (; mask != 0; mask &= mask - 1) {
+            const int ind = std::countr_zero(mask);
+            if (best == -1 || isBetterToSteal(voices[ind], voices[best])) {
+                best = ind;
+            }
+        }
+        return best;
+    }
+
+    ///< Ties (and StealOldest, StealSameBend) are resolved by taking the oldest note
+    bool isBetterToSteal(const Voice &a, const Voice &b) const {
+        switch (voiceStealing) {
+        case VoiceStealingMPE::StealQuietest:
+            if (a.velocity != b.velocity)
+                return a.velocity < b.velocity;
+            break;
+        case VoiceStealingMPE::StealLowest:
+            if (a.totalCents != b.totalCents)
+                return a.totalCents < b.totalCents;
+            break;
+        case VoiceStealingMPE::StealHighest:
+            if (a.totalCents != b.totalCents)
+                return a.totalCents > b.totalCents;
+            break;
+        default:
+            break;
+        }
+        return a.stamp < b.stamp;
+    }
+
+    void pushBackFree(int ind) {
+        freePrev[ind] = static_cast<int8_t>(freeTail);
+        freeNext[ind] = -1;
+        if (freeTail != -1) {
+            freeNext[freeTail] = static_cast<int8_t>(ind);
+        } else {
+            freeHead = ind;
+        }
+        freeTail = ind;
+    }
+
+    void unlinkFree(int ind) {
+        if (freePrev[ind] != -1) {
+            freeNext[freePrev[ind]] = freeNext[ind];
+        } else {
+            freeHead = freeNext[ind];
+        }
+        if (freeNext[ind] != -1) {
+            freePrev[freeNext[ind]] = freePrev[ind];
+        } else {
+            freeTail = freePrev[ind];
+        }
+    }
 };
-} // namespace audio_plugin
\ No newline at end of file
+} // namespace audio_plugin
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+
+namespace audio_plugin {
+/**
+ * @brief Assigns frequencies to midi notes (slots) of MTS-ESP tuning tables
+ *
+ * There are 128 slots per midi channel, slot s is midi note s % 128 of instance's channel s / 128.
+ *
+ * Every note that needs a frequency acquires a slot and releases it when it's not needed anymore
+ * (slots have reference counters, so notes with same frequency share a slot). Released slot keeps
+ * it's frequency until it is needed for another frequency, so the residual sound of released
+ * notes (for example from reverb) doesn't change pitch. When new frequency is needed, least
+ * recently released slot is retuned. Released slots of all channels are in one queue, so a
+ * ringing note keeps it's pitch no matter in which channel the new frequency lands.
+ *
+ * Operations don't allocate. find(), retain() and release() are O(1). acquire() of a new
+ * frequency walks the free list past pinned slots, so it's O(1 + number of pinned released slots)
+ * (bounded by number of sounding notes). releaseAll() and setNumSlots() are O(number of slots).
+ */
+class FreqSlotsManagerMTS {
+  public:
+    static constexpr int slotsPerChannel = 128;
+    static constexpr int maxChannels = 4;
+    static constexpr int maxSlots = slotsPerChannel * maxChannels;
+
+    FreqSlotsManagerMTS() {
+        slotFreqs.fill(0.0);
+        hasFreq.fill(false);
+        refCounts.fill(0);
+        tableSlots.fill(-1);
+        for (int slot = 0; slot < numSlots; ++slot) {
+            pushBackFree(slot);
+        }
+    }
+
+    int getNumSlots() const { return numSlots; }
+
+    /**
+     * @brief Change number of usable slots (when channels are added or removed)
+     * New slots were never used, so they are retuned first. Removed slots lose their frequencies
+     * and acquires.
+     * @param newNumSlots Multiple of slotsPerChannel, up to maxSlots
+     */
+    void setNumSlots(int newNumSlots) {
+        for (int slot = newNumSlots; slot < numSlots; ++slot) {
+            if (refCounts[slot] == 0) {
+                unlinkFree(slot);
+            }
+            refCounts[slot] = 0;
+            if (hasFreq[slot]) {
+                eraseKey(quantise(slotFreqs[slot]));
+                hasFreq[slot] = false;
+            }
+            retuned[slot] = false;
+        }
+        for (int slot = numSlots; slot < newNumSlots; ++slot) {
+            pushFrontFree(slot);
+        }
+        numSlots = newNumSlots;
+    }
+
+    /**
+     * @brief Find slot with given frequency
+     * @return Slot or -1 if not found
+     */
+    int find(double freq) const {
+        const int64_t key = quantise(freq);
+        for (int i = bucket(key); tableSlots[i] != -1; i = (i + 1) & tableMask) {
+            if (tableKeys[i] == key) {
+                return tableSlots[i];
+            }
+        }
+        return -1;
+    }
+
+    ///< Frequency of slot, or noFreq if slot has never been used
+    double getFreq(int slot, double noFreq) const {
+        return hasFreq[slot] ? slotFreqs[slot] : noFreq;
+    }
+
+    /**
+     * @brief Get slot for frequency
+     * Slot that already has this frequency is reused, otherwise least recently released slot is
+     * retuned
+     * @param freq Frequency in Hz
+     * @param isPinned Predicate for slot, pinned released slots (for example that are playing
+     *                 now) are never retuned. It's called for every pinned slot that is skipped
+     * @return Slot or -1 if there are no slots that can be retuned
+     */
+    template <typename Pred> int acquire(double freq, Pred isPinned) {
+        int slot = find(freq);
+        if (slot == -1) {
+            slot = freeHead;
+            while (slot != -1 && isPinned(slot)) {
+                slot = freeNext[slot];
+            }
+            if (slot == -1) {
+                return -1;
+            }
+            if (hasFreq[slot]) {
+                eraseKey(quantise(slotFreqs[slot]));
+            }
+            slotFreqs[slot] = freq;
+            hasFreq[slot] = true;
+            insertKey(quantise(freq), slot);
+            retuned[slot] = true;
+        }
+        if (refCounts[slot]++ == 0) {
+            unlinkFree(slot);
+        }
+        return slot;
+    }
+
+    /**
+     * @brief Acquire slot again with it's current frequency (for example after releaseAll())
+     * Slots that were removed by setNumSlots() are ignored.
+     */
+    void retain(int slot) {
+        if (slot >= numSlots) {
+            return;
+        }
+        if (refCounts[slot]++ == 0) {
+            unlinkFree(slot);
+        }
+    }
+
+    ///< Release slot that was acquired
+    void release(int slot) {
+        if (refCounts[slot] > 0 && --refCounts[slot] == 0) {
+            pushBackFree(slot);
+        }
+    }
+
+    ///< Release all slots (they keep frequencies)
+    void releaseAll() {
+        for (int slot = 0; slot < numSlots; ++slot) {
+            if (refCounts[slot] > 0) {
+                refCounts[slot] = 0;
+                pushBackFree(slot);
+            }
+        }
+    }
+
+    ///< Was slot retuned since last call of clearRetuned()
+    bool isRetuned(int slot) const { return retuned[slot]; }
+    bool anyRetuned() const { return retuned.any(); }
+    void clearRetuned() { retuned.reset(); }
+
+  private:
+    ///< Frequencies closer than 1e-6 Hz are treated as same
+    static int64_t quantise(double freq) { return std::llround(freq * 1e6); }
+
+    int numSlots = slotsPerChannel; ///< Slots of channels that instance has now
+    std::array<double, maxSlots> slotFreqs;
+    std::array<bool, maxSlots> hasFreq;
+    std::array<int, maxSlots> refCounts; ///< Number of acquires without release
+    std::bitset<maxSlots> retuned;
+
+    // Free (released) slots as a doubly linked list, least recently released at the head
+    std::array<int, maxSlots> freePrev, freeNext;
+    int freeHead = -1, freeTail = -1;
+
+    void pushFrontFree(int slot) {
+        freePrev[slot] = -1;
+        freeNext[slot] = freeHead;
+        if (freeHead != -1) {
+            freePrev[freeHead] = slot;
+        } else {
+            freeTail = slot;
+        }
+        freeHead = slot;
+    }
+
+    void pushBackFree(int slot) {
+        freePrev[slot] = freeTail;
+        freeNext[slot] = -1;
+        if (freeTail != -1) {
+            freeNext[freeTail] = slot;
+        } else {
+            freeHead = slot;
+        }
+        freeTail = slot;
+    }
+
+    void unlinkFree(int slot) {
+        if (freePrev[slot] != -1) {
+            freeNext[freePrev[slot]] = freeNext[slot];
+        } else {
+            freeHead = freeNext[slot];
+        }
+        if (freeNext[slot] != -1) {
+            freePrev[freeNext[slot]] = freePrev[slot];
+        } else {
+            freeTail = freePrev[slot];
+        }
+    }
+
+    // Open addressing hash table (linear probing) quantised frequency -> slot
+    static constexpr int tableBits = 11;
+    static constexpr int tableSize = 1 << tableBits; ///< 4 buckets per slot
+    static constexpr int tableMask = tableSize - 1;
+    static_assert(tableSize == 4 * maxSlots);
+    std::array<int64_t, tableSize> tableKeys;
+    std::array<int, tableSize> tableSlots; ///< -1 means empty bucket
+
+    static int bucket(int64_t key) {
+        return static_cast<int>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >>
+                                (64 - tableBits)) &
+               tableMask;
+    }
+
+    void insertKey(int64_t key, int slot) {
+        int i = bucket(key);
+        while (tableSlots[i] != -1) {
+            i = (i + 1) & tableMask;
+        }
+        tableKeys[i] = key;
+        tableSlots[i] = slot;
+    }
+
+    void eraseKey(int64_t key) {
+        int i = bucket(key);
+        while (tableSlots[i] != -1 && tableKeys[i] != key) {
+            i = (i + 1) & tableMask;
+        }
+        if (tableSlots[i] == -1) {
+            return;
+        }
+        // Shift next keys of the cluster back, so lookups don't stop at the hole
+        int j = i;
+        while (true) {
+            j = (j + 1) & tableMask;
+            if (tableSlots[j] == -1) {
+                break;
+            }
+            const int k = bucket(tableKeys[j]);
+            // Key at j can be moved to i if its bucket k isn't cyclically in (i, j]
+            const bool kInRange = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+            if (!kInRange) {
+                tableKeys[i] = tableKeys[j];
+                tableSlots[i] = tableSlots[j];
+                i = j;
+            }
+        }
+        tableSlots[i] = -1;
+    }
+};
+} // namespace audio_plugin
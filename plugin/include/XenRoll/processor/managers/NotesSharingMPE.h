@@ -14,7 +14,12 @@
 #include <boost/uuid/uuid_io.hpp>
 #pragma warning(pop) // Restore warnings
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
 #include <set>
+#include <string>
+#include <thread>
 
 namespace audio_plugin {
 namespace bip = boost::interprocess;
@@ -23,11 +28,22 @@ namespace bid = boost::uuids;
 /**
  * @brief The class that is responsible for notes sharing between different instances of this
  * plugin. ONLY WITH MPE TUNING.
+ *
+ * Init (shared memory, named mutex) is done on a separate thread, so plugin loading doesn't wait
+ * for it (a mutex of a crashed process is waited for with timeout). Until init is done, the
+ * instance isn't active (it doesn't share notes), but it can play.
  */
 class NotesSharingMPE {
   public:
-    ///< id = -1 means "Give free ID"
-    NotesSharingMPE(int id = -1);
+    /**
+     * @brief Start init and return without waiting for it
+     * @param id Desired instance id, -1 means "Give free ID"
+     * @param initDoneCallback Is called from the init thread when init is done (succeeded or not)
+     * @param namePrefix Prefix of names of shared memory and mutex (instances with different
+     *        prefixes don't see each other, for tests)
+     */
+    NotesSharingMPE(int id = -1, std::function<void()> initDoneCallback = nullptr,
+                    std::string namePrefix = "");
     ~NotesSharingMPE();
 
     NotesSharingMPE(const NotesSharingMPE &) = delete;
@@ -41,11 +57,14 @@ class NotesSharingMPE {
 
     int getInstanceId() const { return instanceId; }
     bool getIsActive() const { return isActive; }
+    ///< true when init is done (getIsActive() tells whether it succeeded)
+    bool getIsInitDone() const { return isInitDone; }
 
     std::set<int> getAllInstanceIds() const;
 
     void updateNotes(const std::vector<Note> &notes);
 
+    ///< If init isn't done yet, desired id is taken when it's done
     void changeInstanceId(int desInstId);
 
     std::vector<Note> getInstancesNotes(const std::set<int> &instancesIds) const;
@@ -78,19 +97,39 @@ class NotesSharingMPE {
 
     using ShmemMap = bip::map<int, ShmemData, IntComparator, ShmemAllocator>;
 
+    void initAll(int id);
     void initSharedMemory();
     void initInstance(int id);
     int findSmallestFreeId();
+    void applyInstanceId(int desInstId);
+    ///< Throws if init takes too long or destructor wants it to stop
+    void checkInitDeadline() const;
 
     const int initTimeoutTime = 5000; ///< in ms
     const int lockTimeoutTime = 500;  ///< in ms
+    ///< How often waiting for processInitMutex checks abortInit, in ms
+    const int processInitPollTime = 10;
+
+    std::thread initThread;
+    std::chrono::steady_clock::time_point initDeadline; ///< initTimeoutTime after init started
+    std::atomic<bool> isInitDone{false}, abortInit{false};
+    ///< Guards isInitDone change and pendingInstanceId
+    std::mutex initMutex;
+    ///< Id that was requested while init wasn't done, -1 means there is no request
+    int pendingInstanceId = -1;
+    std::function<void()> onInitDone;
+    const std::string namePrefix;
+    ///< Name of shared object (with namePrefix)
+    std::string sharedName(const std::string &name) const { return namePrefix + name; }
+    ///< Instances of one process are initialized one after another
+    static inline std::timed_mutex processInitMutex;
 
     std::unique_ptr<bip::managed_shared_memory> sharedMemory;
     ///< Map: instanceId -> {process_id, uniqueId, notes}
     ShmemMap *instancesData = nullptr;
     std::unique_ptr<bip::named_mutex> mutex;
 
-    int instanceId = -1;
+    std::atomic<int> instanceId{-1};
     bid::uuid uniqueId;
     std::atomic<bool> isActive{false};
 };
@@ -1,18 +1,23 @@
 #pragma once
 
 #include "XenRoll/common/PlatformUtils.h"
+#include "XenRoll/common/SeqLockArray.h"
 #include "XenRoll/data/Note.h"
 #pragma warning(push, 0) // Disable all warnings for boost
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/containers/vector.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
-#include <boost/interprocess/sync/named_condition.hpp>
 #include <boost/interprocess/sync/named_mutex.hpp>
+#include <boost/interprocess/sync/named_semaphore.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #pragma warning(pop) // Restore warnings
 #include "../external/MTS-ESP/libMTSMaster.h"
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
 #include <set>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -22,10 +27,23 @@ namespace bip = boost::interprocess;
 /**
  * @brief The class that is responsible for synchronization between different instances of this
  * plugin. ONLY WITH MTS-ESP TUNING.
+ *
+ * Init (shared memory, named mutexes, server/client) is done on a separate thread, so plugin
+ * loading doesn't wait for it. Until init is done, the instance isn't active (it has no channel).
  */
 class PluginInstanceManager {
   public:
-    PluginInstanceManager();
+    ///< Max number of midi channels of one instance (main channel + extra channels)
+    static constexpr int maxChannels = 4;
+
+    /**
+     * @brief Start init and return without waiting for it
+     * @param initDoneCallback Is called from the init thread when init is done (succeeded or not)
+     * @param namePrefix Prefix of names of shared memory, mutexes and semaphore (instances with
+     *        different prefixes don't see each other, for tests)
+     */
+    PluginInstanceManager(std::function<void()> initDoneCallback = nullptr,
+                          std::string namePrefix = "");
     ~PluginInstanceManager();
 
     PluginInstanceManager(const PluginInstanceManager &) = delete;
@@ -38,14 +56,39 @@ class PluginInstanceManager {
     void performEmergencyCleanup();
 
     void waitChannelUpdate();
-    void updateFreqs(const double freqs[128]);
+    /**
+     * @brief Publish frequencies of our channels to the server
+     * @param freqs 128 frequencies for main channel, then 128 for every extra channel
+     * @param numChannels Number of channels to publish (main channel + first extra channels)
+     * @note Wait-free (no locks, server is woken up with a semaphore post), processor calls it only
+     * from the audio thread. Calls must not overlap (there is one writer of freqs), also with
+     * claimExtraChannels() (processor serialises them with prepareNotesMutex).
+     */
+    void updateFreqs(const double *freqs, int numChannels = 1);
+    /**
+     * @brief Claim extra midi channels (in addition to main channel), so instance can have more
+     * than 128 pitches. Previous extra channels are released.
+     * @param num Desired number of extra channels (0 - maxChannels-1)
+     * @return Indexes (0-15) of claimed extra channels, there can be less of them than num if
+     * there aren't enough free channels
+     */
+    std::vector<int> claimExtraChannels(int num);
     void updateNotes(const std::vector<Note> &notes);
     /**
-     * It may take up channel already occupied, but in theory, this won't happen after all instance
-     * initializations are complete.
+     * If init isn't done yet, desired channel is taken by applyPendingChannelIndex() after it's
+     * done. It may take up channel already occupied, but in theory, this won't happen after all
+     * instance initializations are complete.
      * Also it doesn't care about notes info (doesn't move/swap it).
+     * @note Moves published freqs and extra channels, so calls must be serialised with
+     * updateFreqs() (processor does it with prepareNotesMutex).
      */
     void changeChannelIndex(int desChInd);
+    /**
+     * @brief Take channel that was requested by changeChannelIndex() before init was done
+     * @note Call it after init is done (from onInitDone's async update), serialised with
+     * updateFreqs() like changeChannelIndex().
+     */
+    void applyPendingChannelIndex();
 
     std::set<int> getAllInstanceChannels();
 
@@ -57,6 +100,8 @@ class PluginInstanceManager {
      */
     std::vector<Note> getChannelsNotes(const std::set<int> chIndxs);
     bool getIsActive() const { return isActive; }
+    ///< true when init is done (getIsActive() tells whether it succeeded)
+    bool getIsInitDone() const { return isInitDone; }
     int getChannelIndex() { return channelIndex; }
     std::string getErrorMessage() { return errorMessage; }
 
@@ -81,6 +126,17 @@ class PluginInstanceManager {
          * then there won't be any server
          */
         std::atomic<uint64_t> serverHeartbeat{0};
+        /**
+         * 0 if channel is main channel of instance (or free), otherwise index+1 of main channel
+         * of instance that uses it as extra channel (these aren't listed as instances)
+         */
+        int8_t extraChannelOwner[16]{0};
+        /**
+         * Bit i is set when ChannelFreqs of channel i was changed, server takes (and resets) all
+         * bits at once and processes only these channels. updateServerSemaphore is posted only
+         * when first bit is set, so at most once per server iteration.
+         */
+        std::atomic<uint16_t> dirtyChannels{0};
     };
 
     struct ChannelFreqs {
@@ -95,12 +151,21 @@ class PluginInstanceManager {
          * needToUpdate = false  -  nothing
          */
         std::atomic<bool> needToUpdate{false};
-        double freqs[128]{0.0};
+        ///< Written only by the instance of this channel (from it's audio thread), without locks
+        SeqLockArray<double, 128> freqs;
+        /**
+         * Bit i (of 128) is set if freqs[i] has changed since server sent freqs last time, so
+         * server sends only these notes (or full table if there are many of them)
+         */
+        std::atomic<uint64_t> changedNotes[2]{};
     };
 
     void initAll();
     void initSharedMemory();
     void initInstance();
+    ///< Throws if init takes too long or destructor wants it to stop
+    void checkInitDeadline() const;
+    void applyChannelIndex(int desChInd);
 
     void becomeClient();
     void becomeServer();
@@ -108,17 +173,57 @@ class PluginInstanceManager {
     bool isServerHeartbeatOk();
     void checkServer();
     void runServer();
+    /**
+     * @brief Tell server that ChannelFreqs of channel was changed (and wake it up)
+     * @note Wait-free
+     */
+    void markChannelDirty(int chInd);
+    /**
+     * @brief Send changes of channel to MTS-ESP (for server)
+     * @return false if freqs are being written now, so channel must be processed again later
+     */
+    bool processChannel(int chInd);
+    /**
+     * @brief Stop retrying channel which freqs couldn't be read maxFailedReads times in a row
+     * (for server). If it's writer process is dead, channel is turned off in MTS-ESP, otherwise
+     * it's processed again when it's written next time.
+     */
+    void giveUpChannel(int chInd);
 
     const int initTimeoutTime = 5000; ///< in ms
     const int lockTimeoutTime = 500;  ///< in ms
+    ///< How often waiting for processInitMutex checks abortInit, in ms
+    const int processInitPollTime = 10;
+
+    std::thread initThread;
+    std::chrono::steady_clock::time_point initDeadline; ///< initTimeoutTime after init started
+    std::atomic<bool> isInitDone{false}, abortInit{false};
+    ///< Guards isInitDone change and pendingChannelIndex
+    std::mutex initMutex;
+    ///< Channel that was requested while init wasn't done, -1 means there is no request
+    int pendingChannelIndex = -1;
+    std::function<void()> onInitDone;
+    const std::string namePrefix;
+    ///< Name of shared object (with namePrefix)
+    std::string sharedName(const std::string &name) const { return namePrefix + name; }
+    ///< Instances of one process are initialized one after another
+    static inline std::timed_mutex processInitMutex;
+
+    /**
+     * Time (steady clock, in ms) when all named mutexes were found not stuck by an instance of this
+     * process, -1 if never (or if some instance was destroyed since then). Instances that are
+     * loaded together (with a project) skip the check, so only the first one locks all 32 mutexes.
+     */
+    static inline std::atomic<int64_t> mutexesCheckTime{-1};
+    static constexpr int64_t mutexesCheckValidTime = 10000; ///< in ms
 
     std::unique_ptr<bip::managed_shared_memory> sharedMemory;
     std::unique_ptr<bip::named_mutex> chShMutex;
-    std::unique_ptr<bip::named_mutex> updServCondMutex;
-    std::unique_ptr<bip::named_condition> updateServerCondition;
+    std::unique_ptr<bip::named_semaphore> updateServerSemaphore;
     ChannelsSheet *channelsSheet = nullptr;
 
     ChannelFreqs *channelsFreqs[16]{nullptr};
+    ///< Guards ChannelFreqs::serverAction (freqs are lock-free)
     std::unique_ptr<bip::named_mutex> chFqMutex[16];
 
     ShmemVector *channelsNotes[16]{nullptr};
@@ -131,9 +236,27 @@ class PluginInstanceManager {
     //            needed if server
     const int heartbeatDeltaTime = 300;            ///< in ms
     const int heartbeatCheckFailedExtraTime = 400; ///< in ms
+    ///< Delay before processing channel again if it's freqs were being written, in ms
+    const int retryDeltaTime = 1;
+    ///< Writer needs microseconds, so after this many failed reads in a row it's likely dead
+    static constexpr int maxFailedReads = 100;
+    int failedReads[16]{0}; ///< Failed reads in a row of every channel (for server)
+    ///< If more notes changed, server sends full table (one call instead of many)
+    static constexpr int maxDeltaNotes = 16;
     uint64_t latestHeartbeat{0};                   ///< in ms, since epoch
+    double serverFreqs[128]{0.0};                  ///< Copy of channel's freqs for MTS-ESP
+
+    ///< Freqs of our channels that were published last time (to find changed notes)
+    double publishedFreqs[maxChannels][128]{};
+
+    int extraChannels[maxChannels - 1]{}; ///< 0-15 range
+    int numExtraChannels = 0;
+    ///< Release extra channels (chShMutex must be locked)
+    void releaseExtraChannels();
+    ///< Publish 128 freqs to channel (channelInd is our channel, k is it's index in our channels)
+    void publishChannelFreqs(int chInd, int k, const double *freqs);
 
-    int channelIndex = -1; ///< 0-15 range
+    std::atomic<int> channelIndex{-1}; ///< 0-15 range
     std::atomic<bool> isActive{false};
     std::atomic<bool> isServer{false};
     std::string errorMessage = "";
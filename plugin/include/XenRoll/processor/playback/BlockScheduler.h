@@ -0,0 +1,77 @@
+#pragma once
+
+#include "XenRoll/processor/playback/NoteTimeline.h"
+#include "XenRoll/processor/playback/NotesSnapshot.h"
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+namespace audio_plugin {
+/**
+ * @brief Note offs and note ons of piano roll in a block of samples
+ *
+ * Shared by processBlock() (all tuning backends) and MidiBounce, so bounced midi has the same
+ * timing as playback. Cursors follow the playhead, voices are handled by the caller: note offs of
+ * the block are taken before note ons.
+ *
+ * @note Doesn't allocate or lock, so it can be used on the audio thread.
+ */
+class BlockScheduler {
+  public:
+    /**
+     * @brief Set the block for the next calls
+     * @param time Playhead time at the block start in bars
+     * @param barsInBlock Block duration in bars
+     * @param numSamples Block duration in samples
+     */
+    void setBlock(double time, double barsInBlock, int numSamples) {
+        blockTime = time;
+        blockBars = barsInBlock;
+        blockSamples = numSamples;
+    }
+
+    /**
+     * @brief Note offs with time in [from, to)
+     * @param from Usually block start, earlier if previous blocks weren't played
+     * @param to Usually block end, earlier if the loop ends in the block
+     */
+    std::span<const NoteTimeline::Event> noteOffs(const NotesSnapshot &notesSnapshot,
+                                                  double from, double to) {
+        return noteOffCursor.advance(notesSnapshot.getTimeline().getNoteOffs(),
+                                     notesSnapshot.getVersion(), from, to);
+    }
+
+    ///< Note ons with time in [from, to), see noteOffs()
+    std::span<const NoteTimeline::Event> noteOns(const NotesSnapshot &notesSnapshot,
+                                                 double from, double to) {
+        return noteOnCursor.advance(notesSnapshot.getTimeline().getNoteOns(),
+                                    notesSnapshot.getVersion(), from, to);
+    }
+
+    ///< Sample of note off (rounded down, so it's before note on at the same time)
+    int noteOffSample(double eventTime) const {
+        return std::max(0, static_cast<int>(std::floor(blockSamples * (eventTime - blockTime) /
+                                                       blockBars)));
+    }
+
+    ///< Sample of note on (notes that started before the block are at it's start)
+    int noteOnSample(double noteTime) const {
+        if (noteTime <= blockTime) {
+            return 0;
+        }
+        return static_cast<int>(std::ceil(blockSamples * (noteTime - blockTime) / blockBars));
+    }
+
+    ///< Next calls find their position with binary search (after the playhead jumped)
+    void reset() {
+        noteOnCursor.reset();
+        noteOffCursor.reset();
+    }
+
+  private:
+    NoteTimeline::Cursor noteOnCursor, noteOffCursor;
+    double blockTime = 0.0;
+    double blockBars = 1.0;
+    int blockSamples = 0;
+};
+} // namespace audio_plugin
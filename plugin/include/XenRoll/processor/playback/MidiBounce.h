@@ -0,0 +1,62 @@
+#pragma once
+
+#include "XenRoll/data/Parameters.h"
+#include "XenRoll/processor/playback/NotesSnapshot.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace audio_plugin {
+/**
+ * @brief Offline bounce of notes from piano roll to retuned midi (without host)
+ *
+ * A synthetic playhead goes through the notes block by block, like a host that calls
+ * processBlock(), and every block is scheduled with the same building blocks as processBlock():
+ * BlockScheduler, ChannelsManagerMPE + PitchBendMPE for MPE (a channel per note and pitch
+ * bend curves) and FreqSlotsManagerMTS + single note tuning changes for MTS SysEx. Nothing waits
+ * for real time, so the whole project is bounced much faster than it plays.
+ *
+ * @note Processor's state isn't used, so it can be called from any thread (and from tests).
+ */
+class MidiBounce {
+  public:
+    static constexpr int ticksPerQuarterNote = 960;
+
+    struct Settings {
+        ///< MPE or MTS_SYSEX (MTS_ESP can't be saved to a file, it's bounced as MTS SysEx)
+        Parameters::TuningType tuningType = Parameters::MPE;
+        double bpm = 120.0;
+        int numerator = 4;
+        int denominator = 4;
+        double A4Freq = 440.0;
+
+        int semiBendRangeMPE = 48;
+        bool channelsEconomyModeMPE = false;
+        Parameters::VoiceStealingMPE voiceStealingMPE = VoiceStealingMPE::NoStealing;
+        bool resetPitchBendOnNoteOff = false;
+        int bendControlRateMPE = 64; ///< In samples
+        int bendControlRateMTS = 1;  ///< In samples (1 is every block)
+
+        // Synthetic playhead (sets time resolution of bends, like in processBlock())
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+    };
+
+    struct Result {
+        juce::MidiMessageSequence sequence; ///< Time stamps are in ticks
+        ///< Notes that didn't get a midi channel (MPE) or a midi note (MTS SysEx)
+        int numDroppedNotes = 0;
+    };
+
+    ///< Settings of the plugin's tuning for the given tempo and time signature
+    static Settings settingsFromParameters(const Parameters &params, double bpm, int numerator,
+                                           int denominator);
+
+    /**
+     * @brief Bounce all notes
+     * @return Midi sequence (starting with time signature and tempo) and number of dropped notes
+     */
+    static Result bounce(const NotesSnapshot &notesSnapshot, const Settings &settings);
+
+    ///< Write bounced sequence as a standard midi file (one track)
+    static bool writeMidiFile(const Result &result, juce::OutputStream &outputStream);
+};
+} // namespace audio_plugin
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "XenRoll/data/Note.h"
+#include <algorithm>
+#include <vector>
+
+namespace audio_plugin {
+/**
+ * @brief Time index of notes for playback
+ *
+ * Notes are stored as intervals [time, time + duration] sorted by start time. On top of the sorted
+ * array there is an implicit augmented binary search tree (each element also stores max end time
+ * of it's subtree), so overlap query takes O(log(n) + k) where k is number of found notes.
+ * Idea is taken from cgranges by Heng Li: https://github.com/lh3/cgranges
+ *
+ * @note build() allocates, so call it off the audio thread. query() doesn't allocate as long as
+ *       `out` has enough capacity (reserve it with size()).
+ */
+class NoteSchedule {
+  public:
+    /**
+     * @brief Rebuild schedule for the new notes
+     * @param notes Notes, indexes in this vector are returned by query()
+     */
+    void build(const std::vector<Note> &notes) {
+        build(notes, [](const Note &) { return true; });
+    }
+
+    /**
+     * @brief Rebuild schedule only for some of the notes
+     * @param notes Notes, indexes in this vector are returned by query()
+     * @param include Predicate, only notes for which it returns true are added
+     */
+    template <typename Pred> void build(const std::vector<Note> &notes, Pred include) {
+        intervals.clear();
+        intervals.reserve(notes.size());
+        for (int i = 0; i < static_cast<int>(notes.size()); ++i) {
+            const Note &note = notes[i];
+            if (include(note)) {
+                intervals.push_back(
+                    {note.time, note.time + note.duration, note.time + note.duration, i});
+            }
+        }
+        std::sort(intervals.begin(), intervals.end(),
+                  [](const Interval &a, const Interval &b) { return a.start < b.start; });
+        rootLevel = indexCore();
+    }
+
+    void clear() {
+        intervals.clear();
+        rootLevel = -1;
+    }
+
+    size_t size() const { return intervals.size(); }
+
+    /**
+     * @brief Find all notes that overlap time range [from, to] (borders included)
+     * @param from Start of range in bars
+     * @param to End of range in bars
+     * @param out Indexes of found notes (in notes vector passed to build()), sorted by note time.
+     *            It is cleared before filling.
+     */
+    void query(double from, double to, std::vector<int> &out) const {
+        out.clear();
+        if (rootLevel < 0) {
+            return;
+        }
+
+        const int n = static_cast<int>(intervals.size());
+        struct StackItem {
+            int x; ///< node index
+            int k; ///< node level
+            bool w; ///< left child has been processed
+        };
+        StackItem stack[64];
+        int t = 0;
+        stack[t++] = {(1 << rootLevel) - 1, rootLevel, false};
+
+        while (t > 0) {
+            const StackItem z = stack[--t];
+            if (z.k <= 3) {
+                // Small subtree, just check every node in it
+                int i0 = z.x >> z.k << z.k;
+                int i1 = std::min(i0 + (1 << (z.k + 1)) - 1, n);
+                for (int i = i0; i < i1 && intervals[i].start <= to; ++i) {
+                    if (intervals[i].end >= from) {
+                        out.push_back(intervals[i].noteInd);
+                    }
+                }
+            } else if (!z.w) {
+                // Left child may be out of range, then it's subtree still can have nodes
+                const int y = z.x - (1 << (z.k - 1));
+                stack[t++] = {z.x, z.k, true};
+                if (y >= n || intervals[y].maxEnd >= from) {
+                    stack[t++] = {y, z.k - 1, false};
+                }
+            } else if (z.x < n && intervals[z.x].start <= to) {
+                if (intervals[z.x].end >= from) {
+                    out.push_back(intervals[z.x].noteInd);
+                }
+                stack[t++] = {z.x + (1 << (z.k - 1)), z.k - 1, false};
+            }
+        }
+    }
+
+  private:
+    struct Interval {
+        float start;  ///< Note time in bars
+        float end;    ///< Note time + duration in bars
+        float maxEnd; ///< Max end in subtree of this node
+        int noteInd;  ///< Index in notes vector
+    };
+
+    std::vector<Interval> intervals; ///< Sorted by start
+    int rootLevel = -1;              ///< Level of the root node, -1 if empty
+
+    ///< Fill maxEnd fields bottom-up, return level of the root node
+    int indexCore() {
+        const int n = static_cast<int>(intervals.size());
+        if (n == 0) {
+            return -1;
+        }
+        int lastInd = 0; ///< rightmost node in the tree
+        float last = 0;  ///< max end at lastInd
+        for (int i = 0; i < n; i += 2) {
+            lastInd = i;
+            last = intervals[i].maxEnd = intervals[i].end;
+        }
+        int k = 1;
+        for (; (1 << k) <= n; ++k) {
+            const int x = 1 << (k - 1);
+            const int i0 = (x << 1) - 1;
+            const int step = x << 2;
+            for (int i = i0; i < n; i += step) {
+                const float el = intervals[i - x].maxEnd;
+                const float er = (i + x < n) ? intervals[i + x].maxEnd : last;
+                intervals[i].maxEnd = std::max({intervals[i].end, el, er});
+            }
+            lastInd = ((lastInd >> k) & 1) ? lastInd - x : lastInd + x;
+            if (lastInd < n && intervals[lastInd].maxEnd > last) {
+                last = intervals[lastInd].maxEnd;
+            }
+        }
+        return k - 1;
+    }
+};
+} // namespace audio_plugin
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "XenRoll/data/Note.h"
+#include <algorithm>
+#include <span>
+#include <vector>
+
+namespace audio_plugin {
+/**
+ * @brief Notes compiled into time-sorted streams of playback events
+ *
+ * There are separate streams for note on (note.time) and note off (note.time + note.duration)
+ * events, so processBlock() can handle all note offs of a block before note ons, like it did
+ * before. Events of a block are found with Cursor, so per-block cost depends on number of
+ * events in the block, not on number of notes.
+ *
+ * @note build() allocates, so call it off the audio thread.
+ */
+class NoteTimeline {
+  public:
+    struct Event {
+        float time;  ///< Time of event in bars
+        int noteInd; ///< Index in notes vector passed to build()
+    };
+
+    /**
+     * @brief Position in an events stream that follows the playhead
+     *
+     * While the playhead moves forward the cursor just steps over events, after a jump (or if
+     * events were rebuilt) it finds its position with binary search.
+     */
+    class Cursor {
+      public:
+        /**
+         * @brief Get events with time in [from, to)
+         * @param events Events stream (from NoteTimeline)
+         * @param eventsVersion Changes every time events are rebuilt
+         * @param from Start of range in bars (usually playhead time)
+         * @param to End of range in bars
+         * @return Found events, sorted by time
+         */
+        std::span<const Event> advance(const std::vector<Event> &events, uint64_t eventsVersion,
+                                       double from, double to) {
+            const int n = static_cast<int>(events.size());
+            if (eventsVersion != version || from < lastFrom || from > lastTo) {
+                auto it = std::lower_bound(
+                    events.begin(), events.end(), from,
+                    [](const Event &event, double time) { return event.time < time; });
+                pos = static_cast<int>(it - events.begin());
+                version = eventsVersion;
+            } else {
+                // Events before lastTo were already returned, even if from is slightly below it
+                //   (because of rounding of playhead time)
+                while (pos < n && events[pos].time < from) {
+                    ++pos;
+                }
+            }
+            lastFrom = from;
+            lastTo = to;
+
+            const int begin = pos;
+            while (pos < n && events[pos].time < to) {
+                ++pos;
+            }
+            return std::span<const Event>(events.data() + begin, pos - begin);
+        }
+
+        ///< Next advance() will use binary search
+        void reset() { version = 0; }
+
+      private:
+        uint64_t version = 0; ///< Version of events that pos belongs to, 0 if none
+        double lastFrom = 0;
+        double lastTo = 0;
+        int pos = 0; ///< First event that wasn't returned (time >= lastTo)
+    };
+
+    /**
+     * @brief Compile events for the new notes
+     * @param notes Notes, indexes in this vector are stored in events
+     */
+    void build(const std::vector<Note> &notes) {
+        noteOns.clear();
+        noteOffs.clear();
+        noteOns.reserve(notes.size());
+        noteOffs.reserve(notes.size());
+        for (int i = 0; i < static_cast<int>(notes.size()); ++i) {
+            const Note &note = notes[i];
+            noteOns.push_back({note.time, i});
+            noteOffs.push_back({note.time + note.duration, i});
+        }
+        auto byTime = [](const Event &a, const Event &b) {
+            return a.time < b.time || (a.time == b.time && a.noteInd < b.noteInd);
+        };
+        std::sort(noteOns.begin(), noteOns.end(), byTime);
+        std::sort(noteOffs.begin(), noteOffs.end(), byTime);
+    }
+
+    const std::vector<Event> &getNoteOns() const { return noteOns; }
+    const std::vector<Event> &getNoteOffs() const { return noteOffs; }
+
+  private:
+    std::vector<Event> noteOns;  ///< Sorted by time
+    std::vector<Event> noteOffs; ///< Sorted by time
+};
+} // namespace audio_plugin
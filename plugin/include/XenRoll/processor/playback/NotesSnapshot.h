@@ -0,0 +1,68 @@
+#pragma once
+
+#include "XenRoll/data/Note.h"
+#include "XenRoll/processor/playback/NoteSchedule.h"
+#include "XenRoll/processor/playback/NoteTimeline.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace audio_plugin {
+/**
+ * @brief Immutable notes from piano roll together with their time indexes and playback events
+ *
+ * One snapshot is made on every notes update and then it's shared (by std::shared_ptr) between
+ * editor, processor and notes sharing managers, so notes aren't copied for each of them.
+ */
+class NotesSnapshot {
+  public:
+    NotesSnapshot() : version(generateVersion()) {}
+    explicit NotesSnapshot(std::vector<Note> newNotes)
+        : notes(std::move(newNotes)), version(generateVersion()) {
+        schedule.build(notes);
+        bendSchedule.build(notes, [](const Note &note) { return note.bend != 0; });
+        timeline.build(notes);
+        idToIndex.reserve(notes.size());
+        for (int i = 0; i < static_cast<int>(notes.size()); ++i) {
+            idToIndex[notes[i].id] = i;
+        }
+    }
+
+    NotesSnapshot(const NotesSnapshot &) = delete;
+    NotesSnapshot &operator=(const NotesSnapshot &) = delete;
+
+    const std::vector<Note> &getNotes() const { return notes; }
+    const NoteSchedule &getSchedule() const { return schedule; }
+    ///< Schedule of notes with bend only
+    const NoteSchedule &getBendSchedule() const { return bendSchedule; }
+    const NoteTimeline &getTimeline() const { return timeline; }
+    ///< Unique for every snapshot (never 0), to find out if timeline cursors must be reset
+    uint64_t getVersion() const { return version; }
+
+    /**
+     * @brief Find note by id in O(1), doesn't allocate
+     * @param noteId Note's id
+     * @return Pointer to note or nullptr if not found
+     */
+    const Note *findNote(uint64_t noteId) const {
+        auto it = idToIndex.find(noteId);
+        return it != idToIndex.end() ? &notes[it->second] : nullptr;
+    }
+
+  private:
+    std::vector<Note> notes;
+    NoteSchedule schedule;
+    NoteSchedule bendSchedule;
+    NoteTimeline timeline;
+    uint64_t version;
+    std::unordered_map<uint64_t, int> idToIndex; ///< Note's id -> index in notes
+
+    static uint64_t generateVersion() {
+        static std::atomic<uint64_t> counter{1};
+        return counter.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+using NotesSnapshotPtr = std::shared_ptr<const NotesSnapshot>;
+} // namespace audio_plugin
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "XenRoll/common/PitchMath.h"
+#include "XenRoll/data/Note.h"
+#include <juce_core/juce_core.h>
+#include <utility>
+
+namespace audio_plugin {
+/**
+ * @brief Conversion of note pitches to midi note + MPE pitch bend
+ *
+ * No pitch bend = 8192; 0 and 16383 are -semiBendRange and +semiBendRange semitones respectively.
+ * Is shared by processBlock() and MidiBounce, so live and bounced MPE are the same.
+ */
+struct PitchBendMPE {
+    double centsPerBend = 48 * 100.0 / 8192;
+    ///< Is used to correct totalCents taking into account A4 freq
+    double corrTotalCents = 0;
+
+    void update(int semiBendRange, double A4Freq) {
+        centsPerBend = semiBendRange * 100.0 / 8192;
+        corrTotalCents = ratioToCents(A4Freq / 440.0);
+    }
+
+    /**
+     * @brief Calculate midi note and midi pitch bend from totalCents
+     * @param totalCents octave*1200 + cents
+     * @return std::pair<int, int>: first value is midi note in range [0...127] and
+     * second value is MPE bend in range [0...16383], where 8192 is no bend
+     */
+    std::pair<int, int> midiNoteAndBend(int totalCents) const {
+        double correctedTotalCents = totalCents + corrTotalCents;
+        // 0 totalCents = C0 = 12th midi note
+        int midiNote = juce::jlimit(0, 127, 12 + juce::roundToInt(correctedTotalCents / 100.0));
+        double bendCents = correctedTotalCents - (midiNote - 12) * 100;
+        int bendMPE = juce::jlimit(0, 16383, 8192 + juce::roundToInt(bendCents / centsPerBend));
+        return std::make_pair(midiNote, bendMPE);
+    }
+
+    ///< Calculate midi bend based on Note.bend while playing it
+    int noteBend(const Note &note, double currTime) const {
+        double totalCents = note.octave * 1200 + note.cents + corrTotalCents;
+        double bendCentsBase = totalCents - juce::roundToInt(totalCents / 100.0) * 100;
+        double bendCents = bendCentsBase + note.bend * (currTime - note.time) / note.duration;
+        int bendMPE = juce::jlimit(0, 16383, 8192 + juce::roundToInt(bendCents / centsPerBend));
+        return bendMPE;
+    }
+};
+} // namespace audio_plugin
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+namespace audio_plugin {
+/**
+ * @brief Detects discontinuities of the host playhead between blocks
+ *
+ * While the host plays, every block should start where the previous one ended. If it doesn't,
+ * the host looped, the user seeked (also via OSC transport) or time signature changed (playhead
+ * time is in bars), so voices of the old position must be released and notes of the new
+ * position must be chased.
+ */
+class PlayheadTracker {
+  public:
+    /**
+     * @brief Call once per block
+     * @param time Playhead time at the block start in bars
+     * @param barsInBlock Block duration in bars
+     * @param isPlaying Is host playing now
+     * @return true if host was playing and is still playing, but the playhead jumped
+     */
+    bool update(double time, double barsInBlock, bool isPlaying) {
+        const bool jumped = isPlaying && wasPlaying &&
+                            std::abs(time - expectedTime) > maxDriftInBlocks * lastBarsInBlock;
+        wasPlaying = isPlaying;
+        expectedTime = time + barsInBlock;
+        lastBarsInBlock = std::max(barsInBlock, minBarsInBlock);
+        return jumped;
+    }
+
+    ///< Next update() won't report a jump
+    void reset() { wasPlaying = false; }
+
+  private:
+    ///< Hosts round positions (to samples or ticks) and tempo can change between blocks
+    static constexpr double maxDriftInBlocks = 0.5;
+    static constexpr double minBarsInBlock = 1e-9;
+
+    bool wasPlaying = false;
+    double expectedTime = 0.0;     ///< Where the next block should start (in bars)
+    double lastBarsInBlock = 0.0;
+};
+} // namespace audio_plugin
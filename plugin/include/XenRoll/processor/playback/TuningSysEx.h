@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * MIDI Tuning Standard real-time single note tuning change (universal real-time SysEx):
+ *   F0 7F <device> 08 02 <program> <count> (<key> <semitone> <frac MSB> <frac LSB>) * count F7
+ *
+ * Frequency of key is semitone (12-EDO midi note, 69 is A4 = 440 Hz) + frac / 16384 semitones,
+ * so resolution is 100 / 16384 = 0.0061 cents. Synths retune the key at once (notes that are
+ * playing too), so it's used for synths that support neither MPE nor MTS-ESP library.
+ */
+namespace audio_plugin {
+namespace tuning_sysex {
+constexpr int maxChangesPerMessage = 127; ///< count is 7-bit
+constexpr int headerSize = 7;             // F0 7F device 08 02 program count
+constexpr int bytesPerChange = 4;
+constexpr int maxMessageSize = headerSize + bytesPerChange * maxChangesPerMessage + 1;
+constexpr uint8_t allDevices = 0x7F;
+constexpr int unitsPerSemitone = 16384;
+
+///< Frequency in Hz (> 0) -> semitone, frac MSB, frac LSB (clamped to the range of MTS)
+inline std::array<uint8_t, 3> encodeFreq(double freq) {
+    const double units = (69.0 + 12.0 * std::log2(freq / 440.0)) * unitsPerSemitone;
+    // 7F 7F 7F means "no change", so the highest frequency is one unit lower
+    constexpr double maxUnits = 128.0 * unitsPerSemitone - 2.0;
+    const int n = static_cast<int>(std::lround(std::clamp(units, 0.0, maxUnits)));
+    return {static_cast<uint8_t>(n >> 14), static_cast<uint8_t>((n >> 7) & 0x7F),
+            static_cast<uint8_t>(n & 0x7F)};
+}
+
+///< Semitone, frac MSB, frac LSB -> frequency in Hz
+inline double decodeFreq(uint8_t semitone, uint8_t fracMsb, uint8_t fracLsb) {
+    const int n = (semitone << 14) | (fracMsb << 7) | fracLsb;
+    return 440.0 * std::exp2((static_cast<double>(n) / unitsPerSemitone - 69.0) / 12.0);
+}
+
+/**
+ * @brief Write single note tuning change message (with F0 and F7)
+ * @param out Buffer of at least maxMessageSize bytes
+ * @param keys Midi notes (0-127) to retune
+ * @param freqs New frequencies of keys in Hz
+ * @param numChanges Number of keys, 1 to maxChangesPerMessage
+ * @param program Tuning program (0-127)
+ * @return Size of message in bytes
+ */
+inline int writeSingleNoteTuningChange(uint8_t *out, const uint8_t *keys, const double *freqs,
+                                       int numChanges, uint8_t program = 0,
+                                       uint8_t device = allDevices) {
+    int size = 0;
+    out[size++] = 0xF0;
+    out[size++] = 0x7F; // Universal real-time
+    out[size++] = device;
+    out[size++] = 0x08; // MIDI Tuning Standard
+    out[size++] = 0x02; // Single note tuning change
+    out[size++] = program;
+    out[size++] = static_cast<uint8_t>(numChanges);
+    for (int i = 0; i < numChanges; ++i) {
+        const auto [semitone, fracMsb, fracLsb] = encodeFreq(freqs[i]);
+        out[size++] = keys[i];
+        out[size++] = semitone;
+        out[size++] = fracMsb;
+        out[size++] = fracLsb;
+    }
+    out[size++] = 0xF7;
+    return size;
+}
+} // namespace tuning_sysex
+} // namespace audio_plugin
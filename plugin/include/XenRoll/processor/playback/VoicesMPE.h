@@ -0,0 +1,142 @@
+#pragma once
+
+#include "XenRoll/common/FixedCapacityMap.h"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace audio_plugin {
+/**
+ * @brief Playing voices of MPE mode (note's id -> Voice), indexed by midi channel
+ *
+ * Every midi channel has its own small table, so voices of a channel are found in O(1) (voice
+ * stealing) and lookup by note's id visits only occupied channels (without economy mode a channel
+ * has max one voice). Voices of a stolen channel are moved to a separate table with channel -1,
+ * they stay there until they end or are released, so they aren't played again.
+ *
+ * @note Doesn't allocate, use it from the audio thread.
+ */
+class VoicesMPE {
+  public:
+    struct Voice {
+        int totalCents;
+        bool hasBend;
+        int channel; ///< Midi channel 2-16, -1 if voice was silenced (channel was stolen)
+        int midiNote;
+        int lastBendMPE; ///< Last sent pitch bend, so same value isn't sent again
+    };
+
+    static constexpr int numChannels = 16;
+    ///< Voices that can share a channel in economy mode
+    static constexpr size_t maxVoicesPerChannel = 16;
+    static constexpr size_t maxSilencedVoices = 128;
+
+    Voice *find(uint64_t noteId) {
+        for (uint16_t mask = occupiedMask; mask != 0; mask &= mask - 1) {
+            Table &table = channels[std::countr_zero(mask)];
+            if (auto it = table.find(noteId); it != table.end()) {
+                return &it->second;
+            }
+        }
+        if (auto it = silenced.find(noteId); it != silenced.end()) {
+            return &it->second;
+        }
+        return nullptr;
+    }
+
+    bool contains(uint64_t noteId) { return find(noteId) != nullptr; }
+
+    ///< False if table of midi channel ch (2-16) is full
+    bool canInsert(int ch) const { return !channels[ch - 1].full(); }
+
+    ///< Insert voice to the table of it's channel (check canInsert() first)
+    void insert(uint64_t noteId, const Voice &voice) {
+        const int ind = voice.channel - 1;
+        channels[ind].insert(noteId, voice);
+        occupiedMask |= static_cast<uint16_t>(1u << ind);
+    }
+
+    void erase(uint64_t noteId) {
+        for (uint16_t mask = occupiedMask; mask != 0; mask &= mask - 1) {
+            const int ind = std::countr_zero(mask);
+            if (auto it = channels[ind].find(noteId); it != channels[ind].end()) {
+                channels[ind].erase(it);
+                updateOccupied(ind);
+                return;
+            }
+        }
+        silenced.erase(noteId);
+    }
+
+    void clear() {
+        for (uint16_t mask = occupiedMask; mask != 0; mask &= mask - 1) {
+            channels[std::countr_zero(mask)].clear();
+        }
+        occupiedMask = 0;
+        silenced.clear();
+    }
+
+    ///< Call f(noteId, voice) for every voice
+    template <typename F> void forEach(F &&f) {
+        for (uint16_t mask = occupiedMask; mask != 0; mask &= mask - 1) {
+            for (auto &[noteId, voice] : channels[std::countr_zero(mask)]) {
+                f(noteId, voice);
+            }
+        }
+        for (auto &[noteId, voice] : silenced) {
+            f(noteId, voice);
+        }
+    }
+
+    ///< Erase every voice for which shouldErase(noteId, voice) returns true
+    template <typename F> void eraseIf(F &&shouldErase) {
+        for (uint16_t mask = occupiedMask; mask != 0; mask &= mask - 1) {
+            const int ind = std::countr_zero(mask);
+            eraseIfFrom(channels[ind], shouldErase);
+            updateOccupied(ind);
+        }
+        eraseIfFrom(silenced, shouldErase);
+    }
+
+    /**
+     * @brief Move voices of midi channel ch (2-16) to silenced voices
+     * @param onSilenced Is called with every voice before it's channel is set to -1
+     * @note If there is no space for silenced voice, it's dropped (then it can be played again)
+     */
+    template <typename F> void silenceChannel(int ch, F &&onSilenced) {
+        Table &table = channels[ch - 1];
+        for (auto &[noteId, voice] : table) {
+            onSilenced(voice);
+            voice.channel = -1;
+            silenced.insert(noteId, voice);
+        }
+        table.clear();
+        updateOccupied(ch - 1);
+    }
+
+  private:
+    using Table = FixedCapacityMap<uint64_t, Voice, maxVoicesPerChannel>;
+
+    ///< Index is midi channel - 1 (first channel isn't used for notes)
+    std::array<Table, numChannels> channels;
+    FixedCapacityMap<uint64_t, Voice, maxSilencedVoices> silenced;
+    uint16_t occupiedMask = 0; ///< Channels with non-empty tables
+
+    void updateOccupied(int ind) {
+        if (channels[ind].empty()) {
+            occupiedMask &= static_cast<uint16_t>(~(1u << ind));
+        }
+    }
+
+    template <typename Map, typename F> static void eraseIfFrom(Map &map, F &shouldErase) {
+        for (auto it = map.begin(); it != map.end();) {
+            if (shouldErase(it->first, it->second)) {
+                it = map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+} // namespace audio_plugin
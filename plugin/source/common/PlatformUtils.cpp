@@ -25,6 +25,10 @@ process_id get_current_pid() {
 bool is_process_active(process_id pid) {
     if (pid == 0)
         return false;
+    // Usually all instances are in the host's process, so os isn't asked about it
+    static const process_id currentPid = get_current_pid();
+    if (pid == currentPid)
+        return true;
 
 #ifdef _WIN32
     if (pid == 0)
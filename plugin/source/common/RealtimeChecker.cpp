@@ -0,0 +1,248 @@
+#include "XenRoll/common/RealtimeChecker.h"
+
+#if XENROLL_REALTIME_CHECKS
+
+    #include <array>
+    #include <atomic>
+    #include <cstdint>
+    #include <cstdio>
+    #include <cstdlib>
+    #include <juce_core/juce_core.h>
+    #include <new>
+
+    #ifndef _WIN32
+        #include <dlfcn.h>
+    #endif
+    #if defined(__GNUG__)
+        #include <cxxabi.h>
+    #endif
+
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define XENROLL_RETURN_ADDRESS() _ReturnAddress()
+    #else
+        #define XENROLL_RETURN_ADDRESS() __builtin_return_address(0)
+    #endif
+
+namespace audio_plugin {
+namespace {
+struct SiteStats {
+    std::atomic<const void *> site{nullptr}; ///< nullptr if entry is empty
+    std::atomic<int> violation{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> blocks{0};      ///< Number of blocks with this violation
+    std::atomic<uint64_t> maxPerBlock{0};
+    std::atomic<uint64_t> lastBlock{0};   ///< Last block with this violation
+    std::atomic<uint64_t> inLastBlock{0}; ///< Count in lastBlock
+};
+
+constexpr int maxSites = 256;
+std::array<SiteStats, maxSites> sites;
+std::atomic<uint64_t> lostViolations{0}; ///< Violations that didn't fit into sites
+std::atomic<uint64_t> numBlocks{0};
+
+thread_local int scopeDepth = 0;
+thread_local uint64_t currentBlock = 0;
+///< Set while violation is being recorded, so allocations of jassertfalse aren't recorded
+thread_local bool isRecording = false;
+
+std::atomic_flag claimLock = ATOMIC_FLAG_INIT; ///< For adding new sites (rare)
+
+SiteStats *findOrClaim(RealtimeChecker::Violation violation, const void *site, bool &isNew) {
+    // Open addressing by site pointer, entries are never removed (except by reset())
+    const auto hash = reinterpret_cast<uintptr_t>(site) * 0x9E3779B97F4A7C15ull;
+    const int start = static_cast<int>((hash >> 32) % maxSites);
+    for (int probe = 0; probe < maxSites; ++probe) {
+        SiteStats &stats = sites[(start + probe) % maxSites];
+        const void *current = stats.site.load(std::memory_order_acquire);
+        if (current == nullptr) {
+            while (claimLock.test_and_set(std::memory_order_acquire)) {
+            }
+            current = stats.site.load(std::memory_order_acquire);
+            if (current == nullptr) {
+                stats.violation.store(static_cast<int>(violation), std::memory_order_relaxed);
+                stats.site.store(site, std::memory_order_release);
+                current = site;
+                isNew = true;
+            }
+            claimLock.clear(std::memory_order_release);
+        }
+        if (current == site) {
+            return &stats;
+        }
+    }
+    return nullptr;
+}
+
+const char *violationName(RealtimeChecker::Violation violation) {
+    switch (violation) {
+    case RealtimeChecker::Violation::HeapAllocation:
+        return "heap allocation";
+    case RealtimeChecker::Violation::HeapDeallocation:
+        return "heap deallocation";
+    case RealtimeChecker::Violation::MutexLock:
+        return "mutex lock";
+    case RealtimeChecker::Violation::IpcMutexLock:
+        return "interprocess mutex lock";
+    case RealtimeChecker::Violation::BlockingCall:
+        return "blocking call";
+    }
+    return "unknown";
+}
+
+std::string describeSite(RealtimeChecker::Violation violation, const void *site) {
+    if (violation != RealtimeChecker::Violation::HeapAllocation &&
+        violation != RealtimeChecker::Violation::HeapDeallocation) {
+        return static_cast<const char *>(site);
+    }
+    char address[32];
+    std::snprintf(address, sizeof(address), "%p", site);
+    #ifndef _WIN32
+    Dl_info info;
+    if (dladdr(site, &info) != 0 && info.dli_sname != nullptr) {
+        std::string name = info.dli_sname;
+        #if defined(__GNUG__)
+        int status = 0;
+        if (char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status)) {
+            name = demangled;
+            std::free(demangled);
+        }
+        #endif
+        return name + " [" + address + "]";
+    }
+    #endif
+    return address;
+}
+} // namespace
+
+RealtimeChecker::Scope::Scope() {
+    if (scopeDepth++ == 0) {
+        currentBlock = numBlocks.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+}
+
+RealtimeChecker::Scope::~Scope() { --scopeDepth; }
+
+bool RealtimeChecker::isRealtimeThread() { return scopeDepth > 0; }
+
+void RealtimeChecker::record(Violation violation, const void *site) {
+    if (scopeDepth == 0 || isRecording) {
+        return;
+    }
+    isRecording = true;
+
+    bool isNew = false;
+    SiteStats *stats = findOrClaim(violation, site, isNew);
+    if (stats == nullptr) {
+        lostViolations.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        stats->total.fetch_add(1, std::memory_order_relaxed);
+        uint64_t countInBlock = 1;
+        if (stats->lastBlock.exchange(currentBlock, std::memory_order_relaxed) != currentBlock) {
+            stats->blocks.fetch_add(1, std::memory_order_relaxed);
+            stats->inLastBlock.store(1, std::memory_order_relaxed);
+        } else {
+            countInBlock = stats->inLastBlock.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+        uint64_t maxPerBlock = stats->maxPerBlock.load(std::memory_order_relaxed);
+        while (countInBlock > maxPerBlock &&
+               !stats->maxPerBlock.compare_exchange_weak(maxPerBlock, countInBlock,
+                                                         std::memory_order_relaxed)) {
+        }
+    }
+
+    #if XENROLL_REALTIME_CHECKS_TRAP
+    if (isNew) {
+        jassertfalse; // Look at the call stack: audio thread did something not real-time safe
+    }
+    #endif
+    isRecording = false;
+}
+
+std::string RealtimeChecker::getReport() {
+    std::string report = "Real-time safety report (" +
+                         std::to_string(numBlocks.load(std::memory_order_relaxed)) +
+                         " blocks):\n";
+    bool isClean = true;
+    for (const SiteStats &stats : sites) {
+        const void *site = stats.site.load(std::memory_order_acquire);
+        if (site == nullptr) {
+            continue;
+        }
+        isClean = false;
+        const auto violation =
+            static_cast<Violation>(stats.violation.load(std::memory_order_relaxed));
+        report += "  " + std::string(violationName(violation)) + " at " +
+                  describeSite(violation, site) +
+                  ": total=" + std::to_string(stats.total.load(std::memory_order_relaxed)) +
+                  ", blocks=" + std::to_string(stats.blocks.load(std::memory_order_relaxed)) +
+                  ", maxPerBlock=" +
+                  std::to_string(stats.maxPerBlock.load(std::memory_order_relaxed)) + "\n";
+    }
+    if (const uint64_t lost = lostViolations.load(std::memory_order_relaxed); lost > 0) {
+        report += "  (" + std::to_string(lost) + " violations at other sites weren't recorded)\n";
+    }
+    if (isClean) {
+        report += "  no violations\n";
+    }
+    return report;
+}
+
+void RealtimeChecker::reset() {
+    for (SiteStats &stats : sites) {
+        stats.total = 0;
+        stats.blocks = 0;
+        stats.maxPerBlock = 0;
+        stats.lastBlock = 0;
+        stats.inLastBlock = 0;
+        stats.site = nullptr;
+    }
+    lostViolations = 0;
+    numBlocks = 0;
+}
+} // namespace audio_plugin
+
+// ========================= Global allocation functions (replaced) ==========================
+// Aligned versions aren't replaced, they don't share the heap with these ones anyway
+
+namespace {
+void *allocate(std::size_t size, const void *site, bool throwIfFailed) {
+    audio_plugin::RealtimeChecker::record(
+        audio_plugin::RealtimeChecker::Violation::HeapAllocation, site);
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr && throwIfFailed) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void deallocate(void *p, const void *site) noexcept {
+    if (p != nullptr) {
+        audio_plugin::RealtimeChecker::record(
+            audio_plugin::RealtimeChecker::Violation::HeapDeallocation, site);
+    }
+    std::free(p);
+}
+} // namespace
+
+void *operator new(std::size_t size) { return allocate(size, XENROLL_RETURN_ADDRESS(), true); }
+void *operator new[](std::size_t size) { return allocate(size, XENROLL_RETURN_ADDRESS(), true); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size, XENROLL_RETURN_ADDRESS(), false);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size, XENROLL_RETURN_ADDRESS(), false);
+}
+
+void operator delete(void *p) noexcept { deallocate(p, XENROLL_RETURN_ADDRESS()); }
+void operator delete[](void *p) noexcept { deallocate(p, XENROLL_RETURN_ADDRESS()); }
+void operator delete(void *p, std::size_t) noexcept { deallocate(p, XENROLL_RETURN_ADDRESS()); }
+void operator delete[](void *p, std::size_t) noexcept { deallocate(p, XENROLL_RETURN_ADDRESS()); }
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    deallocate(p, XENROLL_RETURN_ADDRESS());
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    deallocate(p, XENROLL_RETURN_ADDRESS());
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "XenRoll/editor/PluginEditor.h"
 #include "XenRoll/processor/PluginProcessor.h"
+#include "XenRoll/processor/playback/MidiBounce.h"
 
 namespace audio_plugin {
 void CustomLookAndFeel::updateColors() {
@@ -247,7 +248,9 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(AudioPluginAudi
     addAndMakeVisible(settingsViewport.get());
     settingsViewport->setVisible(false);
 
-    dissonancePanel = std::make_unique<DissonancePanel>(processorRef.params, dissonanceMeter);
+    dissonancePanel = std::make_unique<DissonancePanel>(
+        processorRef.params, dissonanceMeter,
+        [this](bool findPartialsMode) { processorRef.setFindPartialsMode(findPartialsMode); });
     addAndMakeVisible(dissonancePanel.get());
     dissonancePanel->setVisible(false);
 
@@ -384,7 +387,9 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(AudioPluginAudi
     tuningTypeCombo->setTooltip("AFTER THE CHANGE: SAVE & RESTART PROJECT!\nMPE: max 15 "
                                 "simultaneously playing pitches; default\nMTS-ESP: max 16 "
                                 "instances, each instance uses separate midi channel; check out "
-                                "the details in the README on Github: github.com/ankalot/xenroll");
+                                "the details in the README on Github: github.com/ankalot/xenroll"
+                                "\nMTS SysEx: tuning is sent in midi channel 1 as MIDI Tuning "
+                                "Standard messages, for synths without MPE and MTS-ESP");
     addAndMakeVisible(tuningTypeCombo.get());
 
     ghostNotesKeysButton = std::make_unique<SVGButton>(
@@ -466,24 +471,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(AudioPluginAudi
     addAndMakeVisible(numBarsInput.get());
 
     indexLabel = std::make_unique<juce::Label>();
-    bool isActive = processorRef.getIsActive();
-    juce::String indexText;
-    if (processorRef.params.getTuningType() == Parameters::TuningType::MPE) {
-        indexText = "ID: ";
-        if (isActive) {
-            indexText += juce::String(processorRef.params.instanceId + 1);
-        } else {
-            indexText += "-";
-        }
-    } else if (processorRef.params.getTuningType() == Parameters::TuningType::MTS_ESP) {
-        indexText = "CH: ";
-        if (isActive) {
-            indexText += juce::String(processorRef.params.channelIndex + 1);
-        } else {
-            indexText += "-";
-        }
-    }
-    indexLabel->setText(indexText, juce::dontSendNotification);
+    indexLabel->setText(getIndexText(), juce::dontSendNotification);
     currentFont.setHeight(Theme::medium);
     indexLabel->setFont(currentFont);
     addAndMakeVisible(indexLabel.get());
@@ -574,12 +562,15 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(AudioPluginAudi
         alert->setUsingNativeTitleBar(true);
         alert->addButton(".mid OR .mid + .scl (no bends info)", 1);
         alert->addButton(".notes", 2);
+        alert->addButton("retuned .mid (MPE OR MTS SysEx, with bends)", 3);
 
         alert->enterModalState(true, juce::ModalCallbackFunction::create([this, alert](int result) {
                                    if (result == 1) {
                                        exportMidiSclFiles();
                                    } else if (result == 2) {
                                        exportNotesFile();
+                                   } else if (result == 3) {
+                                       exportRetunedMidiFile();
                                    }
                                    alert->exitModalState(result);
                                    alert->setVisible(false);
@@ -707,6 +698,9 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(AudioPluginAudi
     exportFileChooser = std::make_unique<juce::FileChooser>(
         "Export notes", juce::File::getSpecialLocation(juce::File::userHomeDirectory),
         "*.mid;*.midi;*.notes");
+    midiInputScaleFileChooser = std::make_unique<juce::FileChooser>(
+        "Scale for MIDI input", juce::File::getSpecialLocation(juce::File::userHomeDirectory),
+        "*.scl");
 
     reconnectOSCSender();
 
@@ -720,19 +714,6 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(AudioPluginAudi
         updatePitchMemory();
     }
 
-    if (!isActive) {
-        showMessageBoxAsync(
-            juce::AlertWindow::WarningIcon, "ERROR",
-            juce::String("One of two things happened:") +
-                "1. You have exceeded the limit of instances of this plugin (16).\n" +
-                "FIX: Delete this instance, it won't work.\n\n" +
-                "2. There was corruption of the data needed to synchronize the instances, or one "
-                "of the instances crashed last time.\n" +
-                "FIX: Close your DAW and open it again (If this does not help, then restart your "
-                "PC).",
-            "OK", this);
-    }
-
     startTimer(timerMs);
 }
 
@@ -1020,73 +1001,79 @@ void AudioPluginAudioProcessorEditor::setManuallyPlayedKeys(
                                  keyboardManuallyPlayedKeys.end());
     allManuallyPlayedKeys.insert(leftManuallyPlayedKeys.begin(), leftManuallyPlayedKeys.end());
 
-    if ((mode != "drag") && processorRef.params.recordManuallyPlayedNotes &&
-        processorRef.isPlaying()) {
-        float currPlayHeadTime = processorRef.getPlayHeadTime();
-
-        // stop recording released notes
-        for (auto &note : recordedManuallyPlayedNotes) {
-            if (!note.isSelected &&
-                !allManuallyPlayedKeys.contains(note.octave * 1200 + note.cents)) {
-                note.isSelected = true;
-                note.duration = currPlayHeadTime - note.time;
-            }
-        }
-
-        // start recording new notes
-        for (const auto &[totalCents, velocity] : allManuallyPlayedKeys) {
-            bool recordNewNote = true;
-            for (auto &note : recordedManuallyPlayedNotes) {
-                if (!note.isSelected && (note.octave * 1200 + note.cents == totalCents)) {
-                    recordNewNote = false;
-                    continue;
-                }
-            }
-            if (recordNewNote) {
-                Note newNote;
-                newNote.octave = totalCents / 1200;
-                newNote.cents = totalCents % 1200;
-                newNote.time = currPlayHeadTime;
-                newNote.duration = 0.0f;
-                newNote.velocity = velocity;
-                newNote.isSelected = false;
-                newNote.bend = 0;
-                recordedManuallyPlayedNotes.push_back(newNote);
-            }
+    // Notes that are played only by dragging aren't recorded
+    std::set<int> notRecordedKeys;
+    for (const auto &[totalCents, velocity] : dragManuallyPlayedKeys) {
+        if (!allManuallyPlayedKeys.contains(totalCents)) {
+            notRecordedKeys.insert(totalCents);
         }
     }
 
     allManuallyPlayedKeys.insert(dragManuallyPlayedKeys.begin(), dragManuallyPlayedKeys.end());
-    processorRef.setManuallyPlayedNotes(allManuallyPlayedKeys);
+    processorRef.setManuallyPlayedNotes(allManuallyPlayedKeys, notRecordedKeys);
 }
 
 void AudioPluginAudioProcessorEditor::startRecordingManuallyPlayedNotes() {
     recordedManuallyPlayedNotes.clear();
+    openRecordedNotes.clear();
+    // Skip events of previous recording that weren't popped
+    AudioPluginAudioProcessor::RecordedNoteEvent event;
+    while (processorRef.popRecordedNoteEvent(event)) {
+    }
     processorRef.params.recordManuallyPlayedNotes = true;
     mainPanel->repaint();
 }
 
 void AudioPluginAudioProcessorEditor::endRecordingManuallyPlayedNotes() {
-    if (processorRef.isPlaying()) {
-        float currPlayHeadTime = processorRef.getPlayHeadTime();
-        for (auto &note : recordedManuallyPlayedNotes) {
-            if (!note.isSelected) {
-                note.duration = currPlayHeadTime - note.time;
-                note.isSelected = true;
+    processorRef.params.recordManuallyPlayedNotes = false;
+    // Events were only for progress display, the take is recorded by processor
+    recordedManuallyPlayedNotes = processorRef.takeRecordedNotes();
+    AudioPluginAudioProcessor::RecordedNoteEvent event;
+    while (processorRef.popRecordedNoteEvent(event)) {
+    }
+    // Notes that are still held end at the playhead
+    const float currPlayHeadTime = processorRef.getPlayHeadTime();
+    for (auto &note : recordedManuallyPlayedNotes) {
+        if (!note.isSelected) {
+            if (processorRef.isPlaying()) {
+                note.duration = std::max(note.duration, currPlayHeadTime - note.time);
             }
-        }
-    } else {
-        for (auto &note : recordedManuallyPlayedNotes) {
             note.isSelected = true;
         }
     }
 
     mainPanel->addRecordedNotes(recordedManuallyPlayedNotes);
     recordedManuallyPlayedNotes.clear();
-    processorRef.params.recordManuallyPlayedNotes = false;
+    openRecordedNotes.clear();
     mainPanel->repaint();
 }
 
+bool AudioPluginAudioProcessorEditor::popRecordedNoteEvents() {
+    bool popped = false;
+    AudioPluginAudioProcessor::RecordedNoteEvent event;
+    while (processorRef.popRecordedNoteEvent(event)) {
+        popped = true;
+        if (event.isNoteOn) {
+            Note newNote;
+            newNote.octave = event.totalCents / 1200;
+            newNote.cents = event.totalCents % 1200;
+            newNote.time = static_cast<float>(event.time);
+            newNote.duration = 0.0f;
+            newNote.velocity = event.velocity;
+            newNote.isSelected = false;
+            newNote.bend = 0;
+            openRecordedNotes[event.id] = recordedManuallyPlayedNotes.size();
+            recordedManuallyPlayedNotes.push_back(newNote);
+        } else if (auto it = openRecordedNotes.find(event.id); it != openRecordedNotes.end()) {
+            auto &note = recordedManuallyPlayedNotes[it->second];
+            note.duration = static_cast<float>(event.time) - note.time;
+            note.isSelected = true;
+            openRecordedNotes.erase(it);
+        }
+    }
+    return popped;
+}
+
 std::optional<std::vector<int>> parseSclFile(const juce::File &file) {
     juce::FileInputStream inputStream(file);
     if (!inputStream.openedOk()) {
@@ -1359,7 +1346,8 @@ void AudioPluginAudioProcessorEditor::importMidiSclFiles() {
 void AudioPluginAudioProcessorEditor::exportMidiSclFiles() {
     std::vector<int> keysFromNotes;
     keysFromNotes.push_back(0);
-    const std::vector<Note> &notes = getNotes();
+    NotesSnapshotPtr notesSnapshot = getNotesSnapshot();
+    const std::vector<Note> &notes = notesSnapshot->getNotes();
     std::vector<int> keysIndexes(notes.size());
 
     for (int i = 0; i < notes.size(); ++i) {
@@ -1460,12 +1448,53 @@ void AudioPluginAudioProcessorEditor::exportMidiSclFiles() {
         });
 }
 
+void AudioPluginAudioProcessorEditor::exportRetunedMidiFile() {
+    NotesSnapshotPtr notesSnapshot = getNotesSnapshot();
+    auto [bpm, numerator, denominator] = processorRef.getBpmNumDenom();
+    const MidiBounce::Settings settings =
+        MidiBounce::settingsFromParameters(processorRef.params, bpm, numerator, denominator);
+
+    exportFileChooser.get()->launchAsync(
+        juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles,
+        [this, notesSnapshot, settings](const juce::FileChooser &fc) {
+            juce::File midiFile = fc.getResult();
+            if (midiFile == juce::File{})
+                return;
+            if (!midiFile.hasFileExtension(".midi;mid")) {
+                midiFile = midiFile.withFileExtension(".mid");
+            }
+            midiFile.deleteFile();
+
+            // Notes are played offline with current tuning settings (much faster than real time)
+            const MidiBounce::Result result = MidiBounce::bounce(*notesSnapshot, settings);
+
+            juce::FileOutputStream outputStream(midiFile);
+            if (!outputStream.openedOk()) {
+                showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Error",
+                                    "Failed to create file: " + midiFile.getFullPathName(), "OK",
+                                    this);
+                return;
+            }
+            MidiBounce::writeMidiFile(result, outputStream);
+            outputStream.flush();
+
+            if (result.numDroppedNotes > 0) {
+                showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Warning",
+                                    juce::String(result.numDroppedNotes) +
+                                        " notes were dropped: there were no free midi channels "
+                                        "(MPE) or midi notes (MTS SysEx) for them",
+                                    "OK", this);
+            }
+        });
+}
+
 void AudioPluginAudioProcessorEditor::exportNotesFile() {
-    const std::vector<Note> &notes = getNotes();
+    NotesSnapshotPtr notesSnapshot = getNotesSnapshot();
 
     exportFileChooser.get()->launchAsync(
         juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles,
-        [this, notes](const juce::FileChooser &fc) {
+        [this, notesSnapshot](const juce::FileChooser &fc) {
+            const std::vector<Note> &notes = notesSnapshot->getNotes();
             juce::File notesFile = fc.getResult().withFileExtension(".notes");
             if (notesFile == juce::File{})
                 return;
@@ -1543,6 +1572,23 @@ void AudioPluginAudioProcessorEditor::parseNotesFile(const juce::File &notesFile
                         "BPM of imported track: " + juce::String(bpm), "OK", this);
 }
 
+void AudioPluginAudioProcessorEditor::chooseMidiInputScale() {
+    midiInputScaleFileChooser.get()->launchAsync(
+        juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+        [this](const juce::FileChooser &fc) {
+            juce::File sclFile = fc.getResult();
+            if (sclFile == juce::File{})
+                return;
+            auto sclScaleOpt = parseSclFile(sclFile);
+            if (!sclScaleOpt || sclScaleOpt->empty() || sclScaleOpt->back() <= 0) {
+                showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Error",
+                                    "Failed to parse .scl file", "OK", this);
+                return;
+            }
+            processorRef.setMidiInputScale(sclScaleOpt.value());
+        });
+}
+
 void AudioPluginAudioProcessorEditor::importNotesFile() {
     importFileChooser.get()->launchAsync(
         juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
@@ -1639,17 +1685,24 @@ void AudioPluginAudioProcessorEditor::updatePitchMemory() {
         // 0. Stop finding PitchMemoryResults
         pitchMemoryTerminate.store(true);
         pitchMemoryThreadPool->removeAllJobs(true, 0);
-        // 1. Get notes
-        std::vector<Note> notes = getNotes();
-        // 2. Remove notes that are not in active zones
-        notes.erase(std::remove_if(notes.begin(), notes.end(),
-                                   [this](const Note &note) {
-                                       return !this->processorRef.params.zones.isNoteInActiveZone(
-                                           note);
-                                   }),
-                    notes.end());
+        // 1. Get notes (they are shared with processor)
+        NotesSnapshotPtr notesSnapshot = getNotesSnapshot();
+        const std::vector<Note> &allNotes = notesSnapshot->getNotes();
+        // 2. Remove notes that are not in active zones (copy notes only if there are such notes)
+        auto isInActiveZone = [this](const Note &note) {
+            return this->processorRef.params.zones.isNoteInActiveZone(note);
+        };
+        std::optional<std::vector<Note>> notesInZones;
+        if (!std::all_of(allNotes.begin(), allNotes.end(), isInActiveZone)) {
+            notesInZones.emplace();
+            std::copy_if(allNotes.begin(), allNotes.end(), std::back_inserter(*notesInZones),
+                         isInActiveZone);
+        }
         // 3. Add job where PitchMemoryResults will be found
-        pitchMemoryThreadPool->addJob([this, notes, showKeysHarmonicity]() {
+        pitchMemoryThreadPool->addJob([this, notesSnapshot, notesInZones = std::move(notesInZones),
+                                       showKeysHarmonicity]() {
+            const std::vector<Note> &notes =
+                notesInZones.has_value() ? notesInZones.value() : notesSnapshot->getNotes();
             pitchMemoryTerminate.store(false);
             this->pitchMemory->set_TV_add_influence(
                 this->processorRef.params.pitchMemoryTVaddInfluence);
@@ -1677,6 +1730,28 @@ void AudioPluginAudioProcessorEditor::updatePitchMemory() {
     }
 }
 
+juce::String AudioPluginAudioProcessorEditor::getIndexText() {
+    const bool isActive = processorRef.getIsActive();
+    juce::String indexText;
+    if (processorRef.params.getTuningType() == Parameters::TuningType::MPE) {
+        indexText = "ID: ";
+        if (isActive && processorRef.params.instanceId != -1) {
+            indexText += juce::String(processorRef.params.instanceId + 1);
+        } else {
+            indexText += "-";
+        }
+    } else if (processorRef.params.getTuningType() == Parameters::TuningType::MTS_ESP ||
+               processorRef.params.getTuningType() == Parameters::TuningType::MTS_SYSEX) {
+        indexText = "CH: ";
+        if (isActive && processorRef.params.channelIndex != -1) {
+            indexText += juce::String(processorRef.params.channelIndex + 1);
+        } else {
+            indexText += "-";
+        }
+    }
+    return indexText;
+}
+
 void AudioPluginAudioProcessorEditor::timerCallback() {
     // This timer runs pretty fast so don't spam mainPanel with excessive repaints!
     const bool isPlaying = processorRef.isPlaying();
@@ -1684,7 +1759,6 @@ void AudioPluginAudioProcessorEditor::timerCallback() {
     float newPlayHeadTime = processorRef.getPlayHeadTime();
     leftPanel.get()->updateCurrPlayingKeys(mainPanel->getNotes(), isPlaying, newPlayHeadTime,
                                            allManuallyPlayedKeys, isAuditioning, auditionTime);
-    float prevPlayHeadTime = playHeadTime;
     if (newPlayHeadTime != playHeadTime) {
         mainPanelNeedsRepaint = true;
         const int currNumBars = processorRef.params.get_num_bars();
@@ -1708,6 +1782,26 @@ void AudioPluginAudioProcessorEditor::timerCallback() {
 
     if (ghostNotesTicker == 0) {
         updateGhostNotes();
+        // Instance manager gets channel / id after the editor is opened (when it's init is done)
+        const juce::String indexText = getIndexText();
+        if (indexText != indexLabel->getText()) {
+            indexLabel->setText(indexText, juce::dontSendNotification);
+            resized();
+            repaint();
+        }
+        if (!instanceSyncErrorShown && processorRef.hasInstanceSyncFailed()) {
+            instanceSyncErrorShown = true;
+            showMessageBoxAsync(
+                juce::AlertWindow::WarningIcon, "ERROR",
+                juce::String("One of two things happened:") +
+                    "1. You have exceeded the limit of instances of this plugin (16).\n" +
+                    "FIX: Delete this instance, it won't work.\n\n" +
+                    "2. There was corruption of the data needed to synchronize the instances, or "
+                    "one of the instances crashed last time.\n" +
+                    "FIX: Close your DAW and open it again (If this does not help, then restart "
+                    "your PC).",
+                "OK", this);
+        }
     }
     ghostNotesTicker++;
     ghostNotesTicker = ghostNotesTicker % ghostNotesTimerTicks;
@@ -1715,7 +1809,8 @@ void AudioPluginAudioProcessorEditor::timerCallback() {
     bool pitchOverflow = processorRef.thereIsPitchOverflow();
     if (pitchOverflow) {
         juce::String msg;
-        if (processorRef.params.getTuningType() == Parameters::TuningType::MTS_ESP) {
+        if (processorRef.params.getTuningType() == Parameters::TuningType::MTS_ESP ||
+            processorRef.params.getTuningType() == Parameters::TuningType::MTS_SYSEX) {
             msg = juce::String(
                       "You have exceeded the limit on the number of unique pitches (128). ") +
                   "This number includes all notes from the piano roll and those that are played " +
@@ -1735,40 +1830,15 @@ void AudioPluginAudioProcessorEditor::timerCallback() {
     }
 
     if (processorRef.params.recordManuallyPlayedNotes) {
-        if (isPlaying) {
-            if (playHeadTime > prevPlayHeadTime) {
-                for (auto &note : recordedManuallyPlayedNotes) {
-                    if (!note.isSelected) {
-                        note.duration = playHeadTime - note.time;
-                    }
-                }
-            } else if (playHeadTime < prevPlayHeadTime) {
-                const int rmpnNum = recordedManuallyPlayedNotes.size();
-
-                for (int i = 0; i < rmpnNum; ++i) {
-                    auto &note = recordedManuallyPlayedNotes[i];
-                    if (!note.isSelected) {
-                        note.isSelected = true;
-
-                        Note newNote;
-                        newNote.octave = note.octave;
-                        newNote.cents = note.cents;
-                        newNote.time = playHeadTime;
-                        newNote.duration = 0.0f;
-                        newNote.velocity = note.velocity;
-                        newNote.isSelected = false;
-                        newNote.bend = 0;
-                        recordedManuallyPlayedNotes.push_back(newNote);
-                    }
-                }
-            }
-            wasPlayingRMPN = true;
+        if (popRecordedNoteEvents()) {
             mainPanelNeedsRepaint = true;
-        } else if (wasPlayingRMPN) {
-            for (auto &note : recordedManuallyPlayedNotes) {
-                note.isSelected = true;
+        }
+        // Held notes are drawn up to the playhead (their end is set by note off from processor)
+        if (isPlaying && !openRecordedNotes.empty()) {
+            for (const auto &[id, ind] : openRecordedNotes) {
+                auto &note = recordedManuallyPlayedNotes[ind];
+                note.duration = std::max(0.0f, playHeadTime - note.time);
             }
-            wasPlayingRMPN = false;
             mainPanelNeedsRepaint = true;
         }
     }
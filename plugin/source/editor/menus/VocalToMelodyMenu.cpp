@@ -147,6 +147,24 @@ VocalToMelodyMenu::VocalToMelodyMenu(Parameters &params, AudioPluginAudioProcess
     };
     addAndMakeVisible(micGain_dBSlider.get());
 
+    vocalToMelodyHopMsLabel = std::make_unique<juce::Label>();
+    vocalToMelodyHopMsLabel->setFont(currentFont);
+    vocalToMelodyHopMsLabel->setText("Analysis hop (ms)", juce::dontSendNotification);
+    vocalToMelodyHopMsLabel->setJustificationType(juce::Justification::centred);
+    addAndMakeVisible(vocalToMelodyHopMsLabel.get());
+
+    vocalToMelodyHopMsSlider = std::make_unique<juce::Slider>();
+    vocalToMelodyHopMsSlider->setLookAndFeel(editor.smallLF.get());
+    vocalToMelodyHopMsSlider->setRange(params.min_vocalToMelodyHopMs,
+                                       params.max_vocalToMelodyHopMs, 0.5);
+    vocalToMelodyHopMsSlider->setValue(params.vocalToMelodyHopMs);
+    vocalToMelodyHopMsSlider->setTextBoxStyle(juce::Slider::TextBoxLeft, false, 45, rowHeight);
+    vocalToMelodyHopMsSlider->setSliderStyle(juce::Slider::LinearHorizontal);
+    vocalToMelodyHopMsSlider->onDragEnd = [this, &params]() {
+        params.vocalToMelodyHopMs = static_cast<float>(vocalToMelodyHopMsSlider->getValue());
+    };
+    addAndMakeVisible(vocalToMelodyHopMsSlider.get());
+
     int y = vertPadding;
     vocalToMelodyGenCurveLabel->setBounds(horPadding, y, width - 2 * horPadding - rowHeight,
                                           rowHeight);
@@ -188,6 +206,11 @@ VocalToMelodyMenu::VocalToMelodyMenu(Parameters &params, AudioPluginAudioProcess
     micGain_dBLabel->setBounds(horPadding, y, width - 2 * horPadding, rowHeight);
     y += rowHeight;
     micGain_dBSlider->setBounds(horPadding, y, width - 2 * horPadding, rowHeight);
+    y += rowHeight + rowSkip;
+
+    vocalToMelodyHopMsLabel->setBounds(horPadding, y, width - 2 * horPadding, rowHeight);
+    y += rowHeight;
+    vocalToMelodyHopMsSlider->setBounds(horPadding, y, width - 2 * horPadding, rowHeight);
     y += rowHeight;
 
     const int totalHeight = y + vertPadding;
@@ -3,8 +3,10 @@
 
 namespace audio_plugin {
 DissonancePanel::DissonancePanel(Parameters &params,
-                                 std::shared_ptr<DissonanceMeter> dissonanceMeter)
-    : params(params), dissonanceMeter(dissonanceMeter) {
+                                 std::shared_ptr<DissonanceMeter> dissonanceMeter,
+                                 std::function<void(bool)> setFindPartialsMode)
+    : params(params), dissonanceMeter(dissonanceMeter),
+      setFindPartialsMode(std::move(setFindPartialsMode)) {
     // so InterInput won't receive focus when panel becomes focused
     setWantsKeyboardFocus(true);
     setVisible(false);
@@ -390,7 +392,7 @@ DissonancePanel::DissonancePanel(Parameters &params,
             "threadshold.\n");
     addAndMakeVisible(switchFindPartialsModeButton.get());
     switchFindPartialsModeButton->onClick = [this, &params](const juce::MouseEvent &) {
-        params.findPartialsMode.store(!params.findPartialsMode.load());
+        setFindPartialsMode(!params.findPartialsMode.load());
         return true;
     };
 
@@ -37,7 +37,7 @@ MainPanel::MainPanel(AudioPluginAudioProcessorEditor &editor, Parameters &params
     setWantsKeyboardFocus(true);
     setMouseClickGrabsKeyboardFocus(true);
 
-    notes = editor.getNotes();
+    notes = editor.getNotesSnapshot()->getNotes();
     unselectAllNotes();
     remakeKeys();
 
@@ -104,6 +104,31 @@ SettingsPanel::SettingsPanel(Parameters &params, AudioPluginAudioProcessorEditor
     horZoomOnCursorCheckbox->setSize(rowHeight, rowHeight);
     addAndMakeVisible(horZoomOnCursorCheckbox.get());
 
+    midiInputMappingLabel = std::make_unique<juce::Label>();
+    midiInputMappingLabel->setText("Play MIDI input (controller) as:", juce::dontSendNotification);
+    midiInputMappingLabel->setFont(settingFont);
+    midiInputMappingLabel->setTooltip(
+        "How notes from the MIDI input of the plugin are mapped to pitches. They are played "
+        "right away, like manually played notes.\n"
+        "Keys as scale: MIDI note n is key (n % number of keys) of octave (n / number of keys).\n"
+        "Nearest key: MIDI note is snapped to the nearest key.\n"
+        "Loaded .scl scale: you will be asked for a .scl file.");
+    addAndMakeVisible(midiInputMappingLabel.get());
+
+    midiInputMappingCombo = std::make_unique<juce::ComboBox>();
+    midiInputMappingCombo->addItemList(Parameters::getMidiInputMappingNames(), 1);
+    midiInputMappingCombo->setSelectedId(static_cast<int>(params.midiInputMapping.load()));
+    midiInputMappingLabel->attachToComponent(midiInputMappingCombo.get(), true);
+    midiInputMappingCombo->onChange = [this, &params, &editor]() {
+        params.midiInputMapping.store(
+            static_cast<Parameters::MidiInputMapping>(midiInputMappingCombo->getSelectedId()));
+        if (params.midiInputMapping.load() == Parameters::MidiInputSclScale) {
+            editor.chooseMidiInputScale();
+        }
+        editor.changedMidiInputMapping();
+    };
+    addAndMakeVisible(midiInputMappingCombo.get());
+
     // ==================== VISUAL SETTINGS ====================
     visualSettingsHeader = std::make_unique<juce::Label>();
     visualSettingsHeader->setFont(headerFont);
@@ -131,6 +156,7 @@ SettingsPanel::SettingsPanel(Parameters &params, AudioPluginAudioProcessorEditor
         basicSettingsHeader->setColour(juce::Label::backgroundColourId, params.theme.darkest);
         visualSettingsHeader->setColour(juce::Label::backgroundColourId, params.theme.darkest);
         mpeSettingsHeader->setColour(juce::Label::backgroundColourId, params.theme.darkest);
+        mtsSettingsHeader->setColour(juce::Label::backgroundColourId, params.theme.darkest);
     };
     addAndMakeVisible(themeTypeCombo.get());
 
@@ -253,6 +279,93 @@ SettingsPanel::SettingsPanel(Parameters &params, AudioPluginAudioProcessorEditor
     };
     channelsEconomyModeMPECheckbox->setSize(rowHeight, rowHeight);
     addAndMakeVisible(channelsEconomyModeMPECheckbox.get());
+
+    bendControlRateMPELabel = std::make_unique<juce::Label>();
+    bendControlRateMPELabel->setFont(settingFont);
+    bendControlRateMPELabel->setText("Note bend control rate:", juce::dontSendNotification);
+    bendControlRateMPELabel->setTooltip(
+        "How often pitch bend of bending notes is sent. Lower values give smoother bends but more "
+        "MIDI messages. Unchanged pitch bend values are never sent twice.");
+    addAndMakeVisible(bendControlRateMPELabel.get());
+
+    bendControlRateMPECombo = std::make_unique<juce::ComboBox>();
+    for (int rate = 16; rate <= 512; rate *= 2) {
+        bendControlRateMPECombo->addItem("Every " + juce::String(rate) + " samples", rate);
+    }
+    bendControlRateMPECombo->setSelectedId(params.bendControlRateMPE);
+    bendControlRateMPELabel->attachToComponent(bendControlRateMPECombo.get(), true);
+    bendControlRateMPECombo->onChange = [this, &params]() {
+        params.bendControlRateMPE = bendControlRateMPECombo->getSelectedId();
+    };
+    addAndMakeVisible(bendControlRateMPECombo.get());
+
+    voiceStealingMPELabel = std::make_unique<juce::Label>();
+    voiceStealingMPELabel->setFont(settingFont);
+    voiceStealingMPELabel->setText("Voice stealing:", juce::dontSendNotification);
+    voiceStealingMPELabel->setTooltip(
+        "Which playing note is stopped to free a MIDI channel for a new note when all 15 channels "
+        "are busy. If stealing is off, the new note is not played.");
+    addAndMakeVisible(voiceStealingMPELabel.get());
+
+    voiceStealingMPECombo = std::make_unique<juce::ComboBox>();
+    voiceStealingMPECombo->addItemList(Parameters::getVoiceStealingMPENames(), 1);
+    voiceStealingMPECombo->setSelectedId(static_cast<int>(params.voiceStealingMPE.load()));
+    voiceStealingMPELabel->attachToComponent(voiceStealingMPECombo.get(), true);
+    voiceStealingMPECombo->onChange = [this, &params]() {
+        params.voiceStealingMPE.store(
+            static_cast<Parameters::VoiceStealingMPE>(voiceStealingMPECombo->getSelectedId()));
+    };
+    addAndMakeVisible(voiceStealingMPECombo.get());
+
+    // ============= MTS-ESP TUNING MODE SETTINGS =============
+    mtsSettingsHeader = std::make_unique<juce::Label>();
+    mtsSettingsHeader->setFont(headerFont);
+    mtsSettingsHeader->setText("MTS-ESP Tuning Mode Settings", juce::dontSendNotification);
+    mtsSettingsHeader->setColour(juce::Label::backgroundColourId, params.theme.darkest);
+    addAndMakeVisible(mtsSettingsHeader.get());
+
+    bendControlRateMTSLabel = std::make_unique<juce::Label>();
+    bendControlRateMTSLabel->setFont(settingFont);
+    bendControlRateMTSLabel->setText("Note bend control rate:", juce::dontSendNotification);
+    bendControlRateMTSLabel->setTooltip(
+        "How often tuning of bending notes is updated. Lower values give smoother bends, but all "
+        "MTS-ESP clients have to retune more often.");
+    addAndMakeVisible(bendControlRateMTSLabel.get());
+
+    bendControlRateMTSCombo = std::make_unique<juce::ComboBox>();
+    bendControlRateMTSCombo->addItem("Every block", 1);
+    for (int rate = 256; rate <= 4096; rate *= 2) {
+        bendControlRateMTSCombo->addItem("Every " + juce::String(rate) + " samples", rate);
+    }
+    bendControlRateMTSCombo->setSelectedId(params.bendControlRateMTS);
+    bendControlRateMTSLabel->attachToComponent(bendControlRateMTSCombo.get(), true);
+    bendControlRateMTSCombo->onChange = [this, &params]() {
+        params.bendControlRateMTS = bendControlRateMTSCombo->getSelectedId();
+    };
+    addAndMakeVisible(bendControlRateMTSCombo.get());
+
+    numChannelsMTSLabel = std::make_unique<juce::Label>();
+    numChannelsMTSLabel->setFont(settingFont);
+    numChannelsMTSLabel->setText("MIDI channels per instance:", juce::dontSendNotification);
+    numChannelsMTSLabel->setTooltip(
+        "Each MIDI channel gives 128 different pitches. With more channels the instance can use "
+        "more pitches, but takes up free channels of other instances. The synth must support "
+        "multi-channel MTS-ESP tuning.");
+    addAndMakeVisible(numChannelsMTSLabel.get());
+
+    numChannelsMTSCombo = std::make_unique<juce::ComboBox>();
+    for (int num = 1; num <= PluginInstanceManager::maxChannels; ++num) {
+        numChannelsMTSCombo->addItem(juce::String(num) + " (" + juce::String(128 * num) +
+                                         " pitches)",
+                                     num);
+    }
+    numChannelsMTSCombo->setSelectedId(params.numChannelsMTS);
+    numChannelsMTSLabel->attachToComponent(numChannelsMTSCombo.get(), true);
+    numChannelsMTSCombo->onChange = [this, &params, &editor]() {
+        params.numChannelsMTS = numChannelsMTSCombo->getSelectedId();
+        editor.changedNumChannelsMTS();
+    };
+    addAndMakeVisible(numChannelsMTSCombo.get());
 }
 
 void SettingsPanel::resized() {
@@ -282,6 +395,10 @@ void SettingsPanel::resized() {
 
     auto horZoomRow = area.removeFromTop(rowHeight);
     horZoomOnCursorCheckbox->setBounds(horZoomRow.withTrimmedLeft(labelWidth));
+    area.removeFromTop(padding);
+
+    auto midiInputRow = area.removeFromTop(rowHeight);
+    midiInputMappingCombo->setBounds(midiInputRow.withTrimmedLeft(labelWidth));
     area.removeFromTop(padding + sectionSpacing);
 
     // --- Visual Settings ---
@@ -320,15 +437,38 @@ void SettingsPanel::resized() {
 
     auto chEconMPERow = area.removeFromTop(rowHeight);
     channelsEconomyModeMPECheckbox->setBounds(chEconMPERow.withTrimmedLeft(labelWidth));
+    area.removeFromTop(padding);
+
+    auto bendRateMPERow = area.removeFromTop(rowHeight);
+    bendControlRateMPECombo->setBounds(bendRateMPERow.withTrimmedLeft(labelWidth));
+    area.removeFromTop(padding);
+
+    auto voiceStealingMPERow = area.removeFromTop(rowHeight);
+    voiceStealingMPECombo->setBounds(voiceStealingMPERow.withTrimmedLeft(labelWidth));
+    area.removeFromTop(padding + sectionSpacing);
+
+    // --- MTS-ESP Tuning Mode Settings ---
+    auto mtsHeaderRow = area.removeFromTop(headerRowHeight);
+    mtsSettingsHeader->setBounds(mtsHeaderRow.withTrimmedRight(areaWidth - labelWidth));
+    area.removeFromTop(padding);
+
+    auto bendRateMTSRow = area.removeFromTop(rowHeight);
+    bendControlRateMTSCombo->setBounds(bendRateMTSRow.withTrimmedLeft(labelWidth));
+    area.removeFromTop(padding);
+
+    auto numChannelsMTSRow = area.removeFromTop(rowHeight);
+    numChannelsMTSCombo->setBounds(numChannelsMTSRow.withTrimmedLeft(labelWidth));
 }
 
 int SettingsPanel::getRequiredHeight() const {
     return padding + // top padding
-           headerRowHeight + padding + 5 * (rowHeight + padding) +
+           headerRowHeight + padding + 6 * (rowHeight + padding) +
            sectionSpacing + // Basic Settings
            headerRowHeight + padding + 4 * (rowHeight + padding) +
-           sectionSpacing +                                       // Visual Settings
-           headerRowHeight + padding + 3 * (rowHeight + padding); // MPE Tuning Mode Settings
+           sectionSpacing + // Visual Settings
+           headerRowHeight + padding + 5 * (rowHeight + padding) +
+           sectionSpacing +                                       // MPE Tuning Mode Settings
+           headerRowHeight + padding + 2 * (rowHeight + padding); // MTS-ESP Tuning Mode Settings
 }
 
 void SettingsPanel::paint(juce::Graphics &g) { g.fillAll(params.theme.darker); }
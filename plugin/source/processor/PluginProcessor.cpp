@@ -1,8 +1,10 @@
 #include "XenRoll/processor/PluginProcessor.h"
 #include "XenRoll/common/Helpers.h"
+#include "XenRoll/common/RealtimeChecker.h"
 #include "XenRoll/editor/PluginEditor.h"
 #include "XenRoll/processor/audio/dsp/PitchDetectorMPM.h"
 #include <algorithm>
+#include <limits>
 
 namespace audio_plugin {
 AudioPluginAudioProcessor::AudioPluginAudioProcessor()
@@ -14,72 +16,127 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                          .withOutput("Output", juce::AudioChannelSet::stereo(), true)
 #endif
                          ),
-      manPlNotesTotCentsHistory(128), params() {
+      params() {
     setLatencySamples(0);
 
     // INSTANCES SYNC (params.getTuningType() IS DEFAULT HERE, BECAUSE IT ONLY WILL
     //                 BE READ IN setStateInformation)
+    // (MANAGERS ARE INITIALIZED ASYNCHRONOUSLY, SEE handleAsyncUpdate())
     if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
-        pluginInstanceManager = std::make_unique<PluginInstanceManager>();
-        isActive = pluginInstanceManager->getIsActive();
-        params.channelIndex = pluginInstanceManager->getChannelIndex();
+        pluginInstanceManager =
+            std::make_unique<PluginInstanceManager>([this]() { triggerAsyncUpdate(); });
+        isActive = false;
+        params.channelIndex = -1;
     } else if (params.getTuningType() == Parameters::TuningType::MPE) {
-        notesSharingMPE = std::make_unique<NotesSharingMPE>(params.instanceId);
-        isActive = notesSharingMPE->getIsActive();
-        params.instanceId = notesSharingMPE->getInstanceId();
+        notesSharingMPE = std::make_unique<NotesSharingMPE>(params.instanceId,
+                                                            [this]() { triggerAsyncUpdate(); });
+        // Notes are played locally while notes sharing isn't ready
+        isActive = true;
+        params.instanceId = -1;
+    } else if (params.getTuningType() == Parameters::TuningType::MTS_SYSEX) {
+        // Nothing is shared between instances, notes are played in midi channel 1
+        isActive = true;
+        params.channelIndex = 0;
     }
 
     // For MPE use only:
     channelsManagerMPE = std::make_unique<ChannelsManagerMPE>(params.channelsEconomyModeMPE);
 
-    // PARTIALS FINDING
-    threadPool = std::make_unique<juce::ThreadPool>(1);
-    partialsFinder = std::make_shared<PartialsFinder>();
+    // PARTIALS FINDING (partials finder itself is created when the mode is turned on)
     wasPianoRoll = !params.findPartialsMode.load();
     for (int i = 0; i < 128; ++i) {
         freqs12EDO[i] = getFreqFromTotalCents(i * 100.0f);
     }
-    partialsFinderBuffer = std::make_unique<AccumulatingBuffer>();
 
-    // VOCAL TO MELODY
-    pitchDetector = std::make_unique<PitchDetectorMPM>(vocalFFTSize);
-    vocalAccumBuffer.resize(vocalFFTSize);
-    vocalAccumCount = 0;
+    // VOCAL TO MELODY (pitch detector is created when recording starts)
+    resetVocalRing();
 
     std::fill(std::begin(beforeBendTotalCents), std::end(beforeBendTotalCents), -1);
+
+    // RECORDING OF PLAYED NOTES (audio thread only appends to the take)
+    recordedTake.reserve(maxRecordedNotes);
+
+    // MIDI INPUT
+    midiInputMapCopy.fill(-1);
+    updateMidiInputMap();
 }
 
-AudioPluginAudioProcessor::~AudioPluginAudioProcessor() {}
+AudioPluginAudioProcessor::~AudioPluginAudioProcessor() { stopVocalAnalysisThread(); }
 
 void AudioPluginAudioProcessor::changeInstanceSync(Parameters::TuningType newTuningType) {
     // 1. Make processBlock not execute
     std::scoped_lock lock(changeInstanceSyncMutex);
 
-    // 2. Prepare new manager
+    // 2. Prepare new manager (it isn't waited for, handleAsyncUpdate() is called when it's ready)
+    instanceSyncFailed = false;
     if (newTuningType == Parameters::TuningType::MTS_ESP) {
-        pluginInstanceManager = std::make_unique<PluginInstanceManager>();
-        isActive = pluginInstanceManager->getIsActive();
-        params.channelIndex = pluginInstanceManager->getChannelIndex();
+        pluginInstanceManager =
+            std::make_unique<PluginInstanceManager>([this]() { triggerAsyncUpdate(); });
+        isActive = false;
+        params.channelIndex = -1;
     } else if (newTuningType == Parameters::TuningType::MPE) {
-        notesSharingMPE = std::make_unique<NotesSharingMPE>(params.instanceId);
-        isActive = notesSharingMPE->getIsActive();
-        params.instanceId = notesSharingMPE->getInstanceId();
+        notesSharingMPE = std::make_unique<NotesSharingMPE>(params.instanceId,
+                                                            [this]() { triggerAsyncUpdate(); });
+        isActive = true;
+        params.instanceId = -1;
+    } else if (newTuningType == Parameters::TuningType::MTS_SYSEX) {
+        isActive = true;
+        params.channelIndex = 0;
     }
 
-    // 3. Managers are ready, so now can set new tuning type
+    // 3. Managers are created (their init goes on), so now can set new tuning type
     params.setTuningType(newTuningType);
     params.applyGlobalTuningType();
+    if (newTuningType != Parameters::TuningType::MPE) {
+        std::scoped_lock lock(prepareNotesMutex);
+        // MTS_SYSEX has only one channel (there is no pluginInstanceManager)
+        if (newTuningType == Parameters::TuningType::MTS_SYSEX) {
+            pluginInstanceManager.reset();
+        }
+        applyNumChannelsMTS();
+        sentFreqsSysEx.fill(0.0);
+        freqsChangedMTS = true;
+    }
 
     // 4. Clean up the manager that's no longer needed (opposite of newTuningType)
-    if (newTuningType == Parameters::TuningType::MTS_ESP) {
+    if (newTuningType != Parameters::TuningType::MPE) {
         notesSharingMPE.reset();
         params.instanceId = -1;
-    } else if (newTuningType == Parameters::TuningType::MPE) {
+    } else {
         pluginInstanceManager.reset();
         params.channelIndex = -1;
     }
 }
 
+void AudioPluginAudioProcessor::handleAsyncUpdate() {
+    std::scoped_lock lock(changeInstanceSyncMutex);
+    // Piano roll mode right after partials finding mode (see processBlock())
+    if (needPrepareNotes.exchange(false)) {
+        prepareNotes();
+    }
+    // Notes were prepared and changed without the manager, so they are prepared and shared again
+    if (params.getTuningType() == Parameters::TuningType::MTS_ESP &&
+        pluginInstanceManager != nullptr && pluginInstanceManager->getIsInitDone()) {
+        {
+            // Audio thread publishes freqs to our channels under the same lock
+            std::scoped_lock lock(prepareNotesMutex);
+            pluginInstanceManager->applyPendingChannelIndex();
+            params.channelIndex = pluginInstanceManager->getChannelIndex();
+            applyNumChannelsMTS();
+        }
+        isActive = pluginInstanceManager->getIsActive();
+        instanceSyncFailed = !isActive;
+        prepareNotes();
+        pluginInstanceManager->updateNotes(getNotesSnapshot()->getNotes());
+    } else if (params.getTuningType() == Parameters::TuningType::MPE &&
+               notesSharingMPE != nullptr && notesSharingMPE->getIsInitDone()) {
+        params.instanceId = notesSharingMPE->getInstanceId();
+        instanceSyncFailed = !notesSharingMPE->getIsActive();
+        notesSharingMPE->updateNotes(getNotesSnapshot()->getNotes());
+    }
+    // Otherwise manager was changed before it's init was done, new one triggers this again
+}
+
 const juce::String AudioPluginAudioProcessor::getName() const {
     return "XenRoll"; // JucePlugin_Name;
 }
@@ -133,11 +190,25 @@ void AudioPluginAudioProcessor::prepareToPlay(double sampleRate, int samplesPerB
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     juce::ignoreUnused(samplesPerBlock);
+
+    // Synth may have been reset, so all tuning is sent again (MTS_SYSEX)
+    std::scoped_lock lock(prepareNotesMutex);
+    sentFreqsSysEx.fill(0.0);
+    freqsChangedMTS = true;
+    for (juce::MidiBuffer &sysExMidiBuffer : sysExMidiBuffers) {
+        sysExMidiBuffer.ensureSize(sysExMidiBufferSize);
+    }
 }
 
 void AudioPluginAudioProcessor::releaseResources() {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+#if XENROLL_REALTIME_CHECKS
+    juce::Logger::writeToLog(RealtimeChecker::getReport());
+#endif
+#if XENROLL_FOOTPRINT_REPORT
+    juce::Logger::writeToLog(getFootprintReport());
+#endif
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const {
@@ -163,21 +234,76 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported(const BusesLayout &layout
 #endif
 }
 
-int AudioPluginAudioProcessor::findFreqInd(double freq) {
-    for (int i = 0; i < 128; ++i) {
-        if (std::abs(freqs[i] - freq) < 1e-6) {
-            return i;
+int AudioPluginAudioProcessor::findFreqInd(double freq) { return freqSlotsManagerMTS.find(freq); }
+
+juce::String AudioPluginAudioProcessor::getFootprintReport() {
+    auto toKB = [](size_t bytes) { return juce::String(static_cast<int>((bytes + 1023) / 1024)); };
+    auto line = [&](const juce::String &name, bool isAllocated, size_t bytes) {
+        return "  " + name + ": " + (isAllocated ? toKB(bytes) + " KB" : "not allocated") + "\n";
+    };
+
+    // Subsystems are created and released on the message thread only, so no lock is needed
+    const size_t pitchDetectorBytes = pitchDetector ? pitchDetector->getMemoryUsage() : 0;
+    const size_t vocalBufferBytes = vocalRingBuffer.capacity() * sizeof(float);
+    const size_t vocalQueueBytes = vocalChunks ? sizeof(*vocalChunks) : 0;
+    const size_t partialsFinderBytes = partialsFinder ? partialsFinder->getMemoryUsage() : 0;
+    const size_t partialsBufferBytes =
+        partialsFinderBuffer ? partialsFinderBuffer->getMemoryUsage() : 0;
+    const int numThreads = threadPool ? threadPool->getNumThreads() : 0;
+    const size_t totalBytes = pitchDetectorBytes + vocalBufferBytes + vocalQueueBytes +
+                              partialsFinderBytes + partialsBufferBytes;
+
+    return juce::String("XenRoll instance footprint:\n") +
+           line("pitch detector", pitchDetector != nullptr, pitchDetectorBytes) +
+           line("vocal buffer", vocalRingBuffer.capacity() > 0, vocalBufferBytes) +
+           line("vocal input queue", vocalChunks != nullptr, vocalQueueBytes) +
+           "  vocal analysis thread: " +
+           (vocalAnalysisThread.joinable() ? "running" : "not running") + "\n" +
+           line("partials finder", partialsFinder != nullptr, partialsFinderBytes) +
+           line("partials finder buffer", partialsFinderBuffer != nullptr, partialsBufferBytes) +
+           "  partials finder threads: " + juce::String(numThreads) + "\n" +
+           "  total: " + toKB(totalBytes) + " KB\n";
+}
+
+void AudioPluginAudioProcessor::setFindPartialsMode(bool newFindPartialsMode) {
+    // Heavy objects are created and destroyed here, not on the audio thread
+    std::unique_ptr<AccumulatingBuffer> newPartialsFinderBuffer;
+    std::shared_ptr<PartialsFinder> newPartialsFinder;
+    if (newFindPartialsMode && !partialsFinder) {
+        newPartialsFinderBuffer = std::make_unique<AccumulatingBuffer>();
+        newPartialsFinder = std::make_shared<PartialsFinder>();
+        if (!threadPool) {
+            threadPool = std::make_unique<juce::ThreadPool>(1);
+        }
+    }
+    {
+        // processBlock() doesn't execute while they are swapped
+        std::scoped_lock lock(changeInstanceSyncMutex);
+        if (newFindPartialsMode == (partialsFinder != nullptr)) {
+            params.findPartialsMode = newFindPartialsMode;
+            return;
         }
+        std::swap(partialsFinderBuffer, newPartialsFinderBuffer);
+        std::swap(partialsFinder, newPartialsFinder);
+        params.findPartialsMode = newFindPartialsMode;
+    }
+    // Turned off: jobs that are still queued or running aren't waited for, they keep their
+    //   PartialsFinder and their results are dropped
+    if (!newFindPartialsMode) {
+        ++partialsGeneration;
     }
-    return -1;
 }
 
 void AudioPluginAudioProcessor::startPartialsFinding() {
     threadPool->addJob([buf = partialsFinderBuffer->extractAndClear(), rmn = recordingMidiNote,
-                        pf = partialsFinder, pars = &params,
+                        pf = partialsFinder, pars = &params, gen = &partialsGeneration,
+                        startGen = partialsGeneration.load(),
                         strat = params.findPartialsStrat.load(),
                         fftSize = params.findPartialsFFTSize.load(),
                         dbThr = params.findPartialsdBThreshold.load(), sr = getSampleRate()] {
+        if (gen->load() != startGen) {
+            return;
+        }
         if (sr != 0) {
             pf->setSampleRate_(sr);
         }
@@ -186,7 +312,7 @@ void AudioPluginAudioProcessor::startPartialsFinding() {
         pf->setdBThr(dbThr);
         auto partials = pf->findPartials(buf);
         // DON'T ADD EMPTY PARTIALS, THIS IS BAD RESULT!
-        if (!partials.empty()) {
+        if (!partials.empty() && gen->load() == startGen) {
             pars->add_partials(rmn * 100, partials);
         }
     });
@@ -234,7 +360,13 @@ void AudioPluginAudioProcessor::fixateRecordingNote() {
 
     if (currentNote.duration >= params.vocalToMelodyMinNoteDuration) {
         if (params.vocalToMelodyKeySnap) {
-            if (!trySnapNote(currentNote, keys)) {
+            // Keys can be updated from UI while analysis thread snaps
+            bool isSnapped = false;
+            {
+                std::scoped_lock lock(keysMutex);
+                isSnapped = trySnapNote(currentNote, keys);
+            }
+            if (!isSnapped) {
                 trySnapNote(currentNote, recKeys);
             }
         } else {
@@ -279,7 +411,7 @@ int AudioPluginAudioProcessor::freqToTotalCents(float freq) {
     // A4 = 440 Hz is at octave 4, 900 cents (MIDI note 69)
     // totalCents = 4 * 1200 + 900 = 5700
     const int A4TotalCents = 4 * 1200 + 900;
-    double cents = 1200.0 * std::log2(freq / params.A4Freq.load());
+    double cents = ratioToCents(freq / params.A4Freq.load());
     return juce::roundToInt(A4TotalCents + cents);
 }
 
@@ -298,21 +430,81 @@ void AudioPluginAudioProcessor::vocalIsSilent() {
     }
 }
 
-void AudioPluginAudioProcessor::processVocalInput(const juce::AudioBuffer<float> &buffer,
-                                                  int numSamples, double sampleRate) {
-    if (!pitchDetector) {
+void AudioPluginAudioProcessor::pushVocalInput(const juce::AudioBuffer<float> &buffer,
+                                               int numSamples, double sampleRate,
+                                               double blockStartTime, double samplesPerBar) {
+    if (!vocalChunks) {
         return;
     }
 
     // Apply mic gain
-    float gainLinear = GlobalSettings::getInstance().getMicGainLinear();
+    const float gainLinear = GlobalSettings::getInstance().getMicGainLinear();
     const float *channelData = buffer.getReadPointer(0);
 
+    VocalChunk chunk;
+    chunk.samplesPerBar = samplesPerBar;
+    chunk.sampleRate = sampleRate;
+    for (int offset = 0; offset < numSamples; offset += VocalChunk::maxNumSamples) {
+        chunk.time = blockStartTime + offset / samplesPerBar;
+        chunk.numSamples = std::min(numSamples - offset, VocalChunk::maxNumSamples);
+        juce::FloatVectorOperations::copyWithMultiply(chunk.samples.data(), channelData + offset,
+                                                      gainLinear, chunk.numSamples);
+        pushVocalChunk(chunk);
+    }
+}
+
+void AudioPluginAudioProcessor::pushVocalChunk(const VocalChunk &chunk) {
+    if (!isVocalChunkDropped) {
+        isVocalChunkDropped = !vocalChunks->push(chunk);
+        return;
+    }
+    // Analysis thread has to know that input isn't continuous (it ends current note)
+    VocalChunk chunkAfterGap = chunk;
+    chunkAfterGap.isAfterGap = true;
+    isVocalChunkDropped = !vocalChunks->push(chunkAfterGap);
+}
+
+void AudioPluginAudioProcessor::runVocalAnalysis() {
+    VocalChunk chunk;
+    while (true) {
+        // Chunks that were pushed before stop are still processed
+        const bool isStopping = stopVocalAnalysis.load();
+        while (vocalChunks->pop(chunk)) {
+            processVocalChunk(chunk);
+        }
+        if (isStopping) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(vocalAnalysisPollTimeMs));
+    }
+}
+
+void AudioPluginAudioProcessor::stopVocalAnalysisThread() {
+    if (vocalAnalysisThread.joinable()) {
+        stopVocalAnalysis = true;
+        vocalAnalysisThread.join();
+    }
+    stopVocalAnalysis = false;
+}
+
+void AudioPluginAudioProcessor::processVocalChunk(const VocalChunk &chunk) {
+    if (chunk.type == VocalChunk::PlaybackStopped) {
+        vocalPlaybackStopped();
+        return;
+    }
+    if (chunk.isAfterGap) {
+        // Some input is lost, so current note can't be continued
+        vocalPlaybackStopped();
+    }
+
+    const int numSamples = chunk.numSamples;
+    const float *channelData = chunk.samples.data();
+    const double samplesPerBar = chunk.samplesPerBar;
+
     // Calculate current volume for visualization
     float sumSquares = 0.0f;
     for (int i = 0; i < numSamples; ++i) {
-        float sample = channelData[i] * gainLinear;
-        sumSquares += sample * sample;
+        sumSquares += channelData[i] * channelData[i];
     }
     float rms = std::sqrt(sumSquares / numSamples);
     float volume_dB = juce::Decibels::gainToDecibels(rms + 1e-10f);
@@ -320,31 +512,43 @@ void AudioPluginAudioProcessor::processVocalInput(const juce::AudioBuffer<float>
 
     // Check if signal is too weak to be valid
     if (volume_dB <= params.minVocalVolume_dB) {
+        pitchTime = chunk.time - vocalFFTSize / samplesPerBar;
         vocalIsSilent();
-        vocalAccumCount = 0;
+        resetVocalRing();
         return;
     }
 
-    int samplesProcessed = 0;
+    const int hopSize = juce::jlimit(
+        1, vocalFFTSize,
+        juce::roundToInt(params.vocalToMelodyHopMs * chunk.sampleRate / 1000.0));
     int inputOffset = 0;
 
-    while (samplesProcessed < numSamples) {
-        int spaceAvailable = vocalFFTSize - vocalAccumCount;
-        int samplesToCopy = std::min(numSamples - samplesProcessed, spaceAvailable);
-
-        for (int i = 0; i < samplesToCopy; ++i) {
-            vocalAccumBuffer[vocalAccumCount + i] = channelData[inputOffset + i] * gainLinear;
+    while (inputOffset < numSamples) {
+        // Copy until the end of the input, the end of the ring or the next analysis
+        int samplesToCopy = std::min(numSamples - inputOffset, vocalFFTSize - vocalRingWritePos);
+        if (vocalRingCount >= vocalFFTSize) {
+            samplesToCopy = std::min(samplesToCopy, hopSize - vocalSamplesSinceAnalysis);
         }
+        samplesToCopy = std::max(samplesToCopy, 1);
+
+        std::copy(channelData + inputOffset, channelData + inputOffset + samplesToCopy,
+                  vocalRingBuffer.data() + vocalRingWritePos);
 
-        vocalAccumCount += samplesToCopy;
-        samplesProcessed += samplesToCopy;
+        vocalRingWritePos = (vocalRingWritePos + samplesToCopy) % vocalFFTSize;
+        vocalRingCount = std::min(vocalRingCount + samplesToCopy, vocalFFTSize);
+        vocalSamplesSinceAnalysis += samplesToCopy;
         inputOffset += samplesToCopy;
 
-        // When we have enough samples for FFT, perform analysis
-        if (vocalAccumCount >= vocalFFTSize) {
-            // Analyze pitch from the accumulated buffer using MPM
-            float detectedFreq = pitchDetector->detectPitch(vocalAccumBuffer, sampleRate,
-                                                            currentVocalTotalCents == -1);
+        // When the ring is full and a hop has passed, perform analysis
+        if (vocalRingCount >= vocalFFTSize && vocalSamplesSinceAnalysis >= hopSize) {
+            vocalSamplesSinceAnalysis = 0;
+            pitchTime = chunk.time + (inputOffset - vocalFFTSize) / samplesPerBar;
+
+            // Analyze pitch from the ring using MPM: oldest samples start at vocalRingWritePos
+            float detectedFreq = pitchDetector->detectPitch(
+                vocalRingBuffer.data() + vocalRingWritePos, vocalFFTSize - vocalRingWritePos,
+                vocalRingBuffer.data(), vocalRingWritePos, chunk.sampleRate,
+                currentVocalTotalCents == -1);
 
             if (detectedFreq > 0.0f) {
                 int newTotalCents = freqToTotalCents(detectedFreq);
@@ -366,21 +570,35 @@ void AudioPluginAudioProcessor::processVocalInput(const juce::AudioBuffer<float>
             } else {
                 vocalIsSilent();
             }
+        }
+    }
+}
 
-            // Shifting the buffer with overlap (hop size = numSamples for uniformity)
-            int hopSize = numSamples;
-            int samplesToKeep = vocalFFTSize - hopSize;
-
-            if (samplesToKeep > 0) {
-                // We leave the overlapping samples for the next analysis.
-                std::copy(vocalAccumBuffer.begin() + hopSize,
-                          vocalAccumBuffer.begin() + vocalFFTSize, vocalAccumBuffer.begin());
-                vocalAccumCount = samplesToKeep;
-            } else {
-                vocalAccumCount = 0;
-            }
+void AudioPluginAudioProcessor::vocalPlaybackStopped() {
+    if (isRecNote) {
+        {
+            std::scoped_lock lock(recNoteMutex);
+            pitchTime = recNote.time + recNote.duration;
         }
+        fixateRecordingNote();
+
+        // Add gap to pitch curve
+        std::scoped_lock lock(pitchCurveMutex);
+        pitchCurve.first.push_back(pitchTime + 1e-4);
+        pitchCurve.second.push_back(-1);
     }
+
+    // Reset ring buffer
+    resetVocalRing();
+
+    // Reset pitch detector
+    pitchDetector->reset();
+}
+
+void AudioPluginAudioProcessor::resetVocalRing() {
+    vocalRingWritePos = 0;
+    vocalRingCount = 0;
+    vocalSamplesSinceAnalysis = 0;
 }
 
 void AudioPluginAudioProcessor::updateRecordingNote() {
@@ -466,6 +684,23 @@ void AudioPluginAudioProcessor::updateRecordingNote() {
 }
 
 void AudioPluginAudioProcessor::startRecordingVocal() {
+    // Analysis thread is restarted after the state is reset
+    stopVocalAnalysisThread();
+    if (!pitchDetector) {
+        pitchDetector = std::make_unique<PitchDetectorMPM>(vocalFFTSize);
+        pitchDetector->setAnalysisMode(vocalAnalysisMode);
+        vocalRingBuffer.assign(vocalFFTSize, 0.0f);
+    }
+    // Analysis thread prepares it again only if sample rate changes while recording
+    pitchDetector->prepare(getSampleRate());
+    if (!vocalChunks) {
+        auto newVocalChunks = std::make_unique<SpscQueue<VocalChunk, 256>>();
+        // processBlock() doesn't execute while it's swapped
+        std::scoped_lock lock(changeInstanceSyncMutex);
+        vocalChunks = std::move(newVocalChunks);
+        isVocalChunkDropped = false;
+    }
+
     // Clear previously recorded notes
     {
         std::scoped_lock lock(recNotesVecMutex);
@@ -492,10 +727,10 @@ void AudioPluginAudioProcessor::startRecordingVocal() {
     noteMaxPitchTime = 0.0f;
     noteMinPitchTime = 0.0f;
 
-    // Reset accumulation buffer
-    vocalAccumCount = 0;
+    // Reset ring buffer
+    resetVocalRing();
     // this fill is not necessary but why not lol
-    std::fill(vocalAccumBuffer.begin(), vocalAccumBuffer.end(), 0.0f);
+    std::fill(vocalRingBuffer.begin(), vocalRingBuffer.end(), 0.0f);
 
     // Pre-allocate to avoid real-time allocations during recording
     recNotesVec.reserve(1024);
@@ -506,23 +741,35 @@ void AudioPluginAudioProcessor::startRecordingVocal() {
     }
 
     // Reset pitch detector
-    if (pitchDetector) {
-        pitchDetector->reset();
-    }
+    pitchDetector->reset();
 
+    vocalAnalysisThread = std::thread(&AudioPluginAudioProcessor::runVocalAnalysis, this);
     params.vocalToMelody = true;
 }
 
 void AudioPluginAudioProcessor::stopRecordingVocal() {
+    // Input that is already pushed is analysed before the current note is fixated
+    params.vocalToMelody = false;
+    stopVocalAnalysisThread();
     if (isRecNote) {
         fixateRecordingNote();
     }
 
-    params.vocalToMelody = false;
     currentVocalTotalCents = -1;
     recNoteStartTotalCents = -1;
     recNoteMinTotalCents = -1;
     recNoteMaxTotalCents = -1;
+
+    // Pitch detector isn't needed until the next recording, only the queue is used by
+    //   processBlock(), so it's the only thing that is swapped under the lock
+    pitchDetector.reset();
+    std::vector<float>().swap(vocalRingBuffer);
+    resetVocalRing();
+    std::unique_ptr<SpscQueue<VocalChunk, 256>> oldVocalChunks;
+    {
+        std::scoped_lock lock(changeInstanceSyncMutex);
+        oldVocalChunks = std::move(vocalChunks);
+    }
 }
 
 // ============================================================================================
@@ -531,6 +778,7 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
                                              juce::MidiBuffer &midiMessages) {
     if (!isActive)
         return;
+    XENROLL_REALTIME_SCOPE();
 
     std::unique_lock lock(changeInstanceSyncMutex, std::try_to_lock);
     if (!lock.owns_lock()) {
@@ -556,8 +804,19 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
     if (params.findPartialsMode.load()) {
         // If previously was in piano roll mode
         if (wasPianoRoll) {
-            if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
-                pluginInstanceManager->updateFreqs(freqs12EDO);
+            if (params.getTuningType() != Parameters::TuningType::MPE) {
+                // Audio thread is the only writer of tuning (under prepareNotesMutex). If notes
+                //   are being prepared now, 12-EDO is published in the next block
+                std::unique_lock prepareLock(prepareNotesMutex, std::try_to_lock);
+                if (!prepareLock.owns_lock()) {
+                    return;
+                }
+                if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
+                    pluginInstanceManager->updateFreqs(freqs12EDO);
+                } else {
+                    freqsChangedMTS = true;
+                    sendFreqsSysEx(freqs12EDO, midiMessages);
+                }
             }
             partialsFinderBuffer->clear();
             activeMidiNotes.fill(false); // just in case
@@ -594,16 +853,19 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
 
         return;
     } else {
-        // If piano roll mode right after partials finding mode
+        // If piano roll mode right after partials finding mode. Notes (and their tuning) are
+        //   prepared again on the message thread (see handleAsyncUpdate())
         if (!wasPianoRoll) {
-            prepareNotes();
+            needPrepareNotes = true;
+            triggerAsyncUpdate();
             wasPianoRoll = true;
         }
     }
     // ========================================================================
 
     juce::ScopedNoDenormals noDenormals;
-    midiMessages.clear(); // Clear incoming MIDI
+    collectLiveInputEvents(midiMessages);
+    midiMessages.clear(); // Clear incoming MIDI (notes are replayed from liveInputEvents)
 
     int numSamples = buffer.getNumSamples();
     double sampleRate = getSampleRate();
@@ -626,640 +888,762 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
             double barsInBlock = beatsInBlock / beatsPerBar;
             bool isPlaying = positionInfo->getIsPlaying();
 
+            // Loop, seek or time signature change: voices of the old position are released and
+            //   notes of the new position are chased
+            const bool playheadJumped =
+                playheadTracker.update(playHeadTime, barsInBlock, isPlaying);
+            if (playheadJumped) {
+                blockScheduler.reset();
+                preNoteOnCursor.reset();
+            }
+            // If the loop end is inside the block, notes after it aren't played (the next block
+            //   starts at the loop start)
+            double barsToSchedule = barsInBlock;
+            if (positionInfo->getIsLooping()) {
+                auto loopPoints = positionInfo->getLoopPoints();
+                if (loopPoints) {
+                    const double loopEnd = loopPoints->ppqEnd / beatsPerBar;
+                    if (playHeadTime < loopEnd && loopEnd < playHeadTime + barsInBlock) {
+                        barsToSchedule = loopEnd - playHeadTime;
+                    }
+                }
+            }
+            updateRecording(playHeadTime, barsInBlock, barsToSchedule, numSamples, isPlaying,
+                            playheadJumped);
+            numDeferredLiveInputEvents = 0;
+
             // ============================= VOCAL TO MELODY ============================
-            if (params.vocalToMelody) {
+            // Only input is sent here, it's analysed on vocalAnalysisThread
+            if (params.vocalToMelody && vocalChunks) {
                 if (isPlaying) {
-                    pitchTime = playHeadTime - vocalFFTSize / samplesPerBeat / beatsPerBar;
-                    processVocalInput(buffer, numSamples, sampleRate);
+                    pushVocalInput(buffer, numSamples, sampleRate, playHeadTime,
+                                   samplesPerBeat * beatsPerBar);
                 } else if (wasPlaying) {
-                    if (isRecNote) {
-                        {
-                            std::scoped_lock lock(recNoteMutex);
-                            pitchTime = recNote.time + recNote.duration;
-                        }
-                        fixateRecordingNote();
+                    VocalChunk stopChunk;
+                    stopChunk.type = VocalChunk::PlaybackStopped;
+                    pushVocalChunk(stopChunk);
+                }
+            }
+            // ==========================================================================
 
-                        // Add gap to pitch curve
-                        std::scoped_lock lock(pitchCurveMutex);
-                        pitchCurve.first.push_back(pitchTime + 1e-4);
-                        pitchCurve.second.push_back(-1);
-                    }
+            const PlaybackBlock block{barsInBlock, barsToSchedule, numSamples,
+                                      sampleRate,  isPlaying,      playheadJumped};
+            // Tuning type is checked once per block, backends are specialised at compile time
+            switch (params.getTuningType()) {
+            case Parameters::MPE:
+                playBlock<Parameters::MPE>(block, midiMessages);
+                break;
+            case Parameters::MTS_ESP:
+                playBlock<Parameters::MTS_ESP>(block, midiMessages);
+                break;
+            case Parameters::MTS_SYSEX:
+                playBlock<Parameters::MTS_SYSEX>(block, midiMessages);
+                break;
+            }
+        }
+    }
 
-                    // Reset accumulation buffer
-                    vocalAccumCount = 0;
+    buffer.clear();
+}
 
-                    // Reset pitch detector
-                    if (pitchDetector) {
-                        pitchDetector->reset();
-                    }
+template <>
+void AudioPluginAudioProcessor::playBlock<Parameters::MPE>(const PlaybackBlock &block,
+                                                           juce::MidiBuffer &midiMessages) {
+    const double barsInBlock = block.barsInBlock;
+    const double barsToSchedule = block.barsToSchedule;
+    const int numSamples = block.numSamples;
+    const double sampleRate = block.sampleRate;
+    const bool isPlaying = block.isPlaying;
+    const bool playheadJumped = block.playheadJumped;
+
+    // Taking into account A4 freq (default is 440 Hz)
+    pitchBendMPE.update(params.semiBendRangeMPE, params.A4Freq);
+    channelsManagerMPE->setVoiceStealing(params.voiceStealingMPE);
+
+    // Manually played notes (events from the editor, in order)
+    {
+        ManualNoteEvent event;
+        int sample;
+        while (popManualNoteEvent(event, sample, numSamples, sampleRate)) {
+            auto it = manPlNoteToChAndMidiNoteMPE.find(event.totalCents);
+            if (!event.isNoteOn) {
+                if (it != manPlNoteToChAndMidiNoteMPE.end()) {
+                    stopLiveVoiceMPE(it->second, midiMessages, sample);
+                    manPlNoteToChAndMidiNoteMPE.erase(it);
+                }
+            } else if (it == manPlNoteToChAndMidiNoteMPE.end()) {
+                if (manPlNoteToChAndMidiNoteMPE.full()) {
+                    pitchesOverflow = true;
+                    continue;
+                }
+                auto chAndMidiNote = startLiveVoiceMPE(
+                    event.totalCents, event.velocity, midiMessages, sample);
+                if (chAndMidiNote.first != -1) {
+                    manPlNoteToChAndMidiNoteMPE.insert(event.totalCents, chAndMidiNote);
                 }
             }
-            // ==========================================================================
+        }
+    }
 
-            if (params.getTuningType() == Parameters::TuningType::MPE) {
-                // ================================================================================
-                // =                                  USING MPE                                   =
-                // ================================================================================
-
-                centsPerBendMPE = params.semiBendRangeMPE * 100.0 / 8192;
-                // Taking into account A4 freq (default is 440 Hz)
-                corrTotalCentsMPE = 1200 * log2(params.A4Freq / 440.0);
-
-                {
-                    std::scoped_lock lock(manPlNotesMutex);
-                    // Stop playing unexisting notes (manually played)
-                    for (auto it = manPlNoteToChAndMidiNoteMPE.begin();
-                         it != manPlNoteToChAndMidiNoteMPE.end();) {
-                        const auto &[totalCents, chAndMidiNote] = *it;
-                        if (!manuallyPlayedNotes.contains(totalCents)) {
-                            juce::MidiMessage noteOff = juce::MidiMessage::noteOff(
-                                chAndMidiNote.first, chAndMidiNote.second);
-                            midiMessages.addEvent(noteOff, 0);
-                            channelsManagerMPE->noteReleasedMPE(chAndMidiNote.first);
-                            it = manPlNoteToChAndMidiNoteMPE.erase(it);
-                        } else {
-                            ++it;
-                        }
+    // Notes from midi input, at their original sample positions
+    for (int k = 0; k < numLiveInputEvents; ++k) {
+        const LiveInputEvent &event = liveInputEvents[k];
+        auto it = liveInputNotesMPE.find(event.inputNote);
+        if (!event.isNoteOn) {
+            if (it != liveInputNotesMPE.end()) {
+                stopLiveVoiceMPE(it->second, midiMessages, event.sample);
+                liveInputNotesMPE.erase(it);
+            }
+        } else if (it == liveInputNotesMPE.end()) {
+            auto chAndMidiNote = startLiveVoiceMPE(event.totalCents, event.velocity,
+                                                   midiMessages, event.sample);
+            if (chAndMidiNote.first != -1) {
+                liveInputNotesMPE.insert(event.inputNote, chAndMidiNote);
+            }
+        }
+    }
+
+    {
+        // Lock-free, editor publishes new snapshot on every notes change
+        SnapshotPublisher<NotesSnapshot>::RealtimeReader notesReader(notesPublisher);
+        const NotesSnapshot &notesSnapshot = notesReader.get();
+        const std::vector<Note> &notes = notesSnapshot.getNotes();
+        auto &[sustainedNotesInds, bendingNotesInds, auditionedNotesInds] = playbackScratch;
+        // Only notes that overlap current block are of interest
+        queryScheduledNotes(notesSnapshot, isPlaying, barsToSchedule);
+
+        // Stop playing (maybe unexsiting) notes (from piano roll). If playhead jumped,
+        //   all of them are stopped (and then chased at the new position)
+        if (isPlaying && !playheadJumped) {
+            playingNotesMPE.eraseIf([&](uint64_t noteId, const VoicesMPE::Voice &noteData) {
+                bool stopPlayingThisNote = true;
+
+                const Note *note = notesSnapshot.findNote(noteId);
+
+                int totalCents = noteData.totalCents;
+                if (note != nullptr) {
+                    stopPlayingThisNote =
+                        (playHeadTime < note->time ||
+                         playHeadTime > note->time + note->duration) ||
+                        (totalCents != (note->octave * 1200 + note->cents));
+                }
+
+                if (stopPlayingThisNote) {
+                    int channel = noteData.channel;
+                    int midiNote = noteData.midiNote;
+                    if (channel != -1) {
+                        juce::MidiMessage noteOff = juce::MidiMessage::noteOff(channel, midiNote);
+                        midiMessages.addEvent(noteOff, 0);
+                        delCurrPlayedNotesTotalCentsMPE(totalCents);
+                        channelsManagerMPE->noteReleasedMPE(channel);
                     }
                 }
+                return stopPlayingThisNote;
+            });
+        } else if (wasPlaying) {
+            playingNotesMPE.forEach([&](uint64_t, const VoicesMPE::Voice &noteData) {
+                int totalCents = noteData.totalCents;
+                int channel = noteData.channel;
+                int midiNote = noteData.midiNote;
+                if (channel == -1) {
+                    return;
+                }
+                juce::MidiMessage noteOff = juce::MidiMessage::noteOff(channel, midiNote);
+                midiMessages.addEvent(noteOff, 0);
+                delCurrPlayedNotesTotalCentsMPE(totalCents);
+                channelsManagerMPE->noteReleasedMPE(channel);
+            });
+            playingNotesMPE.clear();
+        }
 
-                {
-                    // TODO: if it will cause audio glitches,
-                    //       change the approach to an intermediate buffer for notes
-                    std::scoped_lock lock(notesMutex);
-                    // Stop playing (maybe unexsiting) notes (from piano roll)
-                    if (isPlaying) {
-                        for (auto it = playingNotesMPE.begin(); it != playingNotesMPE.end();) {
-                            const auto &[noteId, noteData] = *it;
-                            bool stopPlayingThisNote = true;
-
-                            auto noteIt =
-                                std::find_if(notes.begin(), notes.end(),
-                                             [noteId](const Note &n) { return n.id == noteId; });
-
-                            int totalCents = noteData.totalCents;
-                            if (noteIt != notes.end()) {
-                                stopPlayingThisNote =
-                                    (playHeadTime < noteIt->time ||
-                                     playHeadTime > noteIt->time + noteIt->duration) ||
-                                    (totalCents != (noteIt->octave * 1200 + noteIt->cents));
-                            }
+        // Stop playing (maybe unexsiting) auditioning notes from piano roll
+        if (isAuditioning) {
+            auditioningNotesMPE.eraseIf([&](uint64_t noteId, const VoicesMPE::Voice &noteData) {
+                bool stopPlayingThisNote = true;
 
-                            if (stopPlayingThisNote) {
-                                int channel = noteData.channel;
-                                int midiNote = noteData.midiNote;
-                                juce::MidiMessage noteOff =
-                                    juce::MidiMessage::noteOff(channel, midiNote);
-                                midiMessages.addEvent(noteOff, 0);
-                                delCurrPlayedNotesTotalCentsMPE(totalCents);
-                                channelsManagerMPE->noteReleasedMPE(channel);
-                                it = playingNotesMPE.erase(it);
-                            } else {
-                                ++it;
-                            }
-                        }
-                    } else if (wasPlaying) {
-                        for (const auto &[_, noteData] : playingNotesMPE) {
-                            int totalCents = noteData.totalCents;
-                            int channel = noteData.channel;
-                            int midiNote = noteData.midiNote;
-                            juce::MidiMessage noteOff =
-                                juce::MidiMessage::noteOff(channel, midiNote);
-                            midiMessages.addEvent(noteOff, 0);
-                            delCurrPlayedNotesTotalCentsMPE(totalCents);
-                            channelsManagerMPE->noteReleasedMPE(channel);
-                        }
-                        playingNotesMPE.clear();
-                    }
+                const Note *note = notesSnapshot.findNote(noteId);
 
-                    // Stop playing (maybe unexsiting) auditioning notes from piano roll
-                    if (isAuditioning) {
-                        for (auto it = auditioningNotesMPE.begin();
-                             it != auditioningNotesMPE.end();) {
-                            const auto &[noteId, noteData] = *it;
-                            bool stopPlayingThisNote = true;
-
-                            auto noteIt =
-                                std::find_if(notes.begin(), notes.end(),
-                                             [noteId](const Note &n) { return n.id == noteId; });
-
-                            int totalCents = noteData.totalCents;
-                            if (noteIt != notes.end()) {
-                                stopPlayingThisNote =
-                                    (auditionTime < noteIt->time ||
-                                     auditionTime >= noteIt->time + noteIt->duration) ||
-                                    (totalCents != (noteIt->octave * 1200 + noteIt->cents));
-                            }
+                int totalCents = noteData.totalCents;
+                if (note != nullptr) {
+                    stopPlayingThisNote =
+                        (auditionTime < note->time ||
+                         auditionTime >= note->time + note->duration) ||
+                        (totalCents != (note->octave * 1200 + note->cents));
+                }
 
-                            if (stopPlayingThisNote) {
-                                int channel = noteData.channel;
-                                int midiNote = noteData.midiNote;
-                                juce::MidiMessage noteOff =
-                                    juce::MidiMessage::noteOff(channel, midiNote);
-                                midiMessages.addEvent(noteOff, 0);
-                                delCurrPlayedNotesTotalCentsMPE(totalCents);
-                                channelsManagerMPE->noteReleasedMPE(channel);
-                                it = auditioningNotesMPE.erase(it);
-                            } else {
-                                ++it;
-                            }
-                        }
-                    } else if (stopAuditioning) {
-                        for (const auto &[_, noteData] : auditioningNotesMPE) {
-                            int totalCents = noteData.totalCents;
-                            int channel = noteData.channel;
-                            int midiNote = noteData.midiNote;
-                            juce::MidiMessage noteOff =
-                                juce::MidiMessage::noteOff(channel, midiNote);
-                            midiMessages.addEvent(noteOff, 0);
-                            delCurrPlayedNotesTotalCentsMPE(totalCents);
-                            channelsManagerMPE->noteReleasedMPE(channel);
-                        }
-                        auditioningNotesMPE.clear();
+                if (stopPlayingThisNote) {
+                    int channel = noteData.channel;
+                    int midiNote = noteData.midiNote;
+                    if (channel != -1) {
+                        juce::MidiMessage noteOff = juce::MidiMessage::noteOff(channel, midiNote);
+                        midiMessages.addEvent(noteOff, 0);
+                        delCurrPlayedNotesTotalCentsMPE(totalCents);
+                        channelsManagerMPE->noteReleasedMPE(channel);
                     }
+                }
+                return stopPlayingThisNote;
+            });
+        } else if (stopAuditioning) {
+            auditioningNotesMPE.forEach([&](uint64_t, const VoicesMPE::Voice &noteData) {
+                int totalCents = noteData.totalCents;
+                int channel = noteData.channel;
+                int midiNote = noteData.midiNote;
+                if (channel == -1) {
+                    return;
+                }
+                juce::MidiMessage noteOff = juce::MidiMessage::noteOff(channel, midiNote);
+                midiMessages.addEvent(noteOff, 0);
+                delCurrPlayedNotesTotalCentsMPE(totalCents);
+                channelsManagerMPE->noteReleasedMPE(channel);
+            });
+            auditioningNotesMPE.clear();
+        }
 
-                    int midiNote, bendMPE;
-
-                    // Play auditioning notes from piano roll
-                    if (isAuditioning && auditionChanged) {
-                        // Note bend
-                        for (auto &[noteId, noteData] : auditioningNotesMPE) {
-                            auto noteIt =
-                                std::find_if(notes.begin(), notes.end(),
-                                             [noteId](const Note &n) { return n.id == noteId; });
-                            if ((noteIt->bend != 0) || noteData.hasBend) {
-                                int channel = noteData.channel;
-
-                                // To exclude: midi channels economy mode &
-                                //             bend appeared while note is playing
-                                if (channelsManagerMPE->getNumNotesInChannel(channel) == 1) {
-                                    bendMPE = calcBendMPE(*noteIt, auditionTime);
-                                    juce::MidiMessage pitchBend =
-                                        juce::MidiMessage::pitchWheel(channel, bendMPE);
-                                    midiMessages.addEvent(pitchBend, 0);
-
-                                    noteData.hasBend = noteIt->bend != 0;
-                                }
-                            }
-                        }
+        int midiNote, bendMPE;
 
-                        // Note on
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            if ((note.time <= auditionTime) &&
-                                (auditionTime < note.time + note.duration)) {
-                                if (!auditioningNotesMPE.contains(note.id)) {
-                                    int totalCents = note.octave * 1200 + note.cents;
-                                    std::tie(midiNote, bendMPE) =
-                                        calcMidiNoteAndBendMPE(totalCents);
-                                    if (note.bend != 0) {
-                                        bendMPE = calcBendMPE(note, auditionTime);
-                                    }
-                                    int ch = channelsManagerMPE->allocateChannelMPE(bendMPE,
-                                                                                    note.bend != 0);
-                                    if (ch != -1) {
-                                        pitchesOverflow = false;
-                                        juce::MidiMessage pitchBend =
-                                            juce::MidiMessage::pitchWheel(ch, bendMPE);
-                                        midiMessages.addEvent(pitchBend, 0);
-                                        juce::MidiMessage noteOn =
-                                            juce::MidiMessage::noteOn(ch, midiNote, note.velocity);
-                                        midiMessages.addEvent(noteOn, 0);
-                                        auditioningNotesMPE[note.id] = {totalCents, note.bend != 0,
-                                                                        ch, midiNote};
-                                        addCurrPlayedNotesTotalCentsMPE(totalCents);
-                                    } else {
-                                        pitchesOverflow = true;
-                                    }
-                                }
-                            }
+        // Play auditioning notes from piano roll
+        if (isAuditioning && auditionChanged) {
+            // Note bend
+            auditioningNotesMPE.forEach([&](uint64_t noteId, VoicesMPE::Voice &noteData) {
+                const Note *note = notesSnapshot.findNote(noteId);
+                if (note == nullptr) {
+                    return;
+                }
+                if ((note->bend != 0) || noteData.hasBend) {
+                    int channel = noteData.channel;
+
+                    // To exclude: midi channels economy mode &
+                    //             bend appeared while note is playing
+                    if ((channel != -1) &&
+                        (channelsManagerMPE->getNumNotesInChannel(channel) == 1)) {
+                        bendMPE = calcBendMPE(*note, auditionTime);
+                        if (bendMPE != noteData.lastBendMPE) {
+                            juce::MidiMessage pitchBend =
+                                juce::MidiMessage::pitchWheel(channel, bendMPE);
+                            midiMessages.addEvent(pitchBend, 0);
+                            noteData.lastBendMPE = bendMPE;
                         }
-                        auditionChanged = false;
-                    }
 
-                    // Play notes from piano roll
-                    if (isPlaying) {
-                        // ===================== Note off =====================
-                        for (auto it = playingNotesMPE.begin(); it != playingNotesMPE.end();) {
-                            const auto &[noteId, noteData] = *it;
-                            auto noteIt =
-                                std::find_if(notes.begin(), notes.end(),
-                                             [noteId](const Note &n) { return n.id == noteId; });
-                            const Note &note = *noteIt;
-
-                            if ((note.time + note.duration >= playHeadTime) &&
-                                (note.time + note.duration < playHeadTime + barsInBlock)) {
-                                int totalCents = noteData.totalCents;
-                                int channel = noteData.channel;
-                                int midiNote = noteData.midiNote;
-
-                                int noteOffSample = static_cast<int>(
-                                    floor(numSamples * (note.time + note.duration - playHeadTime) /
-                                          barsInBlock));
-
-                                juce::MidiMessage noteOff =
-                                    juce::MidiMessage::noteOff(channel, midiNote);
-                                midiMessages.addEvent(noteOff, noteOffSample);
-                                delCurrPlayedNotesTotalCentsMPE(totalCents);
-
-                                if (params.resetPitchBendOnNoteOff && noteData.hasBend) {
-                                    std::tie(midiNote, bendMPE) =
-                                        calcMidiNoteAndBendMPE(totalCents);
-                                    juce::MidiMessage pitchBend =
-                                        juce::MidiMessage::pitchWheel(channel, bendMPE);
-                                    midiMessages.addEvent(pitchBend, noteOffSample);
-                                }
-
-                                channelsManagerMPE->noteReleasedMPE(channel);
-                                it = playingNotesMPE.erase(it);
-                            } else {
-                                ++it;
-                            }
-                        }
-                        // ===================== Note on =====================
-                        const bool chaseMIDINotes =
-                            GlobalSettings::getInstance().getChaseMIDINotes();
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            int totalCents = note.octave * 1200 + note.cents;
-                            bool rightBorderCond =
-                                chaseMIDINotes
-                                    ? playHeadTime <= note.time + note.duration - barsInBlock
-                                    : playHeadTime <= note.time;
-                            if ((note.time - barsInBlock < playHeadTime) && rightBorderCond &&
-                                !playingNotesMPE.contains(note.id)) {
-                                std::tie(midiNote, bendMPE) = calcMidiNoteAndBendMPE(totalCents);
-                                int ch =
-                                    channelsManagerMPE->allocateChannelMPE(bendMPE, note.bend != 0);
-                                if (ch != -1) {
-                                    pitchesOverflow = false;
-                                    int noteOnSample = 0;
-                                    if (playHeadTime < note.time) {
-                                        noteOnSample = static_cast<int>(ceil(
-                                            numSamples * (note.time - playHeadTime) / barsInBlock));
-                                    }
-                                    juce::MidiMessage pitchBend =
-                                        juce::MidiMessage::pitchWheel(ch, bendMPE);
-                                    midiMessages.addEvent(pitchBend, noteOnSample);
-                                    juce::MidiMessage noteOn =
-                                        juce::MidiMessage::noteOn(ch, midiNote, note.velocity);
-                                    midiMessages.addEvent(noteOn, noteOnSample);
-                                    playingNotesMPE[note.id] = {totalCents, note.bend != 0, ch,
-                                                                midiNote};
-                                    addCurrPlayedNotesTotalCentsMPE(totalCents);
-                                } else {
-                                    pitchesOverflow = true;
-                                }
-                            }
+                        noteData.hasBend = note->bend != 0;
+                    }
+                }
+            });
+
+            // Note on
+            for (const int i : auditionedNotesInds) {
+                const Note &note = notes[i];
+                if ((note.time <= auditionTime) && (auditionTime < note.time + note.duration)) {
+                    if (!auditioningNotesMPE.contains(note.id)) {
+                        int totalCents = note.octave * 1200 + note.cents;
+                        std::tie(midiNote, bendMPE) = calcMidiNoteAndBendMPE(totalCents);
+                        if (note.bend != 0) {
+                            bendMPE = calcBendMPE(note, auditionTime);
                         }
-                        // ===================== Note bend =====================
-                        for (auto &[noteId, noteData] : playingNotesMPE) {
-                            auto noteIt =
-                                std::find_if(notes.begin(), notes.end(),
-                                             [noteId](const Note &n) { return n.id == noteId; });
-                            const Note &note = *noteIt;
-                            if (((note.bend != 0) || (noteData.hasBend)) &&
-                                (note.time < playHeadTime) &&
-                                (playHeadTime <= note.time + note.duration)) {
-                                int channel = noteData.channel;
-
-                                // To exclude: midi channels economy mode &
-                                //             bend appeared while note is playing
-                                if (channelsManagerMPE->getNumNotesInChannel(channel) == 1) {
-                                    int bendMPE = calcBendMPE(note, playHeadTime);
-                                    juce::MidiMessage pitchBend =
-                                        juce::MidiMessage::pitchWheel(channel, bendMPE);
-                                    midiMessages.addEvent(pitchBend, 0);
-
-                                    noteData.hasBend = note.bend != 0;
-                                }
-                            }
+                        int ch = allocateChannelMPE(bendMPE, note.bend != 0, totalCents,
+                                                    note.velocity, midiMessages, 0,
+                                                    &auditioningNotesMPE);
+                        if (ch != -1) {
+                            pitchesOverflow = false;
+                            juce::MidiMessage pitchBend =
+                                juce::MidiMessage::pitchWheel(ch, bendMPE);
+                            midiMessages.addEvent(pitchBend, 0);
+                            juce::MidiMessage noteOn =
+                                juce::MidiMessage::noteOn(ch, midiNote, note.velocity);
+                            midiMessages.addEvent(noteOn, 0);
+                            auditioningNotesMPE.insert(note.id,
+                                                       {totalCents, note.bend != 0, ch,
+                                                        midiNote, bendMPE});
+                            addCurrPlayedNotesTotalCentsMPE(totalCents);
+                        } else {
+                            pitchesOverflow = true;
                         }
                     }
                 }
+            }
+            auditionChanged = false;
+        }
 
-                // Start playing manually played notes
-                {
-                    std::scoped_lock lock(manPlNotesMutex);
-                    int midiNote, bendMPE;
-                    for (const auto &[totalCents, velocity] : manuallyPlayedNotes) {
-                        if (!manPlNoteToChAndMidiNoteMPE.contains(totalCents)) {
-                            std::tie(midiNote, bendMPE) = calcMidiNoteAndBendMPE(totalCents);
-                            int ch = channelsManagerMPE->allocateChannelMPE(bendMPE, false);
-                            if (ch != -1) {
-                                pitchesOverflow = false;
-                                juce::MidiMessage pitchBend =
-                                    juce::MidiMessage::pitchWheel(ch, bendMPE);
-                                midiMessages.addEvent(pitchBend, 0);
-                                juce::MidiMessage noteOn =
-                                    juce::MidiMessage::noteOn(ch, midiNote, velocity);
-                                midiMessages.addEvent(noteOn, 0);
-                                manPlNoteToChAndMidiNoteMPE[totalCents] =
-                                    std::make_pair(ch, midiNote);
-                            } else {
-                                pitchesOverflow = true;
-                            }
-                        }
-                    }
+        // Play notes from piano roll
+        if (isPlaying) {
+            blockScheduler.setBlock(playHeadTime, barsInBlock, numSamples);
+            // ===================== Note off =====================
+            for (const NoteTimeline::Event &event : blockScheduler.noteOffs(
+                     notesSnapshot, playHeadTime, playHeadTime + barsToSchedule)) {
+                const uint64_t noteId = notes[event.noteInd].id;
+                const VoicesMPE::Voice *voice = playingNotesMPE.find(noteId);
+                if (voice == nullptr) {
+                    continue;
+                }
+                const VoicesMPE::Voice noteData = *voice;
+                int totalCents = noteData.totalCents;
+                int channel = noteData.channel;
+                int midiNote = noteData.midiNote;
+                if (channel == -1) { // Voice was stolen, it's already silent
+                    playingNotesMPE.erase(noteId);
+                    continue;
                 }
 
-                wasPlaying = isPlaying;
-
-            } else if (params.getTuningType() == Parameters::MTS_ESP) {
-                // ================================================================================
-                // =                                USING MTS-ESP                                 =
-                // ================================================================================
-
-                // TODO: if it causes glitches,
-                //       change the approach to an intermediate buffers for things that are
-                //       changed in prepareToPlay(). Also then use buffers for notes and
-                //       manPlNotes, so all data  will be consistent
-                std::scoped_lock lock(prepareNotesMutex);
-
-                {
-                    std::scoped_lock lock(manPlNotesMutex);
-                    // Stop playing unexisting notes (manually played)
-                    for (auto it = manPlNoteToMidiNoteMTS.begin();
-                         it != manPlNoteToMidiNoteMTS.end();) {
-                        if (!manuallyPlayedNotes.contains(it->first)) {
-                            juce::MidiMessage noteOff =
-                                juce::MidiMessage::noteOff(params.channelIndex + 1, it->second);
-                            midiMessages.addEvent(noteOff, 0);
-                            currPlayedNotesIndexes.erase(it->second);
-                            it = manPlNoteToMidiNoteMTS.erase(it);
-                        } else {
-                            ++it;
-                        }
+                const int noteOffSample = blockScheduler.noteOffSample(event.time);
+
+                juce::MidiMessage noteOff = juce::MidiMessage::noteOff(channel, midiNote);
+                midiMessages.addEvent(noteOff, noteOffSample);
+                delCurrPlayedNotesTotalCentsMPE(totalCents);
+
+                if (params.resetPitchBendOnNoteOff && noteData.hasBend) {
+                    std::tie(midiNote, bendMPE) = calcMidiNoteAndBendMPE(totalCents);
+                    juce::MidiMessage pitchBend = juce::MidiMessage::pitchWheel(channel, bendMPE);
+                    midiMessages.addEvent(pitchBend, noteOffSample);
+                }
+
+                channelsManagerMPE->noteReleasedMPE(channel);
+                playingNotesMPE.erase(noteId);
+            }
+            // ===================== Note on =====================
+            auto noteOnEvents = blockScheduler.noteOns(notesSnapshot, playHeadTime,
+                                                       playHeadTime + barsToSchedule);
+            auto playNoteOn = [&](const Note &note) {
+                int totalCents = note.octave * 1200 + note.cents;
+                if (!playingNotesMPE.contains(note.id)) {
+                    std::tie(midiNote, bendMPE) = calcMidiNoteAndBendMPE(totalCents);
+                    const int noteOnSample = blockScheduler.noteOnSample(note.time);
+                    int ch = allocateChannelMPE(bendMPE, note.bend != 0, totalCents,
+                                                note.velocity, midiMessages, noteOnSample,
+                                                &playingNotesMPE);
+                    if (ch != -1) {
+                        pitchesOverflow = false;
+                        juce::MidiMessage pitchBend = juce::MidiMessage::pitchWheel(ch, bendMPE);
+                        midiMessages.addEvent(pitchBend, noteOnSample);
+                        juce::MidiMessage noteOn =
+                            juce::MidiMessage::noteOn(ch, midiNote, note.velocity);
+                        midiMessages.addEvent(noteOn, noteOnSample);
+                        playingNotesMPE.insert(note.id, {totalCents, note.bend != 0,
+                                                         ch, midiNote, bendMPE});
+                        addCurrPlayedNotesTotalCentsMPE(totalCents);
+                    } else {
+                        pitchesOverflow = true;
                     }
+                }
+            };
+            // If chasing, notes that started before the block are played too, but
+            // only notes that don't end in the block (so notes that sound at it's end)
+            if (GlobalSettings::getInstance().getChaseMIDINotes()) {
+                for (const int i : sustainedNotesInds) {
+                    playNoteOn(notes[i]);
+                }
+            } else {
+                for (const NoteTimeline::Event &event : noteOnEvents) {
+                    playNoteOn(notes[event.noteInd]);
+                }
+            }
+            // ===================== Note bend =====================
+            // Bend is sent at exact sample offsets every bendControlRateMPE samples,
+            // unchanged values are skipped
+            const int bendControlRate = std::max(1, params.bendControlRateMPE.load());
+            playingNotesMPE.forEach([&](uint64_t noteId, VoicesMPE::Voice &noteData) {
+                const Note *notePtr = notesSnapshot.findNote(noteId);
+                if (notePtr == nullptr) {
+                    return;
+                }
+                const Note &note = *notePtr;
+                if ((note.bend == 0) && !noteData.hasBend) {
+                    return;
+                }
+                int channel = noteData.channel;
 
-                    // Start playing manually played notes
-                    for (const auto &[totalCents, velocity] : manuallyPlayedNotes) {
-                        if (!manPlNoteToMidiNoteMTS.contains(totalCents)) {
-                            double noteFreq = getFreqFromTotalCents(totalCents);
-                            int noteInd = findFreqInd(noteFreq);
-                            if (noteInd != -1) {
-                                juce::MidiMessage noteOn = juce::MidiMessage::noteOn(
-                                    params.channelIndex + 1, noteInd, velocity);
-                                midiMessages.addEvent(noteOn, 0);
-                                currPlayedNotesIndexes.insert(noteInd);
-                                manPlNoteToMidiNoteMTS[totalCents] = noteInd;
-                            }
+                // To exclude: midi channels economy mode &
+                //             bend appeared while note is playing
+                if ((channel == -1) || (channelsManagerMPE->getNumNotesInChannel(channel) != 1)) {
+                    return;
+                }
+                for (int sample = 0; sample < numSamples; sample += bendControlRate) {
+                    double time = playHeadTime + barsInBlock * sample / numSamples;
+                    if ((note.time < time) && (time <= note.time + note.duration)) {
+                        int bendMPE = calcBendMPE(note, time);
+                        if (bendMPE != noteData.lastBendMPE) {
+                            juce::MidiMessage pitchBend =
+                                juce::MidiMessage::pitchWheel(channel, bendMPE);
+                            midiMessages.addEvent(pitchBend, sample);
+                            noteData.lastBendMPE = bendMPE;
                         }
+
+                        noteData.hasBend = note.bend != 0;
                     }
                 }
+            });
+        }
+    }
+
+    wasPlaying = isPlaying;
+}
+
+template <Parameters::TuningType tuningType>
+void AudioPluginAudioProcessor::playBlock(const PlaybackBlock &block,
+                                          juce::MidiBuffer &midiMessages) {
+    const double barsInBlock = block.barsInBlock;
+    const double barsToSchedule = block.barsToSchedule;
+    const int numSamples = block.numSamples;
+    const double sampleRate = block.sampleRate;
+    const bool isPlaying = block.isPlaying;
+
+    // Message thread hands prepared notes and their freqs over under prepareNotesMutex. Audio
+    //   thread doesn't wait for it: the block is skipped, manually played notes stay in their
+    //   queue and notes from midi input and piano roll are played at the start of the next block
+    std::unique_lock lock(prepareNotesMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        numDeferredLiveInputEvents = numLiveInputEvents;
+        if (isPlaying) {
+            if (block.playheadJumped || skippedFromMTS < 0.0) {
+                skippedFromMTS = playHeadTime;
+            }
+            skippedJumpMTS = skippedJumpMTS || block.playheadJumped;
+        }
+        return;
+    }
+    // Piano roll events are scheduled from the start of skipped blocks (if playback continued)
+    const bool playheadJumped = block.playheadJumped || skippedJumpMTS;
+    const double scheduleFrom = (isPlaying && !block.playheadJumped && skippedFromMTS >= 0.0 &&
+                                 skippedFromMTS < playHeadTime)
+                                    ? skippedFromMTS
+                                    : playHeadTime.load();
+    skippedFromMTS = -1.0;
+    skippedJumpMTS = false;
+
+    // Manually played notes (events from the editor, in order) and notes from midi
+    //   input. Slots are acquired here, so notes don't wait for prepareNotes()
+    {
+        ManualNoteEvent event;
+        int sample;
+        bool needUpdateFreqs = false;
+        while (popManualNoteEvent(event, sample, numSamples, sampleRate)) {
+            auto it = manPlNoteToMidiNoteMTS.find(event.totalCents);
+            if (!event.isNoteOn) {
+                if (it != manPlNoteToMidiNoteMTS.end()) {
+                    stopLiveVoiceMTS(it->second, midiMessages, sample);
+                    manPlNoteToMidiNoteMTS.erase(it);
+                }
+            } else if (it == manPlNoteToMidiNoteMTS.end() && !manPlNoteToMidiNoteMTS.full()) {
+                const int noteInd =
+                    startLiveVoiceMTS(event.totalCents, event.velocity, midiMessages,
+                                      sample, needUpdateFreqs);
+                if (noteInd != -1) {
+                    manPlNoteToMidiNoteMTS.insert(event.totalCents, noteInd);
+                }
+            }
+        }
 
-                {
-                    std::scoped_lock lock(notesMutex);
-                    // Stop playing (maybe unexsiting) auditioning notes from piano roll
-                    if (isAuditioning) {
-                        for (auto it = auditioningNotesMTS.begin();
-                             it != auditioningNotesMTS.end();) {
-                            uint64_t noteId = it->first;
-                            int totalCents = it->second.totalCents;
-                            bool stopPlayingThisNote = true;
-
-                            auto noteIt =
-                                std::find_if(notes.begin(), notes.end(),
-                                             [noteId](const Note &n) { return n.id == noteId; });
-
-                            if (noteIt != notes.end()) {
-                                stopPlayingThisNote =
-                                    (auditionTime < noteIt->time ||
-                                     auditionTime >= noteIt->time + noteIt->duration) ||
-                                    (totalCents != (noteIt->octave * 1200 + noteIt->cents));
-                            }
+        // Notes from midi input, at their original sample positions
+        for (int k = 0; k < numLiveInputEvents; ++k) {
+            const LiveInputEvent &liveEvent = liveInputEvents[k];
+            auto it = liveInputNotesMTS.find(liveEvent.inputNote);
+            if (!liveEvent.isNoteOn) {
+                if (it != liveInputNotesMTS.end()) {
+                    stopLiveVoiceMTS(it->second, midiMessages, liveEvent.sample);
+                    liveInputNotesMTS.erase(it);
+                }
+            } else if (it == liveInputNotesMTS.end()) {
+                const int noteInd =
+                    startLiveVoiceMTS(liveEvent.totalCents, liveEvent.velocity,
+                                      midiMessages, liveEvent.sample, needUpdateFreqs);
+                if (noteInd != -1) {
+                    liveInputNotesMTS.insert(liveEvent.inputNote, noteInd);
+                }
+            }
+        }
+        if (needUpdateFreqs) {
+            updateFreqsMTS();
+        }
+    }
 
-                            if (stopPlayingThisNote) {
-                                int noteInd = it->second.noteInd;
-                                juce::MidiMessage noteOff =
-                                    juce::MidiMessage::noteOff(params.channelIndex + 1, noteInd);
-                                midiMessages.addEvent(noteOff, 0);
-                                currPlayedNotesIndexes.erase(noteInd);
-                                currPlayedNotesTotalCents.erase(totalCents);
-                                it = auditioningNotesMTS.erase(it);
+    {
+        // notesIndexes were made for preparedNotes (prepareNotesMutex is locked)
+        const NotesSnapshot &notesSnapshot = *preparedNotes;
+        const std::vector<Note> &notes = notesSnapshot.getNotes();
+        auto &[sustainedNotesInds, bendingNotesInds, auditionedNotesInds] = playbackScratch;
+        const NoteTimeline &timeline = notesSnapshot.getTimeline();
+        // Only notes that overlap current block are of interest
+        queryScheduledNotes(notesSnapshot, isPlaying, barsToSchedule);
+
+        // Stop playing midi notes that aren't used by any note. Notes from piano roll
+        //   use them only if keepSustained and they sound at the block end
+        auto stopUnusedMidiNotes = [&](bool keepSustained) {
+            for (int ind = 0; ind < static_cast<int>(currPlayedNotesIndexes.size()); ++ind) {
+                if (!currPlayedNotesIndexes[ind]) {
+                    continue;
+                }
+                bool thereStillExistsThisNote = false;
+                if (keepSustained) {
+                    for (const int i : sustainedNotesInds) {
+                        const Note &note = notes[i];
+                        if (notesIndexes[i] == ind) {
+                            // Check if the note's base pitch matches (without bend)
+                            int noteTotalCents = note.octave * 1200 + note.cents;
+                            int freqsTotalCents;
+                            if (beforeBendTotalCents[ind] != -1) {
+                                freqsTotalCents = beforeBendTotalCents[ind];
                             } else {
-                                ++it;
+                                freqsTotalCents = getTotalCentsFromFreq(freqs[ind]);
+                            }
+                            if (noteTotalCents == freqsTotalCents) {
+                                thereStillExistsThisNote = true;
+                                break;
                             }
                         }
-                    } else if (stopAuditioning) {
-                        for (const auto &[noteId, noteData] : auditioningNotesMTS) {
-                            int totalCents = noteData.totalCents;
-                            int noteInd = noteData.noteInd;
-                            juce::MidiMessage noteOff =
-                                juce::MidiMessage::noteOff(params.channelIndex + 1, noteInd);
-                            midiMessages.addEvent(noteOff, 0);
-                            currPlayedNotesIndexes.erase(noteInd);
-                            currPlayedNotesTotalCents.erase(totalCents);
+                    }
+                }
+                if (!thereStillExistsThisNote) {
+                    for (const auto &[_, midiNoteInd] : manPlNoteToMidiNoteMTS) {
+                        if (midiNoteInd == ind) {
+                            thereStillExistsThisNote = true;
+                            break;
                         }
-                        auditioningNotesMTS.clear();
-                        stopAuditioning = false;
                     }
-
-                    // Play auditioning notes from piano roll
-                    if (isAuditioning && auditionChanged) {
-                        bool needUpdateFreqs = false;
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            if ((note.time <= auditionTime) &&
-                                (auditionTime < note.time + note.duration)) {
-                                auto it = auditioningNotesMTS.find(note.id);
-                                if (it == auditioningNotesMTS.end()) {
-                                    int totalCents = note.octave * 1200 + note.cents;
-                                    int noteInd = notesIndexes[i];
-                                    if (noteInd == -1)
-                                        continue;
-                                    juce::MidiMessage noteOn = juce::MidiMessage::noteOn(
-                                        params.channelIndex + 1, noteInd, note.velocity);
-                                    midiMessages.addEvent(noteOn, 0);
-                                    currPlayedNotesIndexes.insert(noteInd);
-                                    currPlayedNotesTotalCents.insert(totalCents);
-                                    auditioningNotesMTS[note.id] = {totalCents, note.bend != 0,
-                                                                    noteInd};
-                                    if (note.bend != 0) {
-                                        freqs[noteInd] = getNoteFreqAtTime(note, auditionTime);
-                                        needUpdateFreqs = true;
-                                    }
-                                } else {
-                                    if (note.bend != 0 || it->second.hasBend) {
-                                        int noteInd = it->second.noteInd;
-                                        freqs[noteInd] = getNoteFreqAtTime(note, auditionTime);
-                                        needUpdateFreqs = true;
-                                        it->second.hasBend = note.bend != 0;
-                                    }
-                                }
-                            }
+                }
+                if (!thereStillExistsThisNote) {
+                    for (const auto &[_, midiNoteInd] : liveInputNotesMTS) {
+                        if (midiNoteInd == ind) {
+                            thereStillExistsThisNote = true;
+                            break;
                         }
-                        if (needUpdateFreqs) {
-                            pluginInstanceManager->updateFreqs(freqs);
+                    }
+                }
+                if (!thereStillExistsThisNote) {
+                    for (const auto &[_, noteData] : auditioningNotesMTS) {
+                        if (noteData.noteInd == ind) {
+                            thereStillExistsThisNote = true;
+                            break;
                         }
-                        auditionChanged = false;
                     }
+                }
+                if (!thereStillExistsThisNote) {
+                    juce::MidiMessage noteOff = noteOffMTS(ind);
+                    midiMessages.addEvent(noteOff, 0);
+                    int totalCents;
+                    if (beforeBendTotalCents[ind] != -1) {
+                        totalCents = beforeBendTotalCents[ind];
+                    } else {
+                        totalCents = getTotalCentsFromFreq(freqs[ind]);
+                    }
+                    setPlayedTotalCentsMTS(totalCents, false);
+                    currPlayedNotesIndexes[ind] = false;
+                }
+            }
+        };
+        // Midi notes that were bending get their original frequencies
+        auto resetBends = [&]() {
+            bool wasBend = false;
+            for (int i = 0; i < freqSlotsManagerMTS.getNumSlots(); ++i) {
+                const int totCents = beforeBendTotalCents[i];
+                if (totCents != -1) {
+                    freqs[i] = getFreqFromTotalCents(totCents);
+                    beforeBendTotalCents[i] = -1;
+                    wasBend = true;
+                }
+            }
+            if (wasBend) {
+                updateFreqsMTS();
+            }
+        };
+
+        // Stop playing (maybe unexsiting) auditioning notes from piano roll
+        if (isAuditioning) {
+            for (auto it = auditioningNotesMTS.begin();
+                 it != auditioningNotesMTS.end();) {
+                uint64_t noteId = it->first;
+                int totalCents = it->second.totalCents;
+                bool stopPlayingThisNote = true;
+
+                const Note *note = notesSnapshot.findNote(noteId);
+
+                if (note != nullptr) {
+                    stopPlayingThisNote =
+                        (auditionTime < note->time ||
+                         auditionTime >= note->time + note->duration) ||
+                        (totalCents != (note->octave * 1200 + note->cents));
+                }
 
-                    // Play notes from piano roll
-                    if (isPlaying) {
-                        // =======================================
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            // Note off
-                            if ((note.time + note.duration >=
-                                 playHeadTime) && /*currPlayedNotesTotalCents.contains(note.octave*1200+note.cents)*/
-                                (note.time + note.duration < playHeadTime + barsInBlock)) {
-                                const int noteInd = notesIndexes[i];
-                                juce::MidiMessage noteOff =
-                                    juce::MidiMessage::noteOff(params.channelIndex + 1, noteInd);
-                                midiMessages.addEvent(
-                                    noteOff,
-                                    static_cast<int>(floor(
-                                        numSamples * (note.time + note.duration - playHeadTime) /
-                                        barsInBlock)));
-                                currPlayedNotesTotalCents.erase(note.octave * 1200 + note.cents);
-                            }
-                        }
-                        bool needUpdateFreqs = false;
-                        // =======================================
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            // PRE Note on
-                            if ((note.time >= playHeadTime) &&
-                                (note.time < playHeadTime + 2 * barsInBlock)) {
-                                // If note was bending - update frequency (and the start of
-                                // note will be without pitch leap)
-                                const int noteInd = notesIndexes[i];
-                                if (beforeBendTotalCents[noteInd] != -1) {
-                                    freqs[noteInd] =
-                                        getFreqFromTotalCents(note.octave * 1200 + note.cents);
-                                    needUpdateFreqs = true;
-                                }
-                            }
-                        }
-                        // =======================================
-                        const bool chaseMIDINotes =
-                            GlobalSettings::getInstance().getChaseMIDINotes();
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            // Note on
-                            bool rightBorderCond =
-                                chaseMIDINotes
-                                    ? playHeadTime <= note.time + note.duration - barsInBlock
-                                    : playHeadTime <= note.time;
-                            if ((note.time - barsInBlock < playHeadTime) && rightBorderCond &&
-                                !currPlayedNotesTotalCents.contains(note.octave * 1200 +
-                                                                    note.cents)) {
-                                const int noteInd = notesIndexes[i];
-                                juce::MidiMessage noteOn = juce::MidiMessage::noteOn(
-                                    params.channelIndex + 1, noteInd, note.velocity);
-                                int noteOnSample = 0;
-                                if (playHeadTime < note.time) {
-                                    noteOnSample = static_cast<int>(ceil(
-                                        numSamples * (note.time - playHeadTime) / barsInBlock));
-                                }
-                                midiMessages.addEvent(noteOn, noteOnSample);
-                                currPlayedNotesTotalCents.insert(note.octave * 1200 + note.cents);
-                                currPlayedNotesIndexes.insert(noteInd);
-                                if (note.bend != 0) {
-                                    beforeBendTotalCents[noteInd] = note.octave * 1200 + note.cents;
-                                } else {
-                                    beforeBendTotalCents[noteInd] = -1;
-                                }
-                            }
-                        }
-                        // =======================================
-                        for (int i = 0; i < notes.size(); ++i) {
-                            const Note &note = notes[i];
-                            // Note bend
-                            if ((note.bend != 0) && (note.time < playHeadTime) &&
-                                (playHeadTime <= note.time + note.duration)) {
-                                freqs[notesIndexes[i]] = getNoteFreq(note);
-                                needUpdateFreqs = true;
-                            }
-                        }
-                        if (needUpdateFreqs) {
-                            pluginInstanceManager->updateFreqs(freqs);
+                if (stopPlayingThisNote) {
+                    int noteInd = it->second.noteInd;
+                    juce::MidiMessage noteOff = noteOffMTS(noteInd);
+                    midiMessages.addEvent(noteOff, 0);
+                    currPlayedNotesIndexes[noteInd] = false;
+                    setPlayedTotalCentsMTS(totalCents, false);
+                    it = auditioningNotesMTS.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        } else if (stopAuditioning) {
+            for (const auto &[noteId, noteData] : auditioningNotesMTS) {
+                int totalCents = noteData.totalCents;
+                int noteInd = noteData.noteInd;
+                juce::MidiMessage noteOff = noteOffMTS(noteInd);
+                midiMessages.addEvent(noteOff, 0);
+                currPlayedNotesIndexes[noteInd] = false;
+                setPlayedTotalCentsMTS(totalCents, false);
+            }
+            auditioningNotesMTS.clear();
+            stopAuditioning = false;
+        }
+
+        // Play auditioning notes from piano roll
+        if (isAuditioning && auditionChanged) {
+            bool needUpdateFreqs = false;
+            for (const int i : auditionedNotesInds) {
+                const Note &note = notes[i];
+                if ((note.time <= auditionTime) && (auditionTime < note.time + note.duration)) {
+                    auto it = auditioningNotesMTS.find(note.id);
+                    if (it == auditioningNotesMTS.end()) {
+                        int totalCents = note.octave * 1200 + note.cents;
+                        int noteInd = notesIndexes[i];
+                        if (noteInd == -1 || auditioningNotesMTS.full())
+                            continue;
+                        juce::MidiMessage noteOn = noteOnMTS(noteInd, note.velocity);
+                        midiMessages.addEvent(noteOn, 0);
+                        currPlayedNotesIndexes[noteInd] = true;
+                        setPlayedTotalCentsMTS(totalCents, true);
+                        auditioningNotesMTS.insert(note.id,
+                                                   {totalCents, note.bend != 0, noteInd});
+                        if (note.bend != 0) {
+                            freqs[noteInd] = getNoteFreqAtTime(note, auditionTime);
+                            needUpdateFreqs = true;
                         }
                     } else {
-                        // IF THERE WERE NOTE BENDS AND NOTES DIDN'T END BEFORE WE STOPPED
-                        //    PLAYBACK (this isn't necessarily to do)
-                        if (wasPlaying) {
-                            bool wasBend = false;
-                            for (int i = 0; i < 128; ++i) {
-                                const int totCents = beforeBendTotalCents[i];
-                                if (totCents != -1) {
-                                    freqs[i] = getFreqFromTotalCents(totCents);
-                                    beforeBendTotalCents[i] = -1;
-                                    wasBend = true;
-                                }
-                            }
-                            if (wasBend) {
-                                pluginInstanceManager->updateFreqs(freqs);
-                            }
+                        if (note.bend != 0 || it->second.hasBend) {
+                            int noteInd = it->second.noteInd;
+                            freqs[noteInd] = getNoteFreqAtTime(note, auditionTime);
+                            needUpdateFreqs = true;
+                            it->second.hasBend = note.bend != 0;
                         }
                     }
-                    wasPlaying = isPlaying;
-
-                    // Stop playing unexisting notes
-                    for (auto it = currPlayedNotesIndexes.begin();
-                         it != currPlayedNotesIndexes.end();) {
-                        int ind = *it;
-                        bool thereStillExistsThisNote = false;
-                        if (isPlaying) {
-                            for (int i = 0; i < notes.size(); ++i) {
-                                const Note &note = notes[i];
-                                if ((notesIndexes[i] == ind) &&
-                                    (note.time < playHeadTime + barsInBlock) &&
-                                    (note.time + note.duration >= playHeadTime + barsInBlock)) {
-                                    // Check if the note's base pitch matches (without bend)
-                                    int noteTotalCents = note.octave * 1200 + note.cents;
-                                    int freqsTotalCents;
-                                    if (beforeBendTotalCents[ind] != -1) {
-                                        freqsTotalCents = beforeBendTotalCents[ind];
-                                    } else {
-                                        freqsTotalCents = getTotalCentsFromFreq(freqs[ind]);
-                                    }
-                                    if (noteTotalCents == freqsTotalCents) {
-                                        thereStillExistsThisNote = true;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        if (!thereStillExistsThisNote) {
-                            for (const auto &[_, midiNoteInd] : manPlNoteToMidiNoteMTS) {
-                                if (midiNoteInd == ind) {
-                                    thereStillExistsThisNote = true;
-                                    break;
-                                }
-                            }
-                        }
-                        if (!thereStillExistsThisNote) {
-                            for (const auto &[_, noteData] : auditioningNotesMTS) {
-                                if (noteData.noteInd == ind) {
-                                    thereStillExistsThisNote = true;
-                                    break;
-                                }
-                            }
-                        }
-                        if (thereStillExistsThisNote) {
-                            ++it;
-                        } else {
-                            juce::MidiMessage noteOff =
-                                juce::MidiMessage::noteOff(params.channelIndex + 1, ind);
-                            midiMessages.addEvent(noteOff, 0);
-                            int totalCents;
-                            if (beforeBendTotalCents[ind] != -1) {
-                                totalCents = beforeBendTotalCents[ind];
-                            } else {
-                                totalCents = getTotalCentsFromFreq(freqs[ind]);
-                            }
-                            currPlayedNotesTotalCents.erase(totalCents);
-                            it = currPlayedNotesIndexes.erase(it);
-                        }
+                }
+            }
+            if (needUpdateFreqs) {
+                updateFreqsMTS();
+            }
+            auditionChanged = false;
+        }
+
+        // Playhead jumped: notes from piano roll are stopped (and then chased at the
+        //   new position)
+        if (playheadJumped) {
+            stopUnusedMidiNotes(false);
+            resetBends();
+        }
+
+        // Play notes from piano roll
+        if (isPlaying) {
+            const uint64_t eventsVersion = notesSnapshot.getVersion();
+            // =======================================
+            blockScheduler.setBlock(playHeadTime, barsInBlock, numSamples);
+            for (const NoteTimeline::Event &event : blockScheduler.noteOffs(
+                     notesSnapshot, scheduleFrom, playHeadTime + barsToSchedule)) {
+                const Note &note = notes[event.noteInd];
+                // Note off
+                const int noteInd = notesIndexes[event.noteInd];
+                if (noteInd == -1) {
+                    continue;
+                }
+                juce::MidiMessage noteOff = noteOffMTS(noteInd);
+                // Note offs of skipped blocks are at the start of the block
+                const int noteOffSample = blockScheduler.noteOffSample(event.time);
+                midiMessages.addEvent(noteOff, noteOffSample);
+                setPlayedTotalCentsMTS(note.octave * 1200 + note.cents, false);
+            }
+            bool needUpdateFreqs = false;
+            // =======================================
+            for (const NoteTimeline::Event &event :
+                 preNoteOnCursor.advance(timeline.getNoteOns(), eventsVersion,
+                                         playHeadTime,
+                                         playHeadTime + 2 * barsInBlock)) {
+                const Note &note = notes[event.noteInd];
+                // PRE Note on
+                // If note was bending - update frequency (and the start of
+                // note will be without pitch leap)
+                const int noteInd = notesIndexes[event.noteInd];
+                if (noteInd != -1 && beforeBendTotalCents[noteInd] != -1) {
+                    freqs[noteInd] = getFreqFromTotalCents(note.octave * 1200 + note.cents);
+                    needUpdateFreqs = true;
+                }
+            }
+            // =======================================
+            auto noteOnEvents = blockScheduler.noteOns(notesSnapshot, scheduleFrom,
+                                                       playHeadTime + barsToSchedule);
+            auto playNoteOn = [&](int i) {
+                const Note &note = notes[i];
+                // Note on
+                const int noteInd = notesIndexes[i];
+                if (noteInd != -1 &&
+                    !isPlayedTotalCentsMTS(note.octave * 1200 + note.cents)) {
+                    juce::MidiMessage noteOn = noteOnMTS(noteInd, note.velocity);
+                    const int noteOnSample = blockScheduler.noteOnSample(note.time);
+                    midiMessages.addEvent(noteOn, noteOnSample);
+                    setPlayedTotalCentsMTS(note.octave * 1200 + note.cents, true);
+                    currPlayedNotesIndexes[noteInd] = true;
+                    if (note.bend != 0) {
+                        beforeBendTotalCents[noteInd] = note.octave * 1200 + note.cents;
+                    } else {
+                        beforeBendTotalCents[noteInd] = -1;
+                    }
+                }
+            };
+            // If chasing, notes that started before the block are played too, but
+            // only notes that don't end in the block (so notes that sound at it's end)
+            if (GlobalSettings::getInstance().getChaseMIDINotes()) {
+                for (const int i : sustainedNotesInds) {
+                    playNoteOn(i);
+                }
+            } else {
+                for (const NoteTimeline::Event &event : noteOnEvents) {
+                    // Notes of skipped blocks are played only if they still sound
+                    const Note &note = notes[event.noteInd];
+                    if (event.time < playHeadTime &&
+                        note.time + note.duration <= playHeadTime) {
+                        continue;
                     }
+                    playNoteOn(event.noteInd);
                 }
             }
+            // =======================================
+            // Note bends: frequencies of all bending notes are converted at once
+            //   (tuning isn't updated if frequency hasn't changed). Bend updates are
+            //   coalesced to bendControlRateMTS, so clients aren't retuned too often
+            samplesSinceBendUpdateMTS += numSamples;
+            if (samplesSinceBendUpdateMTS >= params.bendControlRateMTS.load()) {
+                samplesSinceBendUpdateMTS = 0;
+                const size_t numBending = bendingNotesInds.size();
+                bendingNotesFreqs.resize(numBending);
+                for (size_t k = 0; k < numBending; ++k) {
+                    bendingNotesFreqs[k] =
+                        getNoteCentsFromA4(notes[bendingNotesInds[k]], playHeadTime);
+                }
+                centsToFreqs(bendingNotesFreqs.data(), bendingNotesFreqs.data(),
+                             numBending, params.A4Freq.load());
+                for (size_t k = 0; k < numBending; ++k) {
+                    const int noteInd = notesIndexes[bendingNotesInds[k]];
+                    const double noteFreq = bendingNotesFreqs[k];
+                    if (noteInd != -1 && freqs[noteInd] != noteFreq) {
+                        freqs[noteInd] = noteFreq;
+                        needUpdateFreqs = true;
+                    }
+                }
+            }
+            if (needUpdateFreqs) {
+                updateFreqsMTS();
+            }
+        } else {
+            // IF THERE WERE NOTE BENDS AND NOTES DIDN'T END BEFORE WE STOPPED
+            //    PLAYBACK (this isn't necessarily to do)
+            if (wasPlaying) {
+                resetBends();
+            }
         }
+        wasPlaying = isPlaying;
+
+        // Stop playing unexisting notes
+        stopUnusedMidiNotes(isPlaying);
     }
 
-    buffer.clear();
+    publishFreqsMTS<tuningType>(midiMessages);
 }
 
 bool AudioPluginAudioProcessor::hasEditor() const {
@@ -1287,6 +1671,16 @@ void AudioPluginAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
     paramsTree.setProperty("a4Freq", params.A4Freq.load(), nullptr);
     paramsTree.setProperty("noteRectHeightCoef", params.noteRectHeightCoef, nullptr);
     paramsTree.setProperty("constNoteRectHeight", params.constNoteRectHeight, nullptr);
+    paramsTree.setProperty("midiInputMapping", static_cast<int>(params.midiInputMapping.load()),
+                           nullptr);
+    {
+        std::scoped_lock lock(midiInputMapMutex);
+        juce::StringArray degrees;
+        for (const int cents : midiInputScale) {
+            degrees.add(juce::String(cents));
+        }
+        paramsTree.setProperty("midiInputScale", degrees.joinIntoString(" "), nullptr);
+    }
 
     // Tuning & instances sync
     paramsTree.setProperty("tuningType", static_cast<int>(params.getGlobalTuningType()), nullptr);
@@ -1303,9 +1697,14 @@ void AudioPluginAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
                            nullptr);
     paramsTree.setProperty("semiBendRangeMPE", params.semiBendRangeMPE.load(), nullptr);
     paramsTree.setProperty("channelsEconomyModeMPE", params.channelsEconomyModeMPE, nullptr);
+    paramsTree.setProperty("bendControlRateMPE", params.bendControlRateMPE.load(), nullptr);
+    paramsTree.setProperty("voiceStealingMPE", static_cast<int>(params.voiceStealingMPE.load()),
+                           nullptr);
+    paramsTree.setProperty("bendControlRateMTS", params.bendControlRateMTS.load(), nullptr);
 
     // For MTS-ESP:
     paramsTree.setProperty("channelIndex", params.channelIndex, nullptr);
+    paramsTree.setProperty("numChannelsMTS", params.numChannelsMTS.load(), nullptr);
     auto ghostChTree = paramsTree.getOrCreateChildWithName("GhostNotesChannels", nullptr);
     for (const int ch : params.ghostNotesChannels) {
         juce::ValueTree chNode("Channel");
@@ -1358,8 +1757,8 @@ void AudioPluginAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
     // Notes
     auto notesTree = state.getOrCreateChildWithName("Notes", nullptr);
     {
-        std::scoped_lock lock(notesMutex);
-        for (const auto &note : notes) {
+        NotesSnapshotPtr notesSnapshot = notesPublisher.get();
+        for (const auto &note : notesSnapshot->getNotes()) {
             juce::ValueTree noteNode("Note");
             noteNode.setProperty("octave", note.octave, nullptr);
             noteNode.setProperty("cents", note.cents, nullptr);
@@ -1402,6 +1801,7 @@ void AudioPluginAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
     paramsTree.setProperty("vocalToMelodyDCents", params.vocalToMelodyDCents.load(), nullptr);
     paramsTree.setProperty("vocalToMelodyKeySnap", params.vocalToMelodyKeySnap.load(), nullptr);
     paramsTree.setProperty("vocalToMelodyMakeBends", params.vocalToMelodyMakeBends.load(), nullptr);
+    paramsTree.setProperty("vocalToMelodyHopMs", params.vocalToMelodyHopMs.load(), nullptr);
 
     // Editor state
     paramsTree.setProperty("lastDuration", params.lastDuration, nullptr);
@@ -1424,8 +1824,7 @@ void AudioPluginAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
 //       SO THIS METHOD CAN CAUSE DATA RACE IF RUNS NOT IN MESSAGE THREAD!
 void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeInBytes) {
     if (data == nullptr || sizeInBytes <= 0) {
-        std::scoped_lock lock(notesMutex);
-        notes.clear();
+        publishNotes({});
         return;
     }
 
@@ -1447,8 +1846,7 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
 
     auto paramsTree = state.getChildWithName("Parameters");
     if (!paramsTree.isValid()) {
-        std::scoped_lock lock(notesMutex);
-        notes.clear();
+        publishNotes({});
         return;
     }
 
@@ -1466,6 +1864,19 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
         static_cast<float>(paramsTree.getProperty("noteRectHeightCoef", params.noteRectHeightCoef));
     params.constNoteRectHeight = static_cast<bool>(
         paramsTree.getProperty("constNoteRectHeight", params.constNoteRectHeight));
+    params.midiInputMapping.store(static_cast<Parameters::MidiInputMapping>(juce::jlimit(
+        static_cast<int>(Parameters::MidiInputOff), static_cast<int>(Parameters::MidiInputSclScale),
+        static_cast<int>(paramsTree.getProperty(
+            "midiInputMapping", static_cast<int>(params.midiInputMapping.load()))))));
+    {
+        std::vector<int> scaleCents;
+        auto degrees = juce::StringArray::fromTokens(
+            paramsTree.getProperty("midiInputScale", "").toString(), " ", "");
+        for (const auto &degree : degrees) {
+            scaleCents.push_back(degree.getIntValue());
+        }
+        setMidiInputScale(scaleCents); // also updates midi input map
+    }
 
     // Tuning & instances sync
     auto newTuningType = static_cast<Parameters::TuningType>(static_cast<int>(
@@ -1497,14 +1908,36 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
     params.channelsEconomyModeMPE = static_cast<bool>(
         paramsTree.getProperty("channelsEconomyModeMPE", params.channelsEconomyModeMPE));
     channelsManagerMPE->setEconomyMode(params.channelsEconomyModeMPE);
+    params.bendControlRateMPE = juce::jlimit(
+        16, 512,
+        static_cast<int>(
+            paramsTree.getProperty("bendControlRateMPE", params.bendControlRateMPE.load())));
+    params.voiceStealingMPE.store(static_cast<Parameters::VoiceStealingMPE>(juce::jlimit(
+        static_cast<int>(VoiceStealingMPE::NoStealing),
+        static_cast<int>(VoiceStealingMPE::StealSameBend),
+        static_cast<int>(paramsTree.getProperty(
+            "voiceStealingMPE", static_cast<int>(params.voiceStealingMPE.load()))))));
+    params.bendControlRateMTS = juce::jlimit(
+        1, 4096,
+        static_cast<int>(
+            paramsTree.getProperty("bendControlRateMTS", params.bendControlRateMTS.load())));
 
     // For MTS-ESP:
     int desiredChannelIndex = paramsTree.getProperty("channelIndex", params.channelIndex);
     if ((params.getTuningType() == Parameters::TuningType::MTS_ESP) &&
         (desiredChannelIndex != params.channelIndex) && (desiredChannelIndex != -1)) {
+        // Serialised with updateFreqs() of the audio thread
+        std::scoped_lock lock(prepareNotesMutex);
         pluginInstanceManager->changeChannelIndex(desiredChannelIndex);
         params.channelIndex = pluginInstanceManager->getChannelIndex();
     }
+    params.numChannelsMTS = juce::jlimit(
+        1, PluginInstanceManager::maxChannels,
+        static_cast<int>(paramsTree.getProperty("numChannelsMTS", params.numChannelsMTS.load())));
+    if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
+        std::scoped_lock lock(prepareNotesMutex);
+        applyNumChannelsMTS();
+    }
     auto ghostChTree = paramsTree.getChildWithName("GhostNotesChannels");
     params.ghostNotesChannels.clear();
     if (ghostChTree.isValid()) {
@@ -1579,23 +2012,20 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
 
     // Notes
     auto notesTree = state.getChildWithName("Notes");
-    {
-        std::scoped_lock lock(notesMutex);
-        notes.clear();
-        if (notesTree.isValid()) {
-            for (auto noteNode : notesTree) {
-                if (noteNode.hasType("Note")) {
-                    Note note;
-                    note.octave = noteNode.getProperty("octave", 0);
-                    note.cents = noteNode.getProperty("cents", 0);
-                    note.time = static_cast<float>(noteNode.getProperty("time", 0.0f));
-                    note.isSelected = static_cast<bool>(noteNode.getProperty("isSelected", false));
-                    note.duration = static_cast<float>(noteNode.getProperty("duration", 1.0f));
-                    note.velocity = static_cast<float>(
-                        noteNode.getProperty("velocity", Parameters::defaultVelocity));
-                    note.bend = noteNode.getProperty("bend", 0);
-                    notes.push_back(note);
-                }
+    std::vector<Note> notes;
+    if (notesTree.isValid()) {
+        for (auto noteNode : notesTree) {
+            if (noteNode.hasType("Note")) {
+                Note note;
+                note.octave = noteNode.getProperty("octave", 0);
+                note.cents = noteNode.getProperty("cents", 0);
+                note.time = static_cast<float>(noteNode.getProperty("time", 0.0f));
+                note.isSelected = static_cast<bool>(noteNode.getProperty("isSelected", false));
+                note.duration = static_cast<float>(noteNode.getProperty("duration", 1.0f));
+                note.velocity = static_cast<float>(
+                    noteNode.getProperty("velocity", Parameters::defaultVelocity));
+                note.bend = noteNode.getProperty("bend", 0);
+                notes.push_back(note);
             }
         }
     }
@@ -1636,6 +2066,10 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
         paramsTree.getProperty("vocalToMelodyKeySnap", params.vocalToMelodyKeySnap.load()));
     params.vocalToMelodyMakeBends = static_cast<bool>(
         paramsTree.getProperty("vocalToMelodyMakeBends", params.vocalToMelodyMakeBends.load()));
+    params.vocalToMelodyHopMs = juce::jlimit(
+        params.min_vocalToMelodyHopMs, params.max_vocalToMelodyHopMs,
+        static_cast<float>(
+            paramsTree.getProperty("vocalToMelodyHopMs", params.vocalToMelodyHopMs.load())));
 
     // Editor state
     params.lastDuration =
@@ -1656,22 +2090,19 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
         static_cast<bool>(paramsTree.getProperty("showGhostNotesKeys", params.showGhostNotesKeys));
 
     // UPDATE NOTES
-    {
-        std::scoped_lock lock(notesMutex);
-        params.stateHistory.push(State(numBars, notes, params.ratiosMarks));
-    }
+    params.stateHistory.push(State(numBars, notes, params.ratiosMarks));
+    NotesSnapshotPtr notesSnapshot = publishNotes(std::move(notes));
     prepareNotes();
     if (params.getTuningType() == Parameters::TuningType::MPE) {
-        notesSharingMPE->updateNotes(notes);
+        notesSharingMPE->updateNotes(notesSnapshot->getNotes());
     } else if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
-        pluginInstanceManager->updateNotes(notes);
+        pluginInstanceManager->updateNotes(notesSnapshot->getNotes());
     }
 }
 
 void AudioPluginAudioProcessor::legacySetStateInformation(const void *data, int sizeInBytes) {
     if (data == nullptr || sizeInBytes <= 0) {
-        std::scoped_lock lock(notesMutex);
-        notes.clear();
+        publishNotes({});
         return;
     }
     juce::MemoryInputStream stream(data, sizeInBytes, false);
@@ -1759,25 +2190,23 @@ void AudioPluginAudioProcessor::legacySetStateInformation(const void *data, int
     params.theme.setTheme(params.themeType);
 
     // Read notes
-    {
-        std::scoped_lock lock(notesMutex);
-        notes.clear();
-        int numNotes = stream.readInt();
-        if ((numNotes < 0) || (numNotes > 1e6)) {
-            return;
-        }
-        notes.reserve(numNotes);
-        for (int i = 0; i < numNotes; ++i) {
-            Note note;
-            note.octave = stream.readInt();
-            note.cents = stream.readInt();
-            note.time = stream.readFloat();
-            note.isSelected = stream.readBool();
-            note.duration = stream.readFloat();
-            note.velocity = stream.readFloat();
-            note.bend = stream.readInt();
-            notes.push_back(note);
-        }
+    std::vector<Note> notes;
+    int numNotes = stream.readInt();
+    if ((numNotes < 0) || (numNotes > 1e6)) {
+        publishNotes({});
+        return;
+    }
+    notes.reserve(numNotes);
+    for (int i = 0; i < numNotes; ++i) {
+        Note note;
+        note.octave = stream.readInt();
+        note.cents = stream.readInt();
+        note.time = stream.readFloat();
+        note.isSelected = stream.readBool();
+        note.duration = stream.readFloat();
+        note.velocity = stream.readFloat();
+        note.bend = stream.readInt();
+        notes.push_back(note);
     }
 
     // Read other things
@@ -1791,6 +2220,8 @@ void AudioPluginAudioProcessor::legacySetStateInformation(const void *data, int
         int desiredChannelIndex = stream.readInt();
         if ((params.getTuningType() == Parameters::TuningType::MTS_ESP) &&
             (desiredChannelIndex != params.channelIndex) && (desiredChannelIndex != -1)) {
+            // Serialised with updateFreqs() of the audio thread
+            std::scoped_lock lock(prepareNotesMutex);
             pluginInstanceManager->changeChannelIndex(desiredChannelIndex);
             params.channelIndex = pluginInstanceManager->getChannelIndex();
         }
@@ -1828,6 +2259,7 @@ void AudioPluginAudioProcessor::legacySetStateInformation(const void *data, int
         }
     }
     params.stateHistory.push(State(num_bars, notes, params.ratiosMarks));
+    NotesSnapshotPtr notesSnapshot = publishNotes(std::move(notes));
 
     // Read vocal to melody params
     if (!stream.isExhausted()) {
@@ -1884,25 +2316,161 @@ void AudioPluginAudioProcessor::legacySetStateInformation(const void *data, int
 
     prepareNotes();
     if (params.getTuningType() == Parameters::TuningType::MPE) {
-        notesSharingMPE->updateNotes(notes);
+        notesSharingMPE->updateNotes(notesSnapshot->getNotes());
     } else if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
-        pluginInstanceManager->updateNotes(notes);
+        pluginInstanceManager->updateNotes(notesSnapshot->getNotes());
     }
 }
 
 void AudioPluginAudioProcessor::updateNotes(const std::vector<Note> &new_notes) {
     // suspendProcessing(true);
-    {
-        std::scoped_lock lock(notesMutex);
-        notes = new_notes;
-    }
-    prepareNotes();
+    NotesSnapshotPtr notesSnapshot = publishNotes(new_notes);
+    prepareNotes(true);
     auditionChanged = true;
     // suspendProcessing(false);
     if (params.getTuningType() == Parameters::TuningType::MPE) {
-        notesSharingMPE->updateNotes(notes);
+        notesSharingMPE->updateNotes(notesSnapshot->getNotes());
     } else if (params.getTuningType() == Parameters::MTS_ESP) {
-        pluginInstanceManager->updateNotes(notes);
+        pluginInstanceManager->updateNotes(notesSnapshot->getNotes());
+    }
+}
+
+NotesSnapshotPtr AudioPluginAudioProcessor::publishNotes(std::vector<Note> newNotes) {
+    auto notesSnapshot = std::make_shared<const NotesSnapshot>(std::move(newNotes));
+
+    // Scratch must fit every note of the snapshot before the audio thread can see it. It grows
+    //   geometrically, so it's rarely swapped (while processBlock() doesn't execute)
+    const size_t numNotes = notesSnapshot->getNotes().size();
+    if (numNotes > playbackScratchCapacity) {
+        const size_t newCapacity = std::max(numNotes, 2 * playbackScratchCapacity);
+        PlaybackScratch newScratch;
+        newScratch.sustainedNotesInds.reserve(newCapacity);
+        newScratch.bendingNotesInds.reserve(newCapacity);
+        newScratch.auditionedNotesInds.reserve(newCapacity);
+        {
+            std::scoped_lock lock(changeInstanceSyncMutex);
+            std::swap(playbackScratch, newScratch);
+        }
+        playbackScratchCapacity = newCapacity;
+    }
+
+    notesPublisher.publish(notesSnapshot);
+    return notesSnapshot;
+}
+
+void AudioPluginAudioProcessor::queryScheduledNotes(const NotesSnapshot &notesSnapshot,
+                                                    bool isPlaying, double barsInBlock) {
+    const std::vector<Note> &notes = notesSnapshot.getNotes();
+    const NoteSchedule &schedule = notesSnapshot.getSchedule();
+    auto &[sustainedNotesInds, bendingNotesInds, auditionedNotesInds] = playbackScratch;
+    if (isPlaying) {
+        // Notes that started before the block end and didn't end before it
+        const double blockStart = playHeadTime;
+        const double blockEnd = blockStart + barsInBlock;
+        schedule.query(blockEnd, blockEnd, sustainedNotesInds);
+        std::erase_if(sustainedNotesInds, [&](int i) { return notes[i].time >= blockEnd; });
+        // Notes with bend that are playing at the block start
+        notesSnapshot.getBendSchedule().query(blockStart, blockStart, bendingNotesInds);
+        std::erase_if(bendingNotesInds, [&](int i) { return notes[i].time >= blockStart; });
+    } else {
+        sustainedNotesInds.clear();
+        bendingNotesInds.clear();
+    }
+    if (isAuditioning) {
+        schedule.query(auditionTime, auditionTime, auditionedNotesInds);
+    } else {
+        auditionedNotesInds.clear();
+    }
+}
+
+
+void AudioPluginAudioProcessor::updateMidiInputMap() {
+    std::scoped_lock lock(midiInputMapMutex);
+    std::set<int> keysSet;
+    {
+        std::scoped_lock keysLock(keysMutex);
+        keysSet = keys;
+    }
+    const std::vector<int> keysCents(keysSet.begin(), keysSet.end());
+    const int numKeys = static_cast<int>(keysCents.size());
+    const int numDegrees = static_cast<int>(midiInputScale.size());
+    const int maxTotalCents = params.num_octaves * 1200;
+
+    std::array<int, 128> map;
+    for (int midiNote = 0; midiNote < 128; ++midiNote) {
+        int totalCents = -1;
+        switch (params.midiInputMapping.load()) {
+        case Parameters::MidiInputKeysScale:
+            // Same as 12-EDO if all 12 keys are there: midi note 0 is the first key of octave 0
+            if (numKeys > 0) {
+                totalCents = 1200 * (midiNote / numKeys) + keysCents[midiNote % numKeys];
+            }
+            break;
+        case Parameters::MidiInputNearestKey:
+            totalCents = (numKeys > 0)
+                             ? findNearestKeyTotalCents(midiNote * 100, keysSet, params.num_octaves)
+                             : midiNote * 100;
+            break;
+        case Parameters::MidiInputSclScale:
+            // Same as when .mid + .scl are imported
+            if (numDegrees > 0) {
+                const int degree = midiNote % numDegrees;
+                totalCents = midiInputScale[numDegrees - 1] * (midiNote / numDegrees) +
+                             (degree == 0 ? 0 : midiInputScale[degree - 1]);
+            }
+            break;
+        default:
+            break;
+        }
+        map[midiNote] = (totalCents >= 0 && totalCents < maxTotalCents) ? totalCents : -1;
+    }
+    midiInputMap.write(map.data());
+}
+
+void AudioPluginAudioProcessor::setMidiInputScale(const std::vector<int> &scaleCents) {
+    {
+        std::scoped_lock lock(midiInputMapMutex);
+        midiInputScale = scaleCents;
+    }
+    updateMidiInputMap();
+}
+
+void AudioPluginAudioProcessor::collectLiveInputEvents(const juce::MidiBuffer &midiMessages) {
+    // Events of a skipped block are played at the start of this one
+    numLiveInputEvents = numDeferredLiveInputEvents;
+    for (int k = 0; k < numLiveInputEvents; ++k) {
+        liveInputEvents[k].sample = 0;
+    }
+    const bool isMappingOn = params.midiInputMapping.load() != Parameters::MidiInputOff;
+    bool isMapRead = false;
+    for (const auto metadata : midiMessages) {
+        const auto message = metadata.getMessage();
+        if (!message.isNoteOnOrOff() || numLiveInputEvents == liveInputEvents.size()) {
+            continue;
+        }
+        LiveInputEvent &event = liveInputEvents[numLiveInputEvents];
+        event.inputNote = message.getNoteNumber();
+        event.isNoteOn = message.isNoteOn();
+        event.velocity = message.getFloatVelocity();
+        event.sample = metadata.samplePosition;
+        if (event.isNoteOn) {
+            if (!isMappingOn) {
+                continue;
+            }
+            if (!isMapRead) {
+                // If mapping is being written now, previous copy is used
+                std::array<int, 128> map;
+                if (midiInputMap.tryRead(map.data(), 1)) {
+                    midiInputMapCopy = map;
+                }
+                isMapRead = true;
+            }
+            event.totalCents = midiInputMapCopy[event.inputNote];
+            if (event.totalCents == -1) {
+                continue;
+            }
+        }
+        ++numLiveInputEvents;
     }
 }
 
@@ -1913,17 +2481,155 @@ void AudioPluginAudioProcessor::rePrepareNotes() {
 }
 
 void AudioPluginAudioProcessor::setManuallyPlayedNotes(
-    const std::map<int, float> newManuallyPlayedNotes) {
-    {
-        std::scoped_lock lock(manPlNotesMutex);
-        manuallyPlayedNotes = newManuallyPlayedNotes;
+    const std::map<int, float> newManuallyPlayedNotes, const std::set<int> &notRecordedNotes) {
+    const double timeMs = juce::Time::getMillisecondCounterHiRes();
+    // If queue is full, the note stays in (or out of) manuallyPlayedNotes and will be sent with
+    //   next call
+    for (auto it = manuallyPlayedNotes.begin(); it != manuallyPlayedNotes.end();) {
+        if (!newManuallyPlayedNotes.contains(it->first) &&
+            manualNoteEvents.push({it->first, 0.0f, false, timeMs})) {
+            it = manuallyPlayedNotes.erase(it);
+        } else {
+            ++it;
+        }
     }
-    if (params.getTuningType() == Parameters::TuningType::MTS_ESP) {
-        rePrepareNotes();
+    for (const auto &[totalCents, velocity] : newManuallyPlayedNotes) {
+        if (!manuallyPlayedNotes.contains(totalCents) &&
+            manualNoteEvents.push(
+                {totalCents, velocity, true, timeMs, !notRecordedNotes.contains(totalCents)})) {
+            manuallyPlayedNotes[totalCents] = velocity;
+        }
+    }
+}
+
+bool AudioPluginAudioProcessor::popManualNoteEvent(ManualNoteEvent &event, int &sample,
+                                                   int numSamples, double sampleRate) {
+    if (!manualNoteEvents.pop(event)) {
+        firstManualNoteEventMs = -1.0;
+        return false;
+    }
+    if (firstManualNoteEventMs < 0.0) {
+        firstManualNoteEventMs = event.timeMs;
+    }
+    sample = juce::jlimit(
+        0, numSamples - 1,
+        static_cast<int>((event.timeMs - firstManualNoteEventMs) * sampleRate / 1000.0));
+    if (event.isRecorded || !event.isNoteOn) {
+        recordPlayedNote(event.totalCents, event.totalCents, event.velocity, event.isNoteOn,
+                         sample);
+    }
+    return true;
+}
+
+void AudioPluginAudioProcessor::updateRecording(double playHeadTime, double barsInBlock,
+                                                double barsToSchedule, int numSamples,
+                                                bool isPlaying, bool playheadJumped) {
+    const bool isRecording = params.recordManuallyPlayedNotes.load();
+    if (isRecording && !wasRecordingPlayedNotes) {
+        // New take (previous one was taken by editor or is discarded)
+        recordedTake.clear();
+    }
+    wasRecordingPlayedNotes = isRecording;
+    if (!isRecording) {
+        // Editor itself ends notes that were held when recording was turned off
+        recordingNotes.clear();
+    } else if (!isPlaying) {
+        if (!recordingNotes.empty()) {
+            cutRecordingNotes(recordingEndTime, false, 0.0);
+        }
+    } else if (playheadJumped) {
+        cutRecordingNotes(recordingEndTime, true, playHeadTime);
+    }
+
+    isRecordingBlock = isRecording && isPlaying;
+    recordingBlockTime = playHeadTime;
+    recordingBarsInBlock = barsInBlock;
+    recordingNumSamples = numSamples;
+    if (isPlaying) {
+        // Notes after the loop end aren't played, so held notes are cut there
+        recordingEndTime = playHeadTime + barsToSchedule;
+    }
+
+    // Deferred events were recorded in the block they came in
+    for (int k = numDeferredLiveInputEvents; k < numLiveInputEvents; ++k) {
+        const LiveInputEvent &event = liveInputEvents[k];
+        recordPlayedNote(liveInputRecordId(event.inputNote), event.totalCents, event.velocity,
+                         event.isNoteOn, event.sample);
     }
 }
 
-const std::vector<Note> &AudioPluginAudioProcessor::getNotes() { return notes; }
+void AudioPluginAudioProcessor::recordPlayedNote(int id, int totalCents, float velocity,
+                                                 bool isNoteOn, int sample) {
+    if (!isRecordingBlock) {
+        return;
+    }
+    const double time =
+        recordingBlockTime + recordingBarsInBlock * sample / std::max(1, recordingNumSamples);
+    auto it = recordingNotes.find(id);
+    if (isNoteOn) {
+        if (it != recordingNotes.end() || recordingNotes.full() ||
+            recordedTake.size() == maxRecordedNotes) {
+            return;
+        }
+        recordingNotes.insert(id, {totalCents, velocity, recordedTake.size()});
+        startTakeNote(totalCents, velocity, time);
+        // If editor doesn't pop events (closed), only the progress isn't shown
+        recordedNoteEvents.push({id, totalCents, velocity, true, time});
+    } else if (it != recordingNotes.end()) {
+        endTakeNote(it->second.takeInd, time);
+        recordedNoteEvents.push({id, it->second.totalCents, 0.0f, false, time});
+        recordingNotes.erase(it);
+    }
+}
+
+void AudioPluginAudioProcessor::cutRecordingNotes(double time, bool restart, double newTime) {
+    for (const auto &[id, note] : recordingNotes) {
+        endTakeNote(note.takeInd, time);
+        recordedNoteEvents.push({id, note.totalCents, 0.0f, false, time});
+    }
+    if (!restart) {
+        recordingNotes.clear();
+        return;
+    }
+    for (auto it = recordingNotes.begin(); it != recordingNotes.end();) {
+        if (recordedTake.size() == maxRecordedNotes) {
+            it = recordingNotes.erase(it);
+            continue;
+        }
+        it->second.takeInd = recordedTake.size();
+        startTakeNote(it->second.totalCents, it->second.velocity, newTime);
+        recordedNoteEvents.push(
+            {it->first, it->second.totalCents, it->second.velocity, true, newTime});
+        ++it;
+    }
+}
+
+void AudioPluginAudioProcessor::startTakeNote(int totalCents, float velocity, double time) {
+    // Held note isn't selected, like in the editor
+    recordedTake.emplace_back(totalCents / 1200, totalCents % 1200, static_cast<float>(time),
+                              false, 0.0f, velocity);
+}
+
+void AudioPluginAudioProcessor::endTakeNote(size_t takeInd, double time) {
+    Note &note = recordedTake[takeInd];
+    note.duration = std::max(0.0f, static_cast<float>(time) - note.time);
+    note.isSelected = true;
+}
+
+std::vector<Note> AudioPluginAudioProcessor::takeRecordedNotes() {
+    std::vector<Note> take;
+    take.reserve(maxRecordedNotes);
+    {
+        // processBlock() doesn't execute, so nothing is appended to the take
+        std::scoped_lock lock(changeInstanceSyncMutex);
+        std::swap(take, recordedTake);
+        // Notes that are still held are ended by editor
+        recordingNotes.clear();
+    }
+    return take;
+}
+
+NotesSnapshotPtr AudioPluginAudioProcessor::getNotesSnapshot() { return notesPublisher.get(); }
 
 std::vector<Note> AudioPluginAudioProcessor::getOtherInstancesNotes() {
     if (params.getTuningType() == Parameters::TuningType::MPE) {
@@ -1937,102 +2643,366 @@ std::vector<Note> AudioPluginAudioProcessor::getOtherInstancesNotes() {
 float AudioPluginAudioProcessor::getPlayHeadTime() { return static_cast<float>(playHeadTime); }
 
 double AudioPluginAudioProcessor::getNoteFreq(const Note &note) {
-    float dBend = 0.0f;
-    if ((note.bend != 0) && (note.time < playHeadTime) &&
-        (playHeadTime <= note.time + note.duration))
-        dBend = note.bend * (playHeadTime - note.time) / note.duration;
-    double dCents = (note.octave * 1200 + note.cents + dBend) - (4 * 1200 + 900);
-    return params.A4Freq.load() * pow(2.0, dCents / 1200.0);
+    return params.A4Freq.load() * centsToRatio(getNoteCentsFromA4(note, playHeadTime));
 }
 
 double AudioPluginAudioProcessor::getNoteFreqAtTime(const Note &note, double time) {
-    double dBend = 0.0f;
+    return params.A4Freq.load() * centsToRatio(getNoteCentsFromA4(note, time));
+}
+
+double AudioPluginAudioProcessor::getNoteCentsFromA4(const Note &note, double time) {
+    double dBend = 0.0;
     if ((note.bend != 0) && (note.time < time) && (time <= note.time + note.duration))
         dBend = note.bend * (time - note.time) / note.duration;
-    double dCents = (note.octave * 1200 + note.cents + dBend) - (4 * 1200 + 900);
-    return params.A4Freq.load() * std::pow(2.0, dCents / 1200.0);
+    return (note.octave * 1200 + note.cents + dBend) - (4 * 1200 + 900);
 }
 
 double AudioPluginAudioProcessor::getFreqFromTotalCents(float totalCents) {
     double dCents = totalCents - (4 * 1200 + 900);
-    return params.A4Freq.load() * pow(2.0, dCents / 1200.0);
+    return params.A4Freq.load() * centsToRatio(dCents);
 }
 
 int AudioPluginAudioProcessor::getTotalCentsFromFreq(double freq) {
-    return juce::roundToInt(1200 * log2(freq / params.A4Freq.load()) + (4 * 1200 + 900));
+    return juce::roundToInt(ratioToCents(freq / params.A4Freq.load()) + (4 * 1200 + 900));
 }
 
-void AudioPluginAudioProcessor::prepareNotes() {
+void AudioPluginAudioProcessor::prepareNotes(bool onlyChanges) {
     std::scoped_lock lock(prepareNotesMutex);
     pitchesOverflow = false;
     editorKnowsAboutOverflow = false;
 
     if (params.getTuningType() == Parameters::TuningType::MPE) {
+        // A4 frequency may change meanwhile, so next time prepare everything
+        notesPreparedMTS = false;
         return;
     }
 
-    // Notes from piano roll
-    // some cleaning
-    notesIndexes.clear();
-    notesIndexes.resize(notes.size());
-    int numUsedFreqs = static_cast<int>(currPlayedNotesIndexes.size());
-    for (int i = 0; i < 128; ++i) {
-        if (!currPlayedNotesIndexes.contains(i)) {
-            freqs[i] = noFreq;
+    const bool prepareAll = !onlyChanges || !notesPreparedMTS;
+    if (prepareAll) {
+        prepareAllNotesMTS();
+    } else {
+        prepareChangedNotesMTS();
+    }
+    notesPreparedMTS = true;
+    // So processBlock() doesn't allocate
+    bendingNotesFreqs.reserve(preparedNotes->getBendSchedule().size());
+
+    // Retuned midi notes get their new frequencies. If everything was prepared, other midi notes
+    //   also keep their last frequencies (for residual sound), but not bends
+    for (int i = 0; i < freqSlotsManagerMTS.getNumSlots(); ++i) {
+        if (!currPlayedNotesIndexes[i] &&
+            (prepareAll || freqSlotsManagerMTS.isRetuned(i))) {
+            freqs[i] = freqSlotsManagerMTS.getFreq(i, noFreq);
         }
     }
+    const bool needUpdateFreqs = prepareAll || freqSlotsManagerMTS.anyRetuned();
+    freqSlotsManagerMTS.clearRetuned();
+
+    if (needUpdateFreqs && !params.findPartialsMode.load())
+        updateFreqsMTS();
+}
+
+void AudioPluginAudioProcessor::prepareAllNotesMTS() {
+    // Notes from piano roll
+    preparedNotes = notesPublisher.get();
+    const std::vector<Note> &notes = preparedNotes->getNotes();
+    freqSlotsManagerMTS.releaseAll();
 
     // set midi notes (indexes) for notes from piano roll
-    int noteIndNew = 0;
-    {
-        std::scoped_lock lock(notesMutex);
+    notesIndexes.assign(notes.size(), -1);
+    for (int i = 0; i < notes.size(); ++i) {
+        notesIndexes[i] = acquireFreqSlotMTS(getNoteFreq(notes[i]));
+    }
+
+    // Manually played notes (and notes from midi input) are playing, so their slots keep
+    //   frequencies
+    for (const auto &[_, noteInd] : manPlNoteToMidiNoteMTS) {
+        freqSlotsManagerMTS.retain(noteInd);
+    }
+    for (const auto &[_, noteInd] : liveInputNotesMTS) {
+        freqSlotsManagerMTS.retain(noteInd);
+    }
+}
+
+void AudioPluginAudioProcessor::prepareChangedNotesMTS() {
+    // Notes from piano roll
+    NotesSnapshotPtr newNotes = notesPublisher.get();
+    if (newNotes != preparedNotes) {
+        const std::vector<Note> &oldNotes = preparedNotes->getNotes();
+        const std::vector<Note> &notes = newNotes->getNotes();
+        std::vector<int> newNotesIndexes(notes.size(), -1);
+        std::vector<bool> oldNoteKept(oldNotes.size(), false);
+
+        // Bent notes get frequency at the playhead, so for them time matters too
+        auto haveSamePitch = [](const Note &a, const Note &b) {
+            return a.octave == b.octave && a.cents == b.cents && a.bend == b.bend &&
+                   (a.bend == 0 || (a.time == b.time && a.duration == b.duration));
+        };
+
+        // Notes which pitch wasn't changed keep their midi notes
         for (int i = 0; i < notes.size(); ++i) {
-            const Note &note = notes[i];
-            double noteFreq = getNoteFreq(note);
-            int noteInd = findFreqInd(noteFreq);
-            if (noteInd == -1) {
-                if (numUsedFreqs >= 128) {
-                    pitchesOverflow = true;
-                    return;
-                }
-                while (freqs[noteIndNew] != noFreq)
-                    noteIndNew++;
-                noteInd = noteIndNew;
-                freqs[noteInd] = noteFreq;
-                numUsedFreqs++;
+            const Note *oldNote = preparedNotes->findNote(notes[i].id);
+            if (oldNote == nullptr) {
+                continue;
+            }
+            const size_t j = oldNote - oldNotes.data();
+            if (notesIndexes[j] != -1 && haveSamePitch(*oldNote, notes[i])) {
+                newNotesIndexes[i] = notesIndexes[j];
+                oldNoteKept[j] = true;
             }
-            notesIndexes[i] = noteInd;
         }
+        // Removed and changed notes release their midi notes first, so they can be reused
+        for (size_t j = 0; j < oldNotes.size(); ++j) {
+            if (!oldNoteKept[j] && notesIndexes[j] != -1) {
+                freqSlotsManagerMTS.release(notesIndexes[j]);
+            }
+        }
+        // New and changed notes (and notes that didn't get midi note because of overflow)
+        for (int i = 0; i < notes.size(); ++i) {
+            if (newNotesIndexes[i] == -1) {
+                newNotesIndexes[i] = acquireFreqSlotMTS(getNoteFreq(notes[i]));
+            }
+        }
+
+        preparedNotes = std::move(newNotes);
+        notesIndexes = std::move(newNotesIndexes);
     }
+}
 
-    // Manually played notes
-    // make notes from manuallyPlayedNotes, that are not in piano roll, relevant
+int AudioPluginAudioProcessor::startLiveVoiceMTS(int totalCents, float velocity,
+                                                 juce::MidiBuffer &midiMessages, int sample,
+                                                 bool &needUpdateFreqs) {
+    const double noteFreq = getFreqFromTotalCents(totalCents);
+    const bool isRetuned = findFreqInd(noteFreq) == -1;
+    const int noteInd = acquireFreqSlotMTS(noteFreq);
+    if (noteInd == -1) {
+        return -1;
+    }
+    if (isRetuned) {
+        freqs[noteInd] = noteFreq;
+        beforeBendTotalCents[noteInd] = -1;
+        needUpdateFreqs = true;
+    }
+    juce::MidiMessage noteOn = noteOnMTS(noteInd, velocity);
+    midiMessages.addEvent(noteOn, sample);
+    currPlayedNotesIndexes[noteInd] = true;
+    return noteInd;
+}
+
+void AudioPluginAudioProcessor::stopLiveVoiceMTS(int slot, juce::MidiBuffer &midiMessages,
+                                                 int sample) {
+    juce::MidiMessage noteOff = noteOffMTS(slot);
+    midiMessages.addEvent(noteOff, sample);
+    currPlayedNotesIndexes[slot] = false;
+    freqSlotsManagerMTS.release(slot);
+}
+
+int AudioPluginAudioProcessor::acquireFreqSlotMTS(double freq) {
+    // Midi notes that are playing now keep their frequencies
+    int noteInd = freqSlotsManagerMTS.acquire(
+        freq, [this](int noteInd) { return currPlayedNotesIndexes[noteInd]; });
+    if (noteInd == -1) {
+        pitchesOverflow = true;
+    }
+    return noteInd;
+}
+
+void AudioPluginAudioProcessor::changedNumChannelsMTS() {
+    if (params.getTuningType() != Parameters::TuningType::MTS_ESP || !isActive) {
+        return;
+    }
     {
-        std::scoped_lock lock(manPlNotesMutex);
-        for (const auto &[totalCents, _] : manuallyPlayedNotes) {
-            double noteFreq = getFreqFromTotalCents(totalCents);
-            int noteInd = findFreqInd(noteFreq);
-            if (noteInd == -1) {
-                manPlNotesTotCentsHistory.add(noteFreq);
+        std::scoped_lock lock(prepareNotesMutex);
+        applyNumChannelsMTS();
+    }
+    // Notes get slots in new channels (and lose slots of released channels)
+    prepareNotes();
+}
+
+void AudioPluginAudioProcessor::applyNumChannelsMTS() {
+    if (pluginInstanceManager == nullptr || !pluginInstanceManager->getIsActive()) {
+        freqSlotsManagerMTS.setNumSlots(FreqSlotsManagerMTS::slotsPerChannel);
+        return;
+    }
+    const std::vector<int> claimed =
+        pluginInstanceManager->claimExtraChannels(params.numChannelsMTS.load() - 1);
+    std::copy(claimed.begin(), claimed.end(), extraChannelsMTS.begin());
+    freqSlotsManagerMTS.setNumSlots(FreqSlotsManagerMTS::slotsPerChannel *
+                                    (1 + static_cast<int>(claimed.size())));
+}
+
+juce::MidiMessage AudioPluginAudioProcessor::noteOnMTS(int slot, float velocity) const {
+    const int k = slot / FreqSlotsManagerMTS::slotsPerChannel;
+    const int chInd = (k == 0) ? params.channelIndex : extraChannelsMTS[k - 1];
+    return juce::MidiMessage::noteOn(chInd + 1, slot % FreqSlotsManagerMTS::slotsPerChannel,
+                                     velocity);
+}
+
+juce::MidiMessage AudioPluginAudioProcessor::noteOffMTS(int slot) const {
+    const int k = slot / FreqSlotsManagerMTS::slotsPerChannel;
+    const int chInd = (k == 0) ? params.channelIndex : extraChannelsMTS[k - 1];
+    return juce::MidiMessage::noteOff(chInd + 1, slot % FreqSlotsManagerMTS::slotsPerChannel);
+}
+
+void AudioPluginAudioProcessor::updateFreqsMTS() { freqsChangedMTS = true; }
+
+template <Parameters::TuningType tuningType>
+void AudioPluginAudioProcessor::publishFreqsMTS(juce::MidiBuffer &midiMessages) {
+    if constexpr (tuningType == Parameters::MTS_SYSEX) {
+        // Tuning changes are midi messages of the block
+        sendFreqsSysEx(freqs, midiMessages);
+    } else {
+        if (!freqsChangedMTS) {
+            return;
+        }
+        freqsChangedMTS = false;
+        pluginInstanceManager->updateFreqs(freqs, freqSlotsManagerMTS.getNumSlots() /
+                                                      FreqSlotsManagerMTS::slotsPerChannel);
+    }
+}
+
+void AudioPluginAudioProcessor::sendFreqsSysEx(const double *newFreqs,
+                                               juce::MidiBuffer &midiMessages) {
+    if (!freqsChangedMTS) {
+        return;
+    }
+    // Events are merged into a buffer that has room for them (without allocating), then it's
+    //   swapped with midiMessages. Buffer of the host is taken in exchange, so if the host
+    //   reuses its buffer, the next block gets back the one we have given
+    const int neededSize = midiMessages.data.size() + maxSysExBytesPerBlock;
+    juce::MidiBuffer *sysExMidiBuffer = nullptr;
+    for (juce::MidiBuffer &buffer : sysExMidiBuffers) {
+        if (buffer.data.capacity() >= neededSize) {
+            sysExMidiBuffer = &buffer;
+            break;
+        }
+    }
+    if (sysExMidiBuffer == nullptr) {
+        return;
+    }
+    freqsChangedMTS = false;
+
+    // Sample of the first note on of each key, -1 if there is none (raw bytes are read, so
+    //   host's SysEx isn't copied)
+    constexpr int numKeys = FreqSlotsManagerMTS::slotsPerChannel;
+    std::array<int, numKeys> firstNoteOnSample;
+    firstNoteOnSample.fill(-1);
+    const uint8_t noteOnStatus = static_cast<uint8_t>(0x90 | params.channelIndex);
+    for (const auto metadata : midiMessages) {
+        const uint8_t *data = metadata.data;
+        if (metadata.numBytes == 3 && data[0] == noteOnStatus && data[2] != 0 &&
+            firstNoteOnSample[data[1]] == -1) {
+            firstNoteOnSample[data[1]] = metadata.samplePosition;
+        }
+    }
+
+    // Changed keys as (sample, key), in order of samples
+    std::array<std::pair<int, uint8_t>, numKeys> changes;
+    int numChanges = 0;
+    for (int key = 0; key < numKeys; ++key) {
+        // Unused midi notes (noFreq) keep their last tuning
+        if (newFreqs[key] == sentFreqsSysEx[key] || newFreqs[key] == noFreq) {
+            continue;
+        }
+        changes[numChanges++] = {std::max(0, firstNoteOnSample[key]), static_cast<uint8_t>(key)};
+        sentFreqsSysEx[key] = newFreqs[key];
+    }
+    if (numChanges == 0) {
+        return;
+    }
+    std::sort(changes.begin(), changes.begin() + numChanges);
+
+    // Tuning messages are merged with events of the block, keys of one sample share a message
+    sysExMidiBuffer->clear();
+    uint8_t keys[tuning_sysex::maxChangesPerMessage];
+    double keysFreqs[tuning_sysex::maxChangesPerMessage];
+    int nextChange = 0;
+    auto addMessagesUpTo = [&](int sample) {
+        while (nextChange < numChanges && changes[nextChange].first <= sample) {
+            const int messageSample = changes[nextChange].first;
+            int numKeysInMessage = 0;
+            while (nextChange < numChanges && changes[nextChange].first == messageSample &&
+                   numKeysInMessage < tuning_sysex::maxChangesPerMessage) {
+                keys[numKeysInMessage] = changes[nextChange].second;
+                keysFreqs[numKeysInMessage] = newFreqs[changes[nextChange].second];
+                ++numKeysInMessage;
+                ++nextChange;
             }
+            const int size = tuning_sysex::writeSingleNoteTuningChange(
+                sysExData.data(), keys, keysFreqs, numKeysInMessage);
+            sysExMidiBuffer->addEvent(sysExData.data(), size, messageSample);
         }
+    };
+    for (const auto metadata : midiMessages) {
+        addMessagesUpTo(metadata.samplePosition);
+        sysExMidiBuffer->addEvent(metadata.data, metadata.numBytes, metadata.samplePosition);
     }
-    // add to freqs[128] mostly relevant manually played notes that are not in freqs[128] array
-    std::vector<double> manPlNotesTotCentsHistoryLast =
-        manPlNotesTotCentsHistory.getLast(juce::jmax(128 - numUsedFreqs, 0));
-    for (int i = 0; i < manPlNotesTotCentsHistoryLast.size(); ++i) {
-        while (freqs[noteIndNew] != noFreq)
-            noteIndNew++;
-        if (noteIndNew >= 128) {
-            pitchesOverflow = true;
-            return;
+    addMessagesUpTo(std::numeric_limits<int>::max());
+
+    midiMessages.swapWith(*sysExMidiBuffer);
+}
+
+int AudioPluginAudioProcessor::allocateChannelMPE(int bendMPE, bool noteWithBend, int totalCents,
+                                                  float velocity, juce::MidiBuffer &midiMessages,
+                                                  int sample, VoicesMPE *voices) {
+    auto [ch, isStolen] =
+        channelsManagerMPE->allocateChannelMPE(bendMPE, noteWithBend, totalCents, velocity);
+    if (isStolen) {
+        silenceChannelMPE(ch, midiMessages, sample);
+    }
+    // In economy mode table of the channel can be full, then it's like there are no free channels
+    if ((ch != -1) && (voices != nullptr) && !voices->canInsert(ch)) {
+        channelsManagerMPE->noteReleasedMPE(ch);
+        return -1;
+    }
+    return ch;
+}
+
+void AudioPluginAudioProcessor::silenceChannelMPE(int ch, juce::MidiBuffer &midiMessages,
+                                                  int sample) {
+    for (auto *voices : {&playingNotesMPE, &auditioningNotesMPE}) {
+        voices->silenceChannel(ch, [&](const VoicesMPE::Voice &noteData) {
+            midiMessages.addEvent(juce::MidiMessage::noteOff(ch, noteData.midiNote), sample);
+            delCurrPlayedNotesTotalCentsMPE(noteData.totalCents);
+        });
+    }
+    for (auto *voices : {&manPlNoteToChAndMidiNoteMPE, &liveInputNotesMPE}) {
+        for (auto &[_, chAndMidiNote] : *voices) {
+            if (chAndMidiNote.first == ch) {
+                midiMessages.addEvent(juce::MidiMessage::noteOff(ch, chAndMidiNote.second),
+                                      sample);
+                chAndMidiNote.first = -1;
+            }
         }
-        freqs[noteIndNew] = manPlNotesTotCentsHistoryLast[i];
-        numUsedFreqs++;
     }
+}
 
-    if (!params.findPartialsMode.load())
-        pluginInstanceManager->updateFreqs(freqs);
+std::pair<int, int> AudioPluginAudioProcessor::startLiveVoiceMPE(int totalCents, float velocity,
+                                                                 juce::MidiBuffer &midiMessages,
+                                                                 int sample) {
+    auto [midiNote, bendMPE] = calcMidiNoteAndBendMPE(totalCents);
+    int ch = allocateChannelMPE(bendMPE, false, totalCents, velocity, midiMessages, sample);
+    if (ch == -1) {
+        pitchesOverflow = true;
+        return {-1, midiNote};
+    }
+    pitchesOverflow = false;
+    juce::MidiMessage pitchBend = juce::MidiMessage::pitchWheel(ch, bendMPE);
+    midiMessages.addEvent(pitchBend, sample);
+    juce::MidiMessage noteOn = juce::MidiMessage::noteOn(ch, midiNote, velocity);
+    midiMessages.addEvent(noteOn, sample);
+    return {ch, midiNote};
+}
+
+void AudioPluginAudioProcessor::stopLiveVoiceMPE(std::pair<int, int> chAndMidiNote,
+                                                 juce::MidiBuffer &midiMessages, int sample) {
+    const auto [ch, midiNote] = chAndMidiNote;
+    if (ch == -1) {
+        return;
+    }
+    juce::MidiMessage noteOff = juce::MidiMessage::noteOff(ch, midiNote);
+    midiMessages.addEvent(noteOff, sample);
+    channelsManagerMPE->noteReleasedMPE(ch);
 }
 
 std::tuple<float, int, int> AudioPluginAudioProcessor::getBpmNumDenom() {
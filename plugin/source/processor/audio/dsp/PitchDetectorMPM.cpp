@@ -1,26 +1,82 @@
 #include "XenRoll/processor/audio/dsp/PitchDetectorMPM.h"
 #include <algorithm>
 #include <cmath>
+#include <complex>
 #include <limits>
 
 namespace audio_plugin {
 
-PitchDetectorMPM::PitchDetectorMPM(int fftSize)
-    : fftSize(fftSize), minVoiceFreq(70.0f), maxVoiceFreq(1500.0f), peakCount(0) {
+PitchDetectorMPM::PitchDetectorMPM(int windowSize)
+    : windowSize(windowSize), fftSize(windowSize), minVoiceFreq(70.0f), maxVoiceFreq(1500.0f),
+      peakCount(0) {
+    // Full rate analysis doesn't depend on sample rate, so it's ready without prepare()
+    prepare(0.0);
+}
+
+PitchDetectorMPM::~PitchDetectorMPM() {}
+
+void PitchDetectorMPM::prepare(double sampleRate) {
+    if (analysisMode == AnalysisMode::Decimated && sampleRate > 0) {
+        decimationFactor = std::max(1, static_cast<int>(sampleRate / minDecimatedRate));
+        analysisRate = sampleRate / decimationFactor;
+
+        // Window must contain a few periods of the lowest voice frequency, but it can't be
+        //   longer than windowSize input samples
+        const double minWindowSize = minPeriodsInWindow * analysisRate / minVoiceFreq;
+        const int maxFFTSize = juce::nextPowerOfTwo(windowSize / decimationFactor + 1) / 2;
+        fftSize = juce::nextPowerOfTwo(static_cast<int>(std::ceil(minWindowSize)));
+        fftSize = juce::jlimit(std::min(64, maxFFTSize), maxFFTSize, fftSize);
+
+        // Windowed sinc, cutoff is below decimated Nyquist so aliases fall above it
+        const int numTaps = 12 * decimationFactor + 1;
+        const double cutoff = 0.35 / decimationFactor; // relative to host sample rate
+        antiAliasTaps.resize(numTaps);
+        juce::dsp::WindowingFunction<float>::fillWindowingTables(
+            antiAliasTaps.data(), numTaps, juce::dsp::WindowingFunction<float>::blackman, false);
+        float sum = 0.0f;
+        for (int k = 0; k < numTaps; ++k) {
+            const double x = k - numTaps / 2;
+            const double sinc = (x == 0) ? 2.0 * cutoff
+                                         : std::sin(2.0 * juce::MathConstants<double>::pi *
+                                                    cutoff * x) /
+                                               (juce::MathConstants<double>::pi * x);
+            antiAliasTaps[k] *= static_cast<float>(sinc);
+            sum += antiAliasTaps[k];
+        }
+        juce::FloatVectorOperations::multiply(antiAliasTaps.data(), 1.0f / sum, numTaps);
+        inputBuffer.resize(fftSize * decimationFactor + numTaps);
+    } else {
+        decimationFactor = 1;
+        analysisRate = sampleRate;
+        fftSize = windowSize;
+        std::vector<float>().swap(antiAliasTaps);
+        std::vector<float>().swap(inputBuffer);
+    }
+    preparedSampleRate = (analysisMode == AnalysisMode::Decimated) ? sampleRate : 0.0;
+
     // Initialize FFT
-    fft = std::make_unique<juce::dsp::FFT>(static_cast<int>(std::log2(fftSize)));
+    if (!fft || fft->getSize() != fftSize) {
+        fft = std::make_unique<juce::dsp::FFT>(static_cast<int>(std::log2(fftSize)));
 
-    // Initialize window (Hann window)
-    window = std::make_unique<juce::dsp::WindowingFunction<float>>(
-        fftSize, juce::dsp::WindowingFunction<float>::hann);
+        // Initialize window (Hann window)
+        window = std::make_unique<juce::dsp::WindowingFunction<float>>(
+            fftSize, juce::dsp::WindowingFunction<float>::hann);
+    }
 
     // Allocate buffers (pre-allocated to avoid real-time allocations)
-    fftBuffer.resize(fftSize * 2);
-    nsdfBuffer.resize(fftSize);
+    fftBuffer.assign(fftSize * 2, 0.0f);
+    nsdfBuffer.assign(fftSize, 0.0f); // only the first half is calculated, the rest stays 0
     peakBuffer.resize(fftSize / 2); // Maximum possible peaks
+    peakCount = 0;
 }
 
-PitchDetectorMPM::~PitchDetectorMPM() {}
+size_t PitchDetectorMPM::getMemoryUsage() const {
+    return (fftBuffer.capacity() + nsdfBuffer.capacity() + antiAliasTaps.capacity() +
+            inputBuffer.capacity()) *
+               sizeof(float) +
+           peakBuffer.capacity() * sizeof(int) + fftSize * sizeof(float) + // window
+           fftSize * sizeof(std::complex<float>);                          // FFT
+}
 
 void PitchDetectorMPM::resetJumpsDetection() {
     prevPitch = 0.0f;
@@ -38,62 +94,94 @@ void PitchDetectorMPM::reset() {
 void PitchDetectorMPM::setVoiceRange(float minFreq, float maxFreq) {
     minVoiceFreq = minFreq;
     maxVoiceFreq = maxFreq;
+    preparedSampleRate = -1.0;
 }
 
-const std::vector<float> &PitchDetectorMPM::calculateNSDF(const std::vector<float> &audioBuffer) {
-    const int bufferSize = static_cast<int>(audioBuffer.size());
-    const int nsdfSize = bufferSize / 2;
+void PitchDetectorMPM::copyInput(const float *firstPart, int firstSize, const float *secondPart,
+                                 int secondSize) {
+    const int numFirst = std::min(firstSize, fftSize);
+    const int numSecond = std::min(secondSize, fftSize - numFirst);
+    std::copy(firstPart, firstPart + numFirst, fftBuffer.begin());
+    if (numSecond > 0) {
+        std::copy(secondPart, secondPart + numSecond, fftBuffer.begin() + numFirst);
+    }
+    std::fill(fftBuffer.begin() + numFirst + numSecond, fftBuffer.end(), 0.0f);
+}
 
-    // Calculate autocorrelation using FFT
-    // Copy audio data to FFT buffer and apply window
-    std::copy(audioBuffer.begin(), audioBuffer.begin() + std::min(bufferSize, fftSize),
-              fftBuffer.begin());
-    std::fill(fftBuffer.begin() + std::min(bufferSize, fftSize), fftBuffer.end(), 0.0f);
+void PitchDetectorMPM::decimateInput(const float *firstPart, int firstSize,
+                                     const float *secondPart, int secondSize) {
+    // Newest samples that fit into the window go to inputBuffer (missing ones are zeros), with
+    //   half of the filter length of zeros before and after them
+    const int numTaps = static_cast<int>(antiAliasTaps.size());
+    const int halfTaps = numTaps / 2;
+    const int numInput = fftSize * decimationFactor;
+    const int numSecond = std::min(secondSize, numInput);
+    const int numFirst = std::min(firstSize, numInput - numSecond);
+    float *input = inputBuffer.data();
+    const int numZeros = halfTaps + numInput - numFirst - numSecond;
+    juce::FloatVectorOperations::clear(input, numZeros);
+    juce::FloatVectorOperations::copy(input + numZeros, firstPart + firstSize - numFirst,
+                                      numFirst);
+    juce::FloatVectorOperations::copy(input + numZeros + numFirst, secondPart, numSecond);
+    juce::FloatVectorOperations::clear(input + numZeros + numFirst + numSecond, halfTaps);
+
+    // Every output sample is independent, so the inner loop over them is vectorised
+    float *output = fftBuffer.data();
+    juce::FloatVectorOperations::clear(output, fftSize * 2);
+    for (int k = 0; k < numTaps; ++k) {
+        const float tap = antiAliasTaps[k];
+        const float *in = input + k;
+        for (int m = 0; m < fftSize; ++m) {
+            output[m] += tap * in[m * decimationFactor];
+        }
+    }
+}
 
+const std::vector<float> &PitchDetectorMPM::calculateNSDF() {
+    const int nsdfSize = fftSize / 2;
+    float *data = fftBuffer.data();
+
+    // Calculate autocorrelation using FFT
     // Apply window
-    window->multiplyWithWindowingTable(fftBuffer.data(), fftSize);
+    window->multiplyWithWindowingTable(data, fftSize);
 
-    // Perform FFT
-    fft->performRealOnlyForwardTransform(fftBuffer.data(), false);
+    // Perform FFT (negative frequencies aren't needed for real signal)
+    fft->performRealOnlyForwardTransform(data, true);
 
     // Compute autocorrelation by multiplying each frequency bin by its complex conjugate
-    // and applying FFT normalization scale factor
+    // and applying FFT normalization scale factor.
+    // (a + bi) * (a - bi) = a^2 + b^2 gives us the power spectrum, which is the frequency-domain
+    // autocorrelation. Imaginary part is zero for real autocorrelation. Loop has no branches, so
+    // it's vectorised
     const float scale = 1.0f / static_cast<float>(fftSize);
-    for (int i = 0; i < fftSize / 2 + 1; ++i) {
-        int reIdx = 2 * i;
-        int imIdx = reIdx + 1;
-        float real = fftBuffer[reIdx];
-        float imag = fftBuffer[imIdx];
-
-        // Multiply by complex conjugate: (a + bi) * (a - bi) = a^2 + b^2
-        // This gives us the power spectrum, which is the frequency-domain autocorrelation
-        fftBuffer[reIdx] = (real * real + imag * imag) * scale;
-        fftBuffer[imIdx] = 0.0f; // Imaginary part is zero for real autocorrelation
+    const int numBins = fftSize / 2 + 1;
+    for (int i = 0; i < numBins; ++i) {
+        const float real = data[2 * i];
+        const float imag = data[2 * i + 1];
+        data[2 * i] = (real * real + imag * imag) * scale;
+        data[2 * i + 1] = 0.0f;
     }
 
     // Inverse FFT to get autocorrelation
-    fft->performRealOnlyInverseTransform(fftBuffer.data());
+    fft->performRealOnlyInverseTransform(data);
 
     // Calculate NSDF (Normalized Square Difference Function)
     // NSDF(tau) = 2 * R(tau) / (R(0) + R(tau))
     // where R is autocorrelation
-    float r0 = fftBuffer[0]; // Autocorrelation at lag 0
+    const float r0 = data[0]; // Autocorrelation at lag 0
+    float *nsdf = nsdfBuffer.data();
 
     if (r0 < 1e-10f) {
         // Return zeros if signal is too weak
-        std::fill(nsdfBuffer.begin(), nsdfBuffer.begin() + nsdfSize, 0.0f);
+        juce::FloatVectorOperations::clear(nsdf, nsdfSize);
         return nsdfBuffer;
     }
 
+    // Select instead of branch, so it's vectorised
     for (int tau = 0; tau < nsdfSize; ++tau) {
-        float rTau = fftBuffer[tau];
-        float denominator = r0 + rTau;
-
-        if (std::abs(denominator) < 1e-10f) {
-            nsdfBuffer[tau] = 0.0f;
-        } else {
-            nsdfBuffer[tau] = 2.0f * rTau / denominator;
-        }
+        const float rTau = data[tau];
+        const float denominator = r0 + rTau;
+        nsdf[tau] = (std::abs(denominator) < 1e-10f) ? 0.0f : 2.0f * rTau / denominator;
     }
 
     return nsdfBuffer;
@@ -145,11 +233,8 @@ const std::vector<int> &PitchDetectorMPM::peakPicking(const std::vector<float> &
         peakBuffer[peakCount++] = curMaxPos;
     }
 
-    // Resize to actual number of peaks (this is cheap since we're shrinking)
-    // Note: In a real-time critical path, we could avoid this by tracking the count separately
-    // but for simplicity and correctness, we keep the resize
-    peakBuffer.resize(peakCount);
-
+    // Buffer isn't resized (it would lose space for peaks of the next windows), only the first
+    //   peakCount positions are valid
     return peakBuffer;
 }
 
@@ -178,18 +263,38 @@ std::pair<float, float> PitchDetectorMPM::parabolicInterpolation(const std::vect
 
 float PitchDetectorMPM::detectPitch(const std::vector<float> &audioBuffer, double sampleRate,
                                     bool wasSilence) {
-    if (audioBuffer.empty() || sampleRate <= 0) {
+    return detectPitch(audioBuffer.data(), static_cast<int>(audioBuffer.size()), nullptr, 0,
+                       sampleRate, wasSilence);
+}
+
+float PitchDetectorMPM::detectPitch(const float *firstPart, int firstSize,
+                                    const float *secondPart, int secondSize, double sampleRate,
+                                    bool wasSilence) {
+    if (firstSize + secondSize <= 0 || sampleRate <= 0) {
         resetJumpsDetection();
         return 0.0f;
     }
 
+    if (analysisMode == AnalysisMode::Decimated) {
+        if (sampleRate != preparedSampleRate) {
+            prepare(sampleRate);
+        }
+        decimateInput(firstPart, firstSize, secondPart, secondSize);
+    } else {
+        if (preparedSampleRate != 0.0 || !fft) {
+            prepare(0.0);
+        }
+        copyInput(firstPart, firstSize, secondPart, secondSize);
+    }
+    const double rate = sampleRate / decimationFactor;
+
     // Calculate NSDF (reuses nsdfBuffer)
-    const std::vector<float> &nsdf = calculateNSDF(audioBuffer);
+    const std::vector<float> &nsdf = calculateNSDF();
 
     // Find peaks (reuses peakBuffer)
     const std::vector<int> &maxPositions = peakPicking(nsdf);
 
-    if (maxPositions.empty()) {
+    if (peakCount == 0) {
         resetJumpsDetection();
         return 0.0f;
     }
@@ -245,7 +350,7 @@ float PitchDetectorMPM::detectPitch(const std::vector<float> &audioBuffer, doubl
     }
 
     // Calculate frequency
-    float pitchEstimate = static_cast<float>(sampleRate) / period;
+    float pitchEstimate = static_cast<float>(rate) / period;
 
     // Apply voice range filtering
     if (pitchEstimate < minVoiceFreq || pitchEstimate > maxVoiceFreq) {
@@ -1,55 +1,76 @@
 #include "XenRoll/processor/managers/NotesSharingMPE.h"
-#include <chrono>
-#include <future>
-#include <thread>
+#include <stdexcept>
 
 namespace audio_plugin {
 
-NotesSharingMPE::NotesSharingMPE(int id) {
-    std::promise<bool> initPromise;
-    auto initFuture = initPromise.get_future();
-
-    std::thread initThread([this, promise = std::move(initPromise), id]() mutable {
-        try {
-            initSharedMemory();
-            initInstance(id);
-            promise.set_value(true);
-        } catch (...) {
-            promise.set_exception(std::current_exception());
+NotesSharingMPE::NotesSharingMPE(int id, std::function<void()> initDoneCallback,
+                                 std::string namePrefix)
+    : onInitDone(std::move(initDoneCallback)), namePrefix(std::move(namePrefix)) {
+    initThread = std::thread(&NotesSharingMPE::initAll, this, id);
+}
+
+void NotesSharingMPE::initAll(int id) {
+    {
+        // Instances of this process are initialized one by one, so if the first one finds stuck
+        // mutexes of a crashed process (and removes them), next ones create new ones. Waiting
+        // for the turn is stopped if destructor aborts init
+        std::unique_lock processInitLock(processInitMutex, std::defer_lock);
+        while (!abortInit &&
+               !processInitLock.try_lock_for(std::chrono::milliseconds(processInitPollTime))) {
+        }
+        // If init was aborted while waiting, instance stays inactive
+        if (processInitLock.owns_lock()) {
+            initDeadline =
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(initTimeoutTime);
+            try {
+                initSharedMemory();
+                initInstance(id);
+            } catch (...) {
+                if (!abortInit) {
+                    performEmergencyCleanup();
+                }
+            }
         }
-    });
+    }
 
-    if (initFuture.wait_for(std::chrono::milliseconds(initTimeoutTime)) !=
-        std::future_status::ready) {
-        performEmergencyCleanup();
-        initThread.detach();
-    } else {
-        initThread.join();
-        try {
-            initFuture.get();
-        } catch (...) {
-            performEmergencyCleanup();
+    {
+        std::scoped_lock initLock(initMutex);
+        if (isActive && pendingInstanceId != -1) {
+            applyInstanceId(pendingInstanceId);
         }
+        isInitDone = true;
+    }
+    if (onInitDone && !abortInit) {
+        onInitDone();
+    }
+}
+
+void NotesSharingMPE::checkInitDeadline() const {
+    if (abortInit || std::chrono::steady_clock::now() > initDeadline) {
+        throw std::runtime_error("Init was aborted or took too long");
     }
 }
 
 void NotesSharingMPE::performEmergencyCleanup() {
-    bip::shared_memory_object::remove("NotesSharingMPESharedMemory");
-    bip::named_mutex::remove("NotesSharingMPEMutex");
+    bip::shared_memory_object::remove(sharedName("NotesSharingMPESharedMemory").c_str());
+    bip::named_mutex::remove(sharedName("NotesSharingMPEMutex").c_str());
     instanceId = -1;
     isActive = false;
 }
 
 void NotesSharingMPE::initSharedMemory() {
+    checkInitDeadline();
     bip::permissions perm;
     perm.set_unrestricted();
 
     const size_t totalSize = 2 * 1024 * 1024; // 2MB
 
     sharedMemory = std::make_unique<bip::managed_shared_memory>(
-        bip::open_or_create, "NotesSharingMPESharedMemory", totalSize, nullptr, perm);
+        bip::open_or_create, sharedName("NotesSharingMPESharedMemory").c_str(), totalSize,
+        nullptr, perm);
 
-    mutex = std::make_unique<bip::named_mutex>(bip::open_or_create, "NotesSharingMPEMutex");
+    mutex = std::make_unique<bip::named_mutex>(bip::open_or_create,
+                                               sharedName("NotesSharingMPEMutex").c_str());
 
     bip::scoped_lock<bip::named_mutex> lock(*mutex, bip::defer_lock);
     if (!lock.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
@@ -61,6 +82,7 @@ void NotesSharingMPE::initSharedMemory() {
 }
 
 void NotesSharingMPE::initInstance(int id) {
+    checkInitDeadline();
     bip::scoped_lock<bip::named_mutex> lock(*mutex);
 
     if (id >= 0) {
@@ -73,7 +95,7 @@ void NotesSharingMPE::initInstance(int id) {
     os_things::process_id myProcessId = os_things::get_current_pid();
 
     instancesData->emplace(
-        std::piecewise_construct, std::forward_as_tuple(instanceId),
+        std::piecewise_construct, std::forward_as_tuple(instanceId.load()),
         std::forward_as_tuple(myProcessId, uniqueId, sharedMemory->get_segment_manager()));
 
     isActive = true;
@@ -95,6 +117,10 @@ int NotesSharingMPE::findSmallestFreeId() {
 }
 
 NotesSharingMPE::~NotesSharingMPE() {
+    abortInit = true;
+    if (initThread.joinable()) {
+        initThread.join();
+    }
     if (!isActive || instanceId < 0) {
         return;
     }
@@ -116,8 +142,8 @@ NotesSharingMPE::~NotesSharingMPE() {
 
     // Clean up outside the lock to avoid holding it during removal
     if (shouldCleanup) {
-        bip::shared_memory_object::remove("NotesSharingMPESharedMemory");
-        bip::named_mutex::remove("NotesSharingMPEMutex");
+        bip::shared_memory_object::remove(sharedName("NotesSharingMPESharedMemory").c_str());
+        bip::named_mutex::remove(sharedName("NotesSharingMPEMutex").c_str());
     }
 
     isActive = false;
@@ -154,6 +180,15 @@ void NotesSharingMPE::updateNotes(const std::vector<Note> &notes) {
 }
 
 void NotesSharingMPE::changeInstanceId(int desInstId) {
+    std::scoped_lock initLock(initMutex);
+    if (!isInitDone) {
+        pendingInstanceId = desInstId;
+        return;
+    }
+    applyInstanceId(desInstId);
+}
+
+void NotesSharingMPE::applyInstanceId(int desInstId) {
     if (!isActive) {
         return;
     }
@@ -1,55 +1,74 @@
 #include "XenRoll/processor/managers/PluginInstanceManager.h"
+#include <algorithm>
+#include <bit>
 #include <chrono>
-#include <future>
+#include <stdexcept>
 
 namespace audio_plugin {
-PluginInstanceManager::PluginInstanceManager() {
-    std::promise<bool> initPromise;
-    auto initFuture = initPromise.get_future();
-
-    std::thread initThread([this, promise = std::move(initPromise)]() mutable {
-        try {
-            initAll();
-            promise.set_value(true);
-        } catch (...) {
-            promise.set_exception(std::current_exception());
-        }
-    });
-
-    if (initFuture.wait_for(std::chrono::milliseconds(initTimeoutTime)) !=
-        std::future_status::ready) {
-        performEmergencyCleanup();
-        initThread.detach();
-    } else {
-        initThread.join();
-        try {
-            initFuture.get();
-        } catch (...) {
-            performEmergencyCleanup();
-        }
-    }
+PluginInstanceManager::PluginInstanceManager(std::function<void()> initDoneCallback,
+                                             std::string namePrefix)
+    : onInitDone(std::move(initDoneCallback)), namePrefix(std::move(namePrefix)) {
+    initThread = std::thread(&PluginInstanceManager::initAll, this);
 }
 
 void PluginInstanceManager::performEmergencyCleanup() {
     errorMessage = "Failed to init, deadlock/error occured";
-    bip::shared_memory_object::remove("XenRollSharedMemory");
-    bip::named_mutex::remove("XenRollMutexChannelsSheet");
-    bip::named_mutex::remove("XenRollMutexUpdateServerCondition");
-    bip::named_condition::remove("XenRollUpdateServerCondition");
+    bip::shared_memory_object::remove(sharedName("XenRollSharedMemory").c_str());
+    bip::named_mutex::remove(sharedName("XenRollMutexChannelsSheet").c_str());
+    bip::named_semaphore::remove(sharedName("XenRollUpdateServerSemaphore").c_str());
     for (int i = 0; i < 16; ++i) {
-        bip::named_mutex::remove(("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
+        bip::named_mutex::remove(
+            sharedName("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
     }
     for (int i = 0; i < 16; ++i) {
-        bip::named_mutex::remove(("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
+        bip::named_mutex::remove(
+            sharedName("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
     }
     checkServerFlag = false;
     runServerFlag = false;
     isActive = false;
+    mutexesCheckTime = -1;
 }
 
 void PluginInstanceManager::initAll() {
-    initSharedMemory();
-    initInstance();
+    {
+        // Instances of this process are initialized one by one, so if the first one finds stuck
+        // mutexes of a crashed process (and removes them), next ones create new ones. Waiting
+        // for the turn is stopped if destructor aborts init
+        std::unique_lock processInitLock(processInitMutex, std::defer_lock);
+        while (!abortInit &&
+               !processInitLock.try_lock_for(std::chrono::milliseconds(processInitPollTime))) {
+        }
+        // If init was aborted while waiting, instance stays inactive
+        if (processInitLock.owns_lock()) {
+            initDeadline =
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(initTimeoutTime);
+            try {
+                initSharedMemory();
+                initInstance();
+            } catch (...) {
+                if (!abortInit) {
+                    performEmergencyCleanup();
+                }
+            }
+        }
+    }
+
+    {
+        // Pending channel is taken by applyPendingChannelIndex() (it must be serialised with
+        //   updateFreqs(), so it isn't done here)
+        std::scoped_lock initLock(initMutex);
+        isInitDone = true;
+    }
+    if (onInitDone && !abortInit) {
+        onInitDone();
+    }
+}
+
+void PluginInstanceManager::checkInitDeadline() const {
+    if (abortInit || std::chrono::steady_clock::now() > initDeadline) {
+        throw std::runtime_error("Init was aborted or took too long");
+    }
 }
 
 bool PluginInstanceManager::isServerHeartbeatOk() {
@@ -61,14 +80,16 @@ bool PluginInstanceManager::isServerHeartbeatOk() {
 }
 
 void PluginInstanceManager::initSharedMemory() {
+    checkInitDeadline();
     bip::permissions perm;
     perm.set_unrestricted();
 
     sharedMemory = std::make_unique<bip::managed_shared_memory>(
-        bip::open_or_create, "XenRollSharedMemory", (18 + 512) * 1024, nullptr, perm);
+        bip::open_or_create, sharedName("XenRollSharedMemory").c_str(), (18 + 512) * 1024,
+        nullptr, perm);
 
-    chShMutex =
-        std::make_unique<bip::named_mutex>(bip::open_or_create, "XenRollMutexChannelsSheet");
+    chShMutex = std::make_unique<bip::named_mutex>(
+        bip::open_or_create, sharedName("XenRollMutexChannelsSheet").c_str());
 
     bip::scoped_lock<bip::named_mutex> lock(*chShMutex, bip::defer_lock);
     if (!lock.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
@@ -77,26 +98,31 @@ void PluginInstanceManager::initSharedMemory() {
 
     channelsSheet = sharedMemory->find_or_construct<ChannelsSheet>("ChannelsSheet")();
 
-    updServCondMutex = std::make_unique<bip::named_mutex>(bip::open_or_create,
-                                                          "XenRollMutexUpdateServerCondition");
-
-    updateServerCondition =
-        std::make_unique<bip::named_condition>(bip::open_or_create, "XenRollUpdateServerCondition");
+    // Initial count is 0, server waits on it with timeout, so it can't get stuck after crash
+    updateServerSemaphore = std::make_unique<bip::named_semaphore>(
+        bip::open_or_create, sharedName("XenRollUpdateServerSemaphore").c_str(), 0);
 
     // CREATE/OPEN ALL MUTEXES FOR EVERYONE
     // CHECK FOR STUCK MUTEXES AFTER CRASH
     // (need to detect them so runServer and other functions don't wait forever)
-    {
-        bip::scoped_lock<bip::named_mutex> lock2(*updServCondMutex, bip::defer_lock);
-        if (!lock2.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
-            throw std::runtime_error(
-                "Unable to acquire mutex lock within timeout - possible deadlock");
-        }
-    }
+    const int64_t checkTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  std::chrono::steady_clock::now().time_since_epoch())
+                                  .count();
+    const int64_t prevCheckTime = mutexesCheckTime;
+    const bool checkMutexes =
+        (prevCheckTime == -1) || (checkTime - prevCheckTime > mutexesCheckValidTime);
     for (int i = 0; i < 16; ++i) {
+        chNtMutex[i] = std::make_unique<bip::named_mutex>(
+            bip::open_or_create,
+            sharedName("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
+        chFqMutex[i] = std::make_unique<bip::named_mutex>(
+            bip::open_or_create,
+            sharedName("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
+        if (!checkMutexes) {
+            continue;
+        }
+        checkInitDeadline();
         {
-            chNtMutex[i] = std::make_unique<bip::named_mutex>(
-                bip::open_or_create, ("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
             bip::scoped_lock<bip::named_mutex> lockNt(*chNtMutex[i], bip::defer_lock);
             if (!lockNt.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
                 throw std::runtime_error(
@@ -104,9 +130,6 @@ void PluginInstanceManager::initSharedMemory() {
             }
         }
         {
-            chFqMutex[i] = std::make_unique<bip::named_mutex>(
-                bip::open_or_create, ("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
-
             bip::scoped_lock<bip::named_mutex> lockFq(*chFqMutex[i], bip::defer_lock);
             if (!lockFq.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
                 throw std::runtime_error(
@@ -114,9 +137,13 @@ void PluginInstanceManager::initSharedMemory() {
             }
         }
     }
+    if (checkMutexes) {
+        mutexesCheckTime = checkTime;
+    }
 }
 
 void PluginInstanceManager::initInstance() {
+    checkInitDeadline();
     bip::scoped_lock<bip::named_mutex> lock(*chShMutex, bip::defer_lock);
     if (!lock.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
         throw std::runtime_error("Unable to acquire mutex lock within timeout - possible deadlock");
@@ -127,6 +154,7 @@ void PluginInstanceManager::initInstance() {
             !channelsSheet->instanceSlots[i]) {
             channelsSheet->instanceSlots[i] = true;
             channelsSheet->pids[i] = os_things::get_current_pid();
+            channelsSheet->extraChannelOwner[i] = 0;
             channelIndex = i;
             break;
         }
@@ -168,8 +196,7 @@ void PluginInstanceManager::becomeClient() {
     checkServerThread = std::thread(&PluginInstanceManager::checkServer, this);
 
     // Notify server to process the new client
-    bip::scoped_lock<bip::named_mutex> lock2(*updServCondMutex);
-    updateServerCondition->notify_one();
+    markChannelDirty(channelIndex);
 }
 
 void PluginInstanceManager::becomeServer() {
@@ -194,6 +221,7 @@ void PluginInstanceManager::becomeServer() {
             bip::scoped_lock<bip::named_mutex> lock(*chFqMutex[i]);
             channelsFreqs[i]->serverAction = 1;
             channelsFreqs[i]->needToUpdate.store(true, std::memory_order_release);
+            channelsSheet->dirtyChannels.fetch_or(static_cast<uint16_t>(1u << i));
         }
     }
 
@@ -228,8 +256,8 @@ void PluginInstanceManager::checkServer() {
     }
 }
 
-// This eats LOTS of CPU, BUT it is necessary for smooth notes' bends
-// (and for no artifacts when playing note with same pitch after bended note)
+// Server sleeps until some channel is marked dirty (or until it's time for heartbeat), then it
+// processes only dirty channels. So bends are smooth, but idle server costs nothing.
 void PluginInstanceManager::runServer() {
     while (runServerFlag) {
         auto now = std::chrono::system_clock::now();
@@ -240,36 +268,101 @@ void PluginInstanceManager::runServer() {
             channelsSheet->serverHeartbeat = timestamp;
         }
 
-        bool anyUpdates = false;
-        for (int i = 0; i < 16; ++i) {
-            bip::scoped_lock<bip::named_mutex> lock(*chFqMutex[i]);
-            if (channelsFreqs[i]->serverAction == -1) {
-                MTS_SetMultiChannel(false, static_cast<char>(i));
-                channelsFreqs[i]->needToUpdate.store(false, std::memory_order_release);
-                channelsFreqs[i]->serverAction = 0;
-                anyUpdates = true;
-                continue;
-            }
-            if (channelsFreqs[i]->serverAction == 1) {
-                MTS_SetMultiChannel(true, static_cast<char>(i));
-                channelsFreqs[i]->serverAction = 0;
-                anyUpdates = true;
-            }
-            if (channelsFreqs[i]->needToUpdate.load(std::memory_order_acquire)) {
-                MTS_SetMultiChannelNoteTunings(channelsFreqs[i]->freqs, static_cast<char>(i));
-                channelsFreqs[i]->needToUpdate.store(false, std::memory_order_release);
-                anyUpdates = true;
+        // Channels marked after this are processed in the next iteration (semaphore is posted)
+        uint16_t dirty = channelsSheet->dirtyChannels.exchange(0);
+        uint16_t retry = 0;
+        for (; dirty != 0; dirty &= dirty - 1) {
+            const int i = std::countr_zero(dirty);
+            if (processChannel(i)) {
+                failedReads[i] = 0;
+            } else if (++failedReads[i] < maxFailedReads) {
+                retry |= static_cast<uint16_t>(1u << i);
+            } else {
+                // Writer crashed in the middle of write, don't spin on it's channel
+                failedReads[i] = 0;
+                giveUpChannel(i);
             }
         }
 
-        // Wait for notification or timeout (for heartbeat)
-        if (!anyUpdates) {
-            bip::scoped_lock<bip::named_mutex> lock(*updServCondMutex);
-            updateServerCondition->wait_for(lock, std::chrono::milliseconds(heartbeatDeltaTime));
+        if (retry != 0) {
+            // Writer needs microseconds to finish, don't spin meanwhile
+            channelsSheet->dirtyChannels.fetch_or(retry);
+            std::this_thread::sleep_for(std::chrono::milliseconds(retryDeltaTime));
+        } else if (channelsSheet->dirtyChannels.load() == 0) {
+            // Wait for notification or timeout (for heartbeat)
+            updateServerSemaphore->try_wait_for(std::chrono::milliseconds(heartbeatDeltaTime));
+        }
+    }
+}
+
+bool PluginInstanceManager::processChannel(int chInd) {
+    ChannelFreqs *channel = channelsFreqs[chInd];
+    bool fullUpdate = false; ///< Client has just got the channel, it needs all notes
+    {
+        bip::scoped_lock<bip::named_mutex> lock(*chFqMutex[chInd]);
+        if (channel->serverAction == -1) {
+            MTS_SetMultiChannel(false, static_cast<char>(chInd));
+            channel->needToUpdate.store(false, std::memory_order_release);
+            channel->serverAction = 0;
+            return true;
+        }
+        if (channel->serverAction == 1) {
+            MTS_SetMultiChannel(true, static_cast<char>(chInd));
+            channel->serverAction = 0;
+            fullUpdate = true;
+        }
+    }
+    // Reset before reading, so freqs written meanwhile are sent in the next iteration
+    if (channel->needToUpdate.exchange(false, std::memory_order_acq_rel) || fullUpdate) {
+        const uint64_t changed[2] = {
+            channel->changedNotes[0].exchange(0, std::memory_order_acq_rel),
+            channel->changedNotes[1].exchange(0, std::memory_order_acq_rel)};
+        if (!channel->freqs.tryRead(serverFreqs)) {
+            // Writer is in the middle of write (or crashed there), try again later
+            channel->changedNotes[0].fetch_or(changed[0], std::memory_order_acq_rel);
+            channel->changedNotes[1].fetch_or(changed[1], std::memory_order_acq_rel);
+            channel->needToUpdate.store(true, std::memory_order_release);
+            if (fullUpdate) {
+                // Full update stays pending (unless the client has given up the channel since)
+                bip::scoped_lock<bip::named_mutex> lock(*chFqMutex[chInd]);
+                if (channel->serverAction == 0) {
+                    channel->serverAction = 1;
+                }
+            }
+            return false;
+        }
+        if (fullUpdate || std::popcount(changed[0]) + std::popcount(changed[1]) > maxDeltaNotes) {
+            MTS_SetMultiChannelNoteTunings(serverFreqs, static_cast<char>(chInd));
         } else {
-            std::this_thread::yield();
+            for (int half = 0; half < 2; ++half) {
+                for (uint64_t bits = changed[half]; bits != 0; bits &= bits - 1) {
+                    const int note = half * 64 + std::countr_zero(bits);
+                    MTS_SetMultiChannelNoteTuning(serverFreqs[note], static_cast<char>(note),
+                                                  static_cast<char>(chInd));
+                }
+            }
         }
     }
+    return true;
+}
+
+void PluginInstanceManager::giveUpChannel(int chInd) {
+    bip::scoped_lock<bip::named_mutex> lock(*chShMutex, bip::defer_lock);
+    if (!lock.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
+        return;
+    }
+    if (os_things::is_process_active(channelsSheet->pids[chInd])) {
+        // needToUpdate stays set, so next write of the owner marks channel dirty again
+        return;
+    }
+    // Owner is dead, it's channel is free for other instances (see initInstance())
+    bip::scoped_lock<bip::named_mutex> lockFq(*chFqMutex[chInd]);
+    MTS_SetMultiChannel(false, static_cast<char>(chInd));
+    ChannelFreqs *channel = channelsFreqs[chInd];
+    channel->needToUpdate.store(false, std::memory_order_release);
+    channel->changedNotes[0].store(0, std::memory_order_release);
+    channel->changedNotes[1].store(0, std::memory_order_release);
+    channel->serverAction = 0;
 }
 
 void PluginInstanceManager::waitChannelUpdate() {
@@ -281,16 +374,91 @@ void PluginInstanceManager::waitChannelUpdate() {
     }
 }
 
-void PluginInstanceManager::updateFreqs(const double freqs[128]) {
+void PluginInstanceManager::markChannelDirty(int chInd) {
+    // Semaphore post doesn't block, and if server is already woken up it's skipped
+    const auto bit = static_cast<uint16_t>(1u << chInd);
+    if (channelsSheet->dirtyChannels.fetch_or(bit) == 0) {
+        updateServerSemaphore->post();
+    }
+}
+
+void PluginInstanceManager::updateFreqs(const double *freqs, int numChannels) {
     if (isActive) {
-        bip::scoped_lock<bip::named_mutex> lock(*chFqMutex[channelIndex]);
-        ChannelFreqs *channel = channelsFreqs[channelIndex];
-        std::memcpy(channel->freqs, freqs, sizeof(double) * 128);
-        channel->needToUpdate.store(true, std::memory_order_release);
+        publishChannelFreqs(channelIndex, 0, freqs);
+        numChannels = std::min(numChannels, numExtraChannels + 1);
+        for (int k = 1; k < numChannels; ++k) {
+            publishChannelFreqs(extraChannels[k - 1], k, freqs + 128 * k);
+        }
     }
+}
+
+void PluginInstanceManager::publishChannelFreqs(int chInd, int k, const double *freqs) {
+    // Only changed notes are sent to MTS-ESP
+    uint64_t changed[2] = {0, 0};
+    for (int i = 0; i < 128; ++i) {
+        changed[i / 64] |= static_cast<uint64_t>(freqs[i] != publishedFreqs[k][i]) << (i % 64);
+        publishedFreqs[k][i] = freqs[i];
+    }
+    if ((changed[0] | changed[1]) == 0) {
+        return;
+    }
+    ChannelFreqs *channel = channelsFreqs[chInd];
+    channel->freqs.write(freqs);
+    channel->changedNotes[0].fetch_or(changed[0], std::memory_order_acq_rel);
+    channel->changedNotes[1].fetch_or(changed[1], std::memory_order_acq_rel);
+    channel->needToUpdate.store(true, std::memory_order_release);
     // Notify server to wake up and process the update
-    bip::scoped_lock<bip::named_mutex> lock(*updServCondMutex);
-    updateServerCondition->notify_one();
+    markChannelDirty(chInd);
+}
+
+std::vector<int> PluginInstanceManager::claimExtraChannels(int num) {
+    if (!isActive) {
+        return {};
+    }
+    bip::scoped_lock<bip::named_mutex> lock(*chShMutex, bip::defer_lock);
+    if (!lock.try_lock_for(std::chrono::milliseconds(lockTimeoutTime))) {
+        return {};
+    }
+    releaseExtraChannels();
+
+    num = std::clamp(num, 0, maxChannels - 1);
+    for (int i = 0; i < 16 && numExtraChannels < num; ++i) {
+        if ((i == channelIndex) || (os_things::is_process_active(channelsSheet->pids[i]) &&
+                                    channelsSheet->instanceSlots[i])) {
+            continue;
+        }
+        channelsSheet->instanceSlots[i] = true;
+        channelsSheet->pids[i] = os_things::get_current_pid();
+        channelsSheet->extraChannelOwner[i] = static_cast<int8_t>(channelIndex + 1);
+        {
+            bip::scoped_lock<bip::named_mutex> lockFq(*chFqMutex[i]);
+            // because it can be not created by server yet
+            channelsFreqs[i] = sharedMemory->find_or_construct<ChannelFreqs>(
+                ("Channel" + std::to_string(i) + "Freqs").c_str())();
+            channelsFreqs[i]->serverAction = 1;
+        }
+        markChannelDirty(i);
+        // Next updateFreqs() publishes all notes of this channel
+        std::fill(std::begin(publishedFreqs[numExtraChannels + 1]),
+                  std::end(publishedFreqs[numExtraChannels + 1]), -1.0);
+        extraChannels[numExtraChannels++] = i;
+    }
+    return std::vector<int>(extraChannels, extraChannels + numExtraChannels);
+}
+
+void PluginInstanceManager::releaseExtraChannels() {
+    for (int k = 0; k < numExtraChannels; ++k) {
+        const int i = extraChannels[k];
+        channelsSheet->instanceSlots[i] = false;
+        channelsSheet->pids[i] = 0;
+        channelsSheet->extraChannelOwner[i] = 0;
+        {
+            bip::scoped_lock<bip::named_mutex> lockFq(*chFqMutex[i]);
+            channelsFreqs[i]->serverAction = -1;
+        }
+        markChannelDirty(i);
+    }
+    numExtraChannels = 0;
 }
 
 void PluginInstanceManager::updateNotes(const std::vector<Note> &notes) {
@@ -302,6 +470,26 @@ void PluginInstanceManager::updateNotes(const std::vector<Note> &notes) {
 }
 
 void PluginInstanceManager::changeChannelIndex(int desChInd) {
+    std::scoped_lock initLock(initMutex);
+    if (!isInitDone) {
+        pendingChannelIndex = desChInd;
+        return;
+    }
+    applyChannelIndex(desChInd);
+}
+
+void PluginInstanceManager::applyPendingChannelIndex() {
+    std::scoped_lock initLock(initMutex);
+    if (!isInitDone || pendingChannelIndex == -1) {
+        return;
+    }
+    if (pendingChannelIndex != channelIndex) {
+        applyChannelIndex(pendingChannelIndex);
+    }
+    pendingChannelIndex = -1;
+}
+
+void PluginInstanceManager::applyChannelIndex(int desChInd) {
     if (!isActive) {
         return;
     }
@@ -315,8 +503,12 @@ void PluginInstanceManager::changeChannelIndex(int desChInd) {
         return;
     }
 
-    // if desired channel is free our current channel will become abandoned
-    if (!os_things::is_process_active(channelsSheet->pids[desChInd]) ||
+    // if desired channel is free (or is our extra channel) our current channel will become
+    //   abandoned
+    const bool desIsExtraChannel =
+        std::find(extraChannels, extraChannels + numExtraChannels, desChInd) !=
+        extraChannels + numExtraChannels;
+    if (desIsExtraChannel || !os_things::is_process_active(channelsSheet->pids[desChInd]) ||
         !channelsSheet->instanceSlots[desChInd]) {
         channelsSheet->instanceSlots[channelIndex] = false;
         channelsSheet->pids[channelIndex] = 0;
@@ -337,12 +529,29 @@ void PluginInstanceManager::changeChannelIndex(int desChInd) {
 
     channelsSheet->instanceSlots[desChInd] = true;
     channelsSheet->pids[desChInd] = os_things::get_current_pid();
+    channelsSheet->extraChannelOwner[desChInd] = 0;
+    // Extra channels now belong to the new main channel (desired channel isn't extra anymore)
+    int numKeptExtraChannels = 0;
+    for (int k = 0; k < numExtraChannels; ++k) {
+        const int i = extraChannels[k];
+        if (i == desChInd) {
+            continue;
+        }
+        channelsSheet->extraChannelOwner[i] = static_cast<int8_t>(desChInd + 1);
+        extraChannels[numKeptExtraChannels] = i;
+        std::copy(std::begin(publishedFreqs[k + 1]), std::end(publishedFreqs[k + 1]),
+                  std::begin(publishedFreqs[numKeptExtraChannels + 1]));
+        numKeptExtraChannels++;
+    }
+    numExtraChannels = numKeptExtraChannels;
 
-    channelIndex = desChInd;
+    // Next updateFreqs() publishes all notes to the new channel
+    std::fill(std::begin(publishedFreqs[0]), std::end(publishedFreqs[0]), -1.0);
 
     // Notify server to process the channel change
-    bip::scoped_lock<bip::named_mutex> lock2(*updServCondMutex);
-    updateServerCondition->notify_one();
+    markChannelDirty(channelIndex);
+    markChannelDirty(desChInd);
+    channelIndex = desChInd;
 }
 
 std::set<int> PluginInstanceManager::getAllInstanceChannels() {
@@ -354,7 +563,7 @@ std::set<int> PluginInstanceManager::getAllInstanceChannels() {
 
     std::set<int> allInstanceChannels;
     for (int i = 0; i < 16; ++i) {
-        if (channelsSheet->instanceSlots[i]) {
+        if (channelsSheet->instanceSlots[i] && channelsSheet->extraChannelOwner[i] == 0) {
             allInstanceChannels.insert(i);
         }
     }
@@ -364,6 +573,9 @@ std::set<int> PluginInstanceManager::getAllInstanceChannels() {
 
 std::vector<Note> PluginInstanceManager::getChannelsNotes(const std::set<int> chIndxs) {
     std::vector<Note> chNotes = {};
+    if (!isActive) {
+        return chNotes;
+    }
     for (const auto i : chIndxs) {
         if (channelsSheet->instanceSlots[i]) {
             bip::scoped_lock<bip::named_mutex> lock(*chNtMutex[i]);
@@ -376,6 +588,12 @@ std::vector<Note> PluginInstanceManager::getChannelsNotes(const std::set<int> ch
 }
 
 PluginInstanceManager::~PluginInstanceManager() {
+    abortInit = true;
+    if (initThread.joinable()) {
+        initThread.join();
+    }
+    // Check of mutexes is skipped only by instances that are loaded together
+    mutexesCheckTime = -1;
     if (!isActive)
         return;
 
@@ -383,6 +601,7 @@ PluginInstanceManager::~PluginInstanceManager() {
         bip::scoped_lock<bip::named_mutex> lock(*chFqMutex[channelIndex]);
         channelsFreqs[channelIndex]->serverAction = -1;
     }
+    markChannelDirty(channelIndex);
 
     if (!isServer) {
         checkServerFlag = false;
@@ -391,6 +610,7 @@ PluginInstanceManager::~PluginInstanceManager() {
     }
 
     bip::scoped_lock<bip::named_mutex> lock(*chShMutex);
+    releaseExtraChannels();
 
     if (isServer) {
         channelsSheet->serverIndex = -1;
@@ -416,15 +636,16 @@ PluginInstanceManager::~PluginInstanceManager() {
     }
 
     // We are 100% the last instance, so we need to clean up
-    bip::shared_memory_object::remove("XenRollSharedMemory");
-    bip::named_mutex::remove("XenRollMutexChannelsSheet");
-    bip::named_mutex::remove("XenRollMutexUpdateServerCondition");
-    bip::named_condition::remove("XenRollUpdateServerCondition");
+    bip::shared_memory_object::remove(sharedName("XenRollSharedMemory").c_str());
+    bip::named_mutex::remove(sharedName("XenRollMutexChannelsSheet").c_str());
+    bip::named_semaphore::remove(sharedName("XenRollUpdateServerSemaphore").c_str());
     for (int i = 0; i < 16; ++i) {
-        bip::named_mutex::remove(("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
+        bip::named_mutex::remove(
+            sharedName("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
     }
     for (int i = 0; i < 16; ++i) {
-        bip::named_mutex::remove(("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
+        bip::named_mutex::remove(
+            sharedName("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
     }
 }
 } // namespace audio_plugin
\ No newline at end of file
@@ -0,0 +1,398 @@
+#include "XenRoll/processor/playback/MidiBounce.h"
+#include "XenRoll/common/FixedCapacityMap.h"
+#include "XenRoll/common/PitchMath.h"
+#include "XenRoll/processor/managers/ChannelsManagerMPE.h"
+#include "XenRoll/processor/managers/FreqSlotsManagerMTS.h"
+#include "XenRoll/processor/playback/BlockScheduler.h"
+#include "XenRoll/processor/playback/PitchBendMPE.h"
+#include "XenRoll/processor/playback/TuningSysEx.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace audio_plugin {
+namespace {
+///< Block of the synthetic playhead
+struct Block {
+    double time;        ///< Playhead time in bars
+    double barsInBlock; ///< Length of block in bars
+    int numSamples;
+};
+
+/**
+ * MPE: like playBlock<Parameters::MPE>() with notes that never change, without chasing,
+ * auditioning and live notes
+ */
+class BounceMPE {
+  public:
+    explicit BounceMPE(const MidiBounce::Settings &settings)
+        : settings(settings), channelsManager(settings.channelsEconomyModeMPE) {
+        pitchBend.update(settings.semiBendRangeMPE, settings.A4Freq);
+        channelsManager.setVoiceStealing(settings.voiceStealingMPE);
+    }
+
+    ///< MPE configuration (lower zone with 15 member channels) and pitch bend range of channels
+    void addSetupMessages(juce::MidiMessageSequence &sequence) const {
+        auto addRPN = [&](int channel, int rpn, int value) {
+            sequence.addEvent(juce::MidiMessage::controllerEvent(channel, 101, 0));
+            sequence.addEvent(juce::MidiMessage::controllerEvent(channel, 100, rpn));
+            sequence.addEvent(juce::MidiMessage::controllerEvent(channel, 6, value));
+            sequence.addEvent(juce::MidiMessage::controllerEvent(channel, 38, 0));
+        };
+        addRPN(1, 6, ChannelsManagerMPE::numChannels);
+        for (int ch = 2; ch <= 16; ++ch) {
+            addRPN(ch, 0, settings.semiBendRangeMPE);
+        }
+    }
+
+    void playBlock(const NotesSnapshot &notesSnapshot, const Block &block,
+                   juce::MidiBuffer &midiMessages) {
+        const std::vector<Note> &notes = notesSnapshot.getNotes();
+        const double blockEnd = block.time + block.barsInBlock;
+        scheduler.setBlock(block.time, block.barsInBlock, block.numSamples);
+
+        // Notes that started and ended in the previous block (their note off was before note on)
+        for (auto it = voices.begin(); it != voices.end();) {
+            const Note &note = *notesSnapshot.findNote(it->first);
+            if (note.time + note.duration < block.time) {
+                stopVoice(it->second, midiMessages, 0);
+                it = voices.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // ===================== Note off =====================
+        for (const NoteTimeline::Event &event :
+             scheduler.noteOffs(notesSnapshot, block.time, blockEnd)) {
+            auto it = voices.find(notes[event.noteInd].id);
+            if (it == voices.end()) {
+                continue;
+            }
+            stopVoice(it->second, midiMessages, scheduler.noteOffSample(event.time));
+            voices.erase(it);
+        }
+
+        // ===================== Note on =====================
+        for (const NoteTimeline::Event &event :
+             scheduler.noteOns(notesSnapshot, block.time, blockEnd)) {
+            const Note &note = notes[event.noteInd];
+            const int totalCents = note.octave * 1200 + note.cents;
+            const auto [midiNote, bendMPE] = pitchBend.midiNoteAndBend(totalCents);
+            const int sample = scheduler.noteOnSample(note.time);
+            int ch = -1;
+            if (!voices.full()) {
+                bool isStolen;
+                std::tie(ch, isStolen) = channelsManager.allocateChannelMPE(
+                    bendMPE, note.bend != 0, totalCents, note.velocity);
+                if (isStolen) {
+                    silenceChannel(ch, midiMessages, sample);
+                }
+            }
+            if (ch == -1) {
+                ++numDroppedNotes;
+                continue;
+            }
+            midiMessages.addEvent(juce::MidiMessage::pitchWheel(ch, bendMPE), sample);
+            midiMessages.addEvent(juce::MidiMessage::noteOn(ch, midiNote, note.velocity), sample);
+            voices.insert(note.id, {totalCents, note.bend != 0, ch, midiNote, bendMPE});
+        }
+
+        // ===================== Note bend =====================
+        const int bendControlRate = std::max(1, settings.bendControlRateMPE);
+        for (auto &[noteId, voice] : voices) {
+            if (!voice.hasBend || voice.channel == -1 ||
+                channelsManager.getNumNotesInChannel(voice.channel) != 1) {
+                continue;
+            }
+            const Note &note = *notesSnapshot.findNote(noteId);
+            for (int sample = 0; sample < block.numSamples; sample += bendControlRate) {
+                const double time = block.time + block.barsInBlock * sample / block.numSamples;
+                if ((note.time < time) && (time <= note.time + note.duration)) {
+                    const int bendMPE = pitchBend.noteBend(note, time);
+                    if (bendMPE != voice.lastBendMPE) {
+                        midiMessages.addEvent(
+                            juce::MidiMessage::pitchWheel(voice.channel, bendMPE), sample);
+                        voice.lastBendMPE = bendMPE;
+                    }
+                }
+            }
+        }
+    }
+
+    int getNumDroppedNotes() const { return numDroppedNotes; }
+
+  private:
+    struct Voice {
+        int totalCents;
+        bool hasBend;
+        int channel; ///< -1 if voice was stolen
+        int midiNote;
+        int lastBendMPE;
+    };
+
+    ///< Same as number of voices of processBlock()
+    static constexpr size_t maxVoices = 128;
+
+    const MidiBounce::Settings &settings;
+    PitchBendMPE pitchBend;
+    ChannelsManagerMPE channelsManager;
+    BlockScheduler scheduler;
+    FixedCapacityMap<uint64_t, Voice, maxVoices> voices; ///< note's id -> Voice
+    int numDroppedNotes = 0;
+
+    void stopVoice(const Voice &voice, juce::MidiBuffer &midiMessages, int sample) {
+        if (voice.channel == -1) { // Voice was stolen, it's already silent
+            return;
+        }
+        midiMessages.addEvent(juce::MidiMessage::noteOff(voice.channel, voice.midiNote), sample);
+        if (settings.resetPitchBendOnNoteOff && voice.hasBend) {
+            const int bendMPE = pitchBend.midiNoteAndBend(voice.totalCents).second;
+            midiMessages.addEvent(juce::MidiMessage::pitchWheel(voice.channel, bendMPE), sample);
+        }
+        channelsManager.noteReleasedMPE(voice.channel);
+    }
+
+    void silenceChannel(int ch, juce::MidiBuffer &midiMessages, int sample) {
+        for (auto &[_, voice] : voices) {
+            if (voice.channel == ch) {
+                midiMessages.addEvent(juce::MidiMessage::noteOff(ch, voice.midiNote), sample);
+                voice.channel = -1;
+            }
+        }
+    }
+};
+
+/**
+ * MTS SysEx: notes acquire midi notes of channel 1 (slots) when they start and release them when
+ * they end, so any number of distinct pitches can be bounced (only simultaneous ones are limited
+ * by 128). Midi note is retuned right before it's note on, bends are sent like in
+ * playBlock<Parameters::MTS_SYSEX>() (all bending notes at once, every bendControlRateMTS samples)
+ */
+class BounceMTS {
+  public:
+    explicit BounceMTS(const MidiBounce::Settings &settings) : settings(settings) {
+        sentFreqs.fill(noFreq);
+        slotNumNotes.fill(0);
+    }
+
+    void addSetupMessages(juce::MidiMessageSequence &) const {}
+
+    void playBlock(const NotesSnapshot &notesSnapshot, const Block &block,
+                   juce::MidiBuffer &midiMessages) {
+        const std::vector<Note> &notes = notesSnapshot.getNotes();
+        const double blockEnd = block.time + block.barsInBlock;
+        scheduler.setBlock(block.time, block.barsInBlock, block.numSamples);
+
+        // Notes that started and ended in the previous block (their note off was before note on)
+        for (auto it = voices.begin(); it != voices.end();) {
+            const Note &note = *notesSnapshot.findNote(it->first);
+            if (note.time + note.duration < block.time) {
+                stopVoice(it->second, midiMessages, 0);
+                it = voices.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // ===================== Note off =====================
+        for (const NoteTimeline::Event &event :
+             scheduler.noteOffs(notesSnapshot, block.time, blockEnd)) {
+            auto it = voices.find(notes[event.noteInd].id);
+            if (it == voices.end()) {
+                continue;
+            }
+            stopVoice(it->second, midiMessages, scheduler.noteOffSample(event.time));
+            voices.erase(it);
+        }
+
+        // ===================== Note bend =====================
+        // Notes that start in this block have no bend yet
+        samplesSinceBendUpdate += block.numSamples;
+        if (samplesSinceBendUpdate >= settings.bendControlRateMTS) {
+            samplesSinceBendUpdate = 0;
+            for (const auto &[noteId, voice] : voices) {
+                if (voice.hasBend) {
+                    const Note &note = *notesSnapshot.findNote(noteId);
+                    retune(voice.slot, getNoteFreqAtTime(note, block.time));
+                }
+            }
+            flushRetunes(midiMessages, 0);
+        }
+
+        // ===================== Note on =====================
+        // Midi notes of notes that start at the same sample are retuned with one message
+        int pendingSample = 0;
+        pendingNoteOns.clear();
+        auto flushNoteOns = [&]() {
+            flushRetunes(midiMessages, pendingSample);
+            for (const auto &[slot, velocity] : pendingNoteOns) {
+                midiMessages.addEvent(juce::MidiMessage::noteOn(1, slot, velocity),
+                                      pendingSample);
+            }
+            pendingNoteOns.clear();
+        };
+        for (const NoteTimeline::Event &event :
+             scheduler.noteOns(notesSnapshot, block.time, blockEnd)) {
+            const Note &note = notes[event.noteInd];
+            const int sample = scheduler.noteOnSample(note.time);
+            if (sample != pendingSample) {
+                flushNoteOns();
+                pendingSample = sample;
+            }
+            const double freq = getNoteFreqAtTime(note, note.time);
+            const int slot =
+                slots.acquire(freq, [this](int slot) { return slotNumNotes[slot] > 0; });
+            if (slot == -1) {
+                ++numDroppedNotes;
+                continue;
+            }
+            // Every note holds it's own acquire of the slot (released in stopVoice())
+            if (slotNumNotes[slot]++ == 0) {
+                retune(slot, freq);
+                pendingNoteOns.push_back({slot, note.velocity});
+            }
+            voices[note.id] = {slot, note.bend != 0};
+        }
+        flushNoteOns();
+    }
+
+    int getNumDroppedNotes() const { return numDroppedNotes; }
+
+  private:
+    struct Voice {
+        int slot; ///< Midi note of channel 1
+        bool hasBend;
+    };
+
+    static constexpr double noFreq = -1.0;
+
+    const MidiBounce::Settings &settings;
+    FreqSlotsManagerMTS slots; ///< 128 slots (one midi channel)
+    std::array<int, FreqSlotsManagerMTS::slotsPerChannel> slotNumNotes; ///< Playing notes of slot
+    ///< Last frequencies that were sent to synth, noFreq if midi note wasn't tuned yet
+    std::array<double, FreqSlotsManagerMTS::slotsPerChannel> sentFreqs;
+    BlockScheduler scheduler;
+    std::unordered_map<uint64_t, Voice> voices; ///< note's id -> Voice
+    int samplesSinceBendUpdate = 0;
+    int numDroppedNotes = 0;
+
+    // Tuning changes and note ons that wait to be added to midi buffer
+    std::vector<uint8_t> retuneKeys;
+    std::vector<double> retuneFreqs;
+    std::vector<std::pair<int, float>> pendingNoteOns; ///< {slot, velocity}
+    std::array<uint8_t, tuning_sysex::maxMessageSize> sysExData;
+
+    ///< Notes with same frequency share midi note, it's stopped by the last one
+    void stopVoice(const Voice &voice, juce::MidiBuffer &midiMessages, int sample) {
+        slots.release(voice.slot);
+        if (--slotNumNotes[voice.slot] == 0) {
+            midiMessages.addEvent(juce::MidiMessage::noteOff(1, voice.slot), sample);
+        }
+    }
+
+    double getNoteFreqAtTime(const Note &note, double time) const {
+        double dBend = 0.0;
+        if ((note.bend != 0) && (note.time < time) && (time <= note.time + note.duration))
+            dBend = note.bend * (time - note.time) / note.duration;
+        return settings.A4Freq * centsToRatio(note.octave * 1200 + note.cents + dBend -
+                                              (4 * 1200 + 900));
+    }
+
+    void retune(int slot, double freq) {
+        if (sentFreqs[slot] == freq) {
+            return;
+        }
+        sentFreqs[slot] = freq;
+        retuneKeys.push_back(static_cast<uint8_t>(slot));
+        retuneFreqs.push_back(freq);
+    }
+
+    void flushRetunes(juce::MidiBuffer &midiMessages, int sample) {
+        const int numChanges = static_cast<int>(retuneKeys.size());
+        for (int i = 0; i < numChanges; i += tuning_sysex::maxChangesPerMessage) {
+            const int size = tuning_sysex::writeSingleNoteTuningChange(
+                sysExData.data(), retuneKeys.data() + i, retuneFreqs.data() + i,
+                std::min(tuning_sysex::maxChangesPerMessage, numChanges - i));
+            midiMessages.addEvent(juce::MidiMessage::createSysExMessage(sysExData.data(), size),
+                                  sample);
+        }
+        retuneKeys.clear();
+        retuneFreqs.clear();
+    }
+};
+} // namespace
+
+MidiBounce::Settings MidiBounce::settingsFromParameters(const Parameters &params, double bpm,
+                                                        int numerator, int denominator) {
+    Settings settings;
+    settings.tuningType = params.getTuningType() == Parameters::MPE ? Parameters::MPE
+                                                                     : Parameters::MTS_SYSEX;
+    settings.bpm = bpm;
+    settings.numerator = numerator;
+    settings.denominator = denominator;
+    settings.A4Freq = params.A4Freq.load();
+    settings.semiBendRangeMPE = params.semiBendRangeMPE.load();
+    settings.channelsEconomyModeMPE = params.channelsEconomyModeMPE;
+    settings.voiceStealingMPE = params.voiceStealingMPE.load();
+    settings.resetPitchBendOnNoteOff = params.resetPitchBendOnNoteOff.load();
+    settings.bendControlRateMPE = params.bendControlRateMPE.load();
+    settings.bendControlRateMTS = params.bendControlRateMTS.load();
+    return settings;
+}
+
+MidiBounce::Result MidiBounce::bounce(const NotesSnapshot &notesSnapshot,
+                                      const Settings &settings) {
+    Result result;
+    juce::MidiMessageSequence &sequence = result.sequence;
+    sequence.addEvent(
+        juce::MidiMessage::timeSignatureMetaEvent(settings.numerator, settings.denominator));
+    sequence.addEvent(
+        juce::MidiMessage::tempoMetaEvent(juce::roundToInt(60000000.0 / settings.bpm)));
+
+    const double beatsPerBar = settings.numerator / (settings.denominator / 4.0);
+    const double ticksPerBar = ticksPerQuarterNote * beatsPerBar;
+    const double samplesPerBeat = 60.0 / settings.bpm * settings.sampleRate;
+    const double barsInBlock = settings.blockSize / samplesPerBeat / beatsPerBar;
+
+    double endTime = 0.0;
+    for (const Note &note : notesSnapshot.getNotes()) {
+        endTime = std::max(endTime, static_cast<double>(note.time + note.duration));
+    }
+
+    auto run = [&](auto &engine) {
+        engine.addSetupMessages(sequence);
+        juce::MidiBuffer midiMessages;
+        // Block contains events with time in [block.time, block.time + barsInBlock)
+        for (int64_t blockInd = 0; blockInd * barsInBlock <= endTime; ++blockInd) {
+            const Block block{blockInd * barsInBlock, barsInBlock, settings.blockSize};
+            midiMessages.clear();
+            engine.playBlock(notesSnapshot, block, midiMessages);
+            for (const auto metadata : midiMessages) {
+                const double time =
+                    block.time + barsInBlock * metadata.samplePosition / block.numSamples;
+                sequence.addEvent(metadata.getMessage().withTimeStamp(time * ticksPerBar));
+            }
+        }
+        result.numDroppedNotes = engine.getNumDroppedNotes();
+    };
+    if (settings.tuningType == Parameters::MPE) {
+        BounceMPE engine(settings);
+        run(engine);
+    } else {
+        BounceMTS engine(settings);
+        run(engine);
+    }
+    return result;
+}
+
+bool MidiBounce::writeMidiFile(const Result &result, juce::OutputStream &outputStream) {
+    juce::MidiFile midiFile;
+    midiFile.setTicksPerQuarterNote(ticksPerQuarterNote);
+    midiFile.addTrack(result.sequence);
+    return midiFile.writeTo(outputStream);
+}
+} // namespace audio_plugin
@@ -0,0 +1,84 @@
+#include <XenRoll/processor/managers/ChannelsManagerMPE.h>
+#include <chrono>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace audio_plugin_test {
+using audio_plugin::ChannelsManagerMPE;
+using audio_plugin::VoiceStealingMPE;
+
+TEST(ChannelsManagerMPE, GivesEveryNoteItsOwnChannel) {
+    ChannelsManagerMPE manager;
+    std::set<int> channels;
+    for (int i = 0; i < ChannelsManagerMPE::numChannels; ++i) {
+        const auto [ch, isStolen] = manager.allocateChannelMPE(8192, false, 6000 + i, 0.5f);
+        ASSERT_GE(ch, 2);
+        ASSERT_LE(ch, 16);
+        EXPECT_FALSE(isStolen);
+        channels.insert(ch);
+    }
+    EXPECT_EQ(channels.size(), static_cast<size_t>(ChannelsManagerMPE::numChannels));
+    EXPECT_EQ(manager.allocateChannelMPE(8192, false, 7000, 0.5f).first, -1);
+}
+
+TEST(ChannelsManagerMPE, EconomyModeSharesChannelOfSameBend) {
+    ChannelsManagerMPE manager(true);
+    const int ch = manager.allocateChannelMPE(9000, false, 6000, 0.5f).first;
+    EXPECT_EQ(manager.allocateChannelMPE(9000, false, 6100, 0.5f).first, ch);
+    EXPECT_EQ(manager.getNumNotesInChannel(ch), 2);
+    // Notes with bend never share a channel
+    EXPECT_NE(manager.allocateChannelMPE(9000, true, 6200, 0.5f).first, ch);
+}
+
+TEST(ChannelsManagerMPE, StealsOldestChannel) {
+    ChannelsManagerMPE manager;
+    manager.setVoiceStealing(VoiceStealingMPE::StealOldest);
+    const int oldest = manager.allocateChannelMPE(8192, false, 6000, 0.5f).first;
+    for (int i = 1; i < ChannelsManagerMPE::numChannels; ++i) {
+        manager.allocateChannelMPE(8192, false, 6000 + i, 0.5f);
+    }
+    const auto [ch, isStolen] = manager.allocateChannelMPE(8192, false, 7000, 0.5f);
+    EXPECT_EQ(ch, oldest);
+    EXPECT_TRUE(isStolen);
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests (in a release build)
+TEST(ChannelsManagerMPE, DISABLED_BenchmarkAllocateRelease) {
+    constexpr int numOps = 20'000'000;
+    constexpr size_t maxHeld = 14;
+    constexpr int numBendGroups = 8;
+
+    for (const bool economyMode : {false, true}) {
+        ChannelsManagerMPE manager(economyMode);
+        std::mt19937 rng(1);
+        std::vector<int> held;
+        held.reserve(maxHeld);
+        long long checksum = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int op = 0; op < numOps; ++op) {
+            const bool release = !held.empty() && (held.size() == maxHeld || (rng() & 1));
+            if (release) {
+                const size_t i = rng() % held.size();
+                manager.noteReleasedMPE(held[i]);
+                held[i] = held.back();
+                held.pop_back();
+            } else {
+                const int bendMPE = 8192 + 100 * static_cast<int>(rng() % numBendGroups);
+                const int ch = manager.allocateChannelMPE(bendMPE, false, 6000, 0.5f).first;
+                if (ch != -1) {
+                    held.push_back(ch);
+                    checksum += ch;
+                }
+            }
+        }
+        const std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::printf("economy mode %d: %.1f ns/op (checksum %lld)\n", economyMode,
+                    elapsed.count() / numOps, checksum);
+    }
+}
+} // namespace audio_plugin_test
@@ -0,0 +1,162 @@
+#include <XenRoll/processor/managers/NotesSharingMPE.h>
+#include <XenRoll/processor/managers/PluginInstanceManager.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Benchmarks of managers that synchronise instances through shared memory. Their shared objects
+//   have own names (see testPrefix), so instances of the plugin aren't affected, but the
+//   MTS-ESP server benchmark still registers as MTS-ESP master. Run with
+//   --gtest_also_run_disabled_tests (in a release build).
+
+namespace audio_plugin_test {
+namespace {
+namespace bip = boost::interprocess;
+using audio_plugin::NotesSharingMPE;
+using audio_plugin::PluginInstanceManager;
+using Clock = std::chrono::steady_clock;
+
+double msBetween(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+///< Prefix of names of shared objects of managers in benchmarks
+const std::string testPrefix = "XenRollBenchmark";
+
+std::string testName(const std::string &name) { return testPrefix + name; }
+
+void removeSharedObjects() {
+    bip::shared_memory_object::remove(testName("NotesSharingMPESharedMemory").c_str());
+    bip::named_mutex::remove(testName("NotesSharingMPEMutex").c_str());
+    bip::shared_memory_object::remove(testName("XenRollSharedMemory").c_str());
+    bip::named_mutex::remove(testName("XenRollMutexChannelsSheet").c_str());
+    bip::named_semaphore::remove(testName("XenRollUpdateServerSemaphore").c_str());
+    for (int i = 0; i < 16; ++i) {
+        bip::named_mutex::remove(
+            testName("XenRollMutexChannel" + std::to_string(i) + "Freq").c_str());
+        bip::named_mutex::remove(
+            testName("XenRollMutexChannel" + std::to_string(i) + "Note").c_str());
+    }
+}
+
+///< Manager with shared objects of benchmarks
+template <typename Manager> std::unique_ptr<Manager> makeManager() {
+    if constexpr (std::is_same_v<Manager, NotesSharingMPE>) {
+        return std::make_unique<NotesSharingMPE>(-1, nullptr, testPrefix);
+    } else {
+        return std::make_unique<PluginInstanceManager>(nullptr, testPrefix);
+    }
+}
+
+template <typename Manager> void waitInitDone(const std::vector<std::unique_ptr<Manager>> &v) {
+    for (const auto &manager : v) {
+        while (!manager->getIsInitDone()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+/**
+ * @brief Construct numInstances managers back to back and print how long the constructors took
+ * and when all inits were done
+ * @param stuckMutex Named mutex that is locked, like after a crash of the process that held it
+ * (nullptr for clean start)
+ */
+template <typename Manager>
+void benchmarkConstruction(const char *name, const char *stuckMutex, int numInstances) {
+    removeSharedObjects();
+    std::unique_ptr<bip::named_mutex> stuck;
+    if (stuckMutex != nullptr) {
+        stuck = std::make_unique<bip::named_mutex>(bip::open_or_create,
+                                                   testName(stuckMutex).c_str());
+        stuck->lock();
+    }
+
+    std::vector<std::unique_ptr<Manager>> managers;
+    double maxCtorMs = 0.0;
+    const auto start = Clock::now();
+    for (int i = 0; i < numInstances; ++i) {
+        const auto ctorStart = Clock::now();
+        managers.push_back(makeManager<Manager>());
+        maxCtorMs = std::max(maxCtorMs, msBetween(ctorStart, Clock::now()));
+    }
+    const auto ctorsEnd = Clock::now();
+    waitInitDone(managers);
+    const auto readyEnd = Clock::now();
+    const int numActive = static_cast<int>(std::count_if(
+        managers.begin(), managers.end(), [](const auto &m) { return m->getIsActive(); }));
+    std::printf("%-24s ctors %7.2f ms (max %6.2f ms), all ready %7.2f ms, active %d\n", name,
+                msBetween(start, ctorsEnd), maxCtorMs, msBetween(start, readyEnd), numActive);
+
+    managers.clear();
+    if (stuck) {
+        // Mutex was removed by emergency cleanup, so unlocking it doesn't affect anything
+        stuck->unlock();
+    }
+    removeSharedObjects();
+}
+} // namespace
+
+// Constructors don't wait for init (it's done on init thread), also when a named mutex is stuck
+TEST(InstanceManagers, DISABLED_BenchmarkConstruction) {
+    constexpr int numInstances = 50;
+    for (int rep = 0; rep < 2; ++rep) {
+        benchmarkConstruction<NotesSharingMPE>("MPE, clean", nullptr, numInstances);
+        benchmarkConstruction<NotesSharingMPE>("MPE, stuck mutex", "NotesSharingMPEMutex",
+                                               numInstances);
+        benchmarkConstruction<PluginInstanceManager>("MTS-ESP, clean", nullptr, numInstances);
+        benchmarkConstruction<PluginInstanceManager>(
+            "MTS-ESP, stuck mutex", "XenRollMutexChannel9Freq", numInstances);
+    }
+}
+
+// MTS-ESP server with writers that publish a bend (all 128 freqs change) every 128 samples at
+//   48 kHz. Reported CPU is of the whole process (writers are cheap), std::clock() is process
+//   time on POSIX systems
+TEST(InstanceManagers, DISABLED_BenchmarkServerLoop) {
+    constexpr auto blockTime = std::chrono::microseconds(2667);
+    constexpr auto runTime = std::chrono::seconds(2);
+
+    for (const int numWriters : {0, 1, 4, 15}) {
+        removeSharedObjects();
+        // First instance becomes the server
+        std::vector<std::unique_ptr<PluginInstanceManager>> managers;
+        managers.push_back(makeManager<PluginInstanceManager>());
+        waitInitDone(managers);
+        for (int w = 0; w < numWriters; ++w) {
+            managers.push_back(makeManager<PluginInstanceManager>());
+        }
+        waitInitDone(managers);
+
+        double freqs[128];
+        int numBlocks = 0;
+        const std::clock_t cpuStart = std::clock();
+        const auto start = Clock::now();
+        for (auto next = start; Clock::now() - start < runTime; next += blockTime) {
+            for (int i = 0; i < 128; ++i) {
+                freqs[i] = 440.0 * std::exp2((i - 69 + 0.001 * (numBlocks % 100)) / 12.0);
+            }
+            for (size_t w = 1; w < managers.size(); ++w) {
+                managers[w]->updateFreqs(freqs);
+            }
+            ++numBlocks;
+            std::this_thread::sleep_until(next + blockTime);
+        }
+        const double cpuMs = 1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        const double wallMs =
+            std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::printf("%2d writers: %d blocks, process CPU %.2f%%\n", numWriters, numBlocks,
+                    100.0 * cpuMs / wallMs);
+        managers.clear();
+    }
+    removeSharedObjects();
+}
+} // namespace audio_plugin_test
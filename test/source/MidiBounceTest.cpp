@@ -0,0 +1,134 @@
+#include <XenRoll/processor/managers/FreqSlotsManagerMTS.h>
+#include <XenRoll/processor/playback/MidiBounce.h>
+#include <XenRoll/processor/playback/TuningSysEx.h>
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+
+namespace audio_plugin_test {
+namespace {
+using audio_plugin::MidiBounce;
+using audio_plugin::Note;
+using audio_plugin::NotesSnapshot;
+using audio_plugin::Parameters;
+
+constexpr double ticksPerBar = MidiBounce::ticksPerQuarterNote * 4.0; // 4/4
+
+///< A4 and a quarter tone higher note that bends 200 cents up, both are one bar long
+std::vector<Note> makeNotes() {
+    return {Note(4, 900, 0.0f, false, 1.0f, 0.8f), Note(4, 950, 0.0f, false, 1.0f, 0.8f, 200)};
+}
+} // namespace
+
+TEST(MidiBounce, MpeNotesGetOwnChannelsAndBendCurves) {
+    const NotesSnapshot notes(makeNotes());
+    const MidiBounce::Result result = MidiBounce::bounce(notes, MidiBounce::Settings{});
+    EXPECT_EQ(result.numDroppedNotes, 0);
+
+    std::map<int, int> numSounding;             // channel -> note ons - note offs
+    std::map<int, std::vector<int>> pitchBends; // channel -> pitch wheel values
+    int numNoteOns = 0;
+    for (int i = 0; i < result.sequence.getNumEvents(); ++i) {
+        const juce::MidiMessage &message = result.sequence.getEventPointer(i)->message;
+        if (message.isNoteOn()) {
+            EXPECT_GE(message.getChannel(), 2);
+            EXPECT_EQ(numSounding[message.getChannel()]++, 0);
+            EXPECT_EQ(message.getTimeStamp(), 0.0);
+            ++numNoteOns;
+        } else if (message.isNoteOff()) {
+            EXPECT_EQ(--numSounding[message.getChannel()], 0);
+            EXPECT_LE(message.getTimeStamp(), ticksPerBar);
+            EXPECT_GT(message.getTimeStamp(), ticksPerBar - 10);
+        } else if (message.isPitchWheel()) {
+            pitchBends[message.getChannel()].push_back(message.getPitchWheelValue());
+        }
+    }
+    EXPECT_EQ(numNoteOns, 2);
+    EXPECT_EQ(numSounding.size(), 2u);
+
+    // Bending note's channel gets an increasing curve, the other one only initial bend
+    const std::vector<int> *curve = nullptr;
+    for (const auto &[channel, values] : pitchBends) {
+        if (values.size() > 1) {
+            curve = &values;
+        } else {
+            EXPECT_EQ(values.front(), 8192);
+        }
+    }
+    ASSERT_NE(curve, nullptr);
+    for (size_t k = 1; k < curve->size(); ++k) {
+        EXPECT_GT((*curve)[k], (*curve)[k - 1]);
+    }
+    const double centsPerBend = 48 * 100.0 / 8192;
+    EXPECT_NEAR((curve->back() - curve->front()) * centsPerBend, 200.0, 1.0);
+}
+
+TEST(MidiBounce, MtsSysExRetunesKeysBeforeNoteOns) {
+    const NotesSnapshot notes(makeNotes());
+    MidiBounce::Settings settings;
+    settings.tuningType = Parameters::MTS_SYSEX;
+    const MidiBounce::Result result = MidiBounce::bounce(notes, settings);
+    EXPECT_EQ(result.numDroppedNotes, 0);
+
+    std::map<int, double> keyFreqs;
+    std::vector<double> noteOnFreqs;
+    for (int i = 0; i < result.sequence.getNumEvents(); ++i) {
+        const juce::MidiMessage &message = result.sequence.getEventPointer(i)->message;
+        if (message.isSysEx()) {
+            // 7F <device> 08 02 <program> <count> (<key> <semitone> <frac MSB> <frac LSB>)*
+            const juce::uint8 *data = message.getSysExData();
+            for (int k = 0; k < data[5]; ++k) {
+                const juce::uint8 *change = data + 6 + 4 * k;
+                keyFreqs[change[0]] = audio_plugin::tuning_sysex::decodeFreq(
+                    change[1], change[2], change[3]);
+            }
+        } else if (message.isNoteOn()) {
+            ASSERT_TRUE(keyFreqs.contains(message.getNoteNumber()));
+            noteOnFreqs.push_back(keyFreqs[message.getNoteNumber()]);
+        }
+    }
+    ASSERT_EQ(noteOnFreqs.size(), 2u);
+    EXPECT_NEAR(noteOnFreqs[0], 440.0, 0.01);
+    EXPECT_NEAR(noteOnFreqs[1], 440.0 * std::exp2(50.0 / 1200.0), 0.01);
+    // Bent note is retuned while it plays
+    double maxFreq = 0.0;
+    for (const auto &[key, freq] : keyFreqs) {
+        maxFreq = std::max(maxFreq, freq);
+    }
+    EXPECT_NEAR(maxFreq, 440.0 * std::exp2(250.0 / 1200.0), 1.0);
+}
+TEST(MidiBounce, MtsSysExOverlappingUnisonNotesReleaseTheirKey) {
+    // Two overlapping A4 notes share a key, then all 128 keys are needed at once
+    std::vector<Note> notes = {Note(4, 900, 0.0f, false, 1.0f, 0.8f),
+                               Note(4, 900, 0.5f, false, 1.0f, 0.8f)};
+    for (int k = 0; k < audio_plugin::FreqSlotsManagerMTS::slotsPerChannel; ++k) {
+        const int totalCents = 3 * 1200 + 10 * k;
+        notes.push_back(Note(totalCents / 1200, totalCents % 1200, 2.0f, false, 1.0f, 0.8f));
+    }
+    const NotesSnapshot snapshot(notes);
+    MidiBounce::Settings settings;
+    settings.tuningType = Parameters::MTS_SYSEX;
+    const MidiBounce::Result result = MidiBounce::bounce(snapshot, settings);
+    EXPECT_EQ(result.numDroppedNotes, 0);
+
+    // Shared key is played once and stopped by the note that ends last
+    int numUnisonNoteOns = 0;
+    int numUnisonNoteOffs = 0;
+    for (int i = 0; i < result.sequence.getNumEvents(); ++i) {
+        const juce::MidiMessage &message = result.sequence.getEventPointer(i)->message;
+        if (message.getTimeStamp() >= 2 * ticksPerBar - 10) {
+            continue;
+        }
+        if (message.isNoteOn()) {
+            ++numUnisonNoteOns;
+        } else if (message.isNoteOff()) {
+            ++numUnisonNoteOffs;
+            EXPECT_GT(message.getTimeStamp(), 1.5 * ticksPerBar - 10);
+        }
+    }
+    EXPECT_EQ(numUnisonNoteOns, 1);
+    EXPECT_EQ(numUnisonNoteOffs, 1);
+}
+} // namespace audio_plugin_test
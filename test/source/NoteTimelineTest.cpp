@@ -0,0 +1,48 @@
+#include <XenRoll/processor/playback/NoteTimeline.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace audio_plugin_test {
+using audio_plugin::Note;
+using audio_plugin::NoteTimeline;
+
+namespace {
+NoteTimeline makeTimeline(const std::vector<float> &times) {
+    std::vector<Note> notes;
+    for (const float time : times) {
+        notes.emplace_back(4, 0, time, false, 0.25f, 0.5f);
+    }
+    NoteTimeline timeline;
+    timeline.build(notes);
+    return timeline;
+}
+} // namespace
+
+TEST(NoteTimeline, ConsecutiveBlocksReturnEveryEventOnce) {
+    const NoteTimeline timeline = makeTimeline({0.0f, 0.1f, 0.35f, 0.5f, 0.99f});
+    NoteTimeline::Cursor cursor;
+    int numEvents = 0;
+    for (int block = 0; block < 10; ++block) {
+        numEvents += static_cast<int>(
+            cursor.advance(timeline.getNoteOns(), 1, block * 0.1, (block + 1) * 0.1).size());
+    }
+    EXPECT_EQ(numEvents, 5);
+}
+
+TEST(NoteTimeline, BlockStartingBeforePreviousEndDoesNotRepeatEvents) {
+    const NoteTimeline timeline = makeTimeline({0.5f, 0.9995f});
+    NoteTimeline::Cursor cursor;
+    EXPECT_EQ(cursor.advance(timeline.getNoteOns(), 1, 0.0, 1.0).size(), 2u);
+    // Playhead time of the next block is rounded slightly below the previous end
+    EXPECT_EQ(cursor.advance(timeline.getNoteOns(), 1, 0.999, 2.0).size(), 0u);
+}
+
+TEST(NoteTimeline, JumpBackReturnsEventsAgain) {
+    const NoteTimeline timeline = makeTimeline({0.5f});
+    NoteTimeline::Cursor cursor;
+    EXPECT_EQ(cursor.advance(timeline.getNoteOns(), 1, 0.0, 1.0).size(), 1u);
+    EXPECT_EQ(cursor.advance(timeline.getNoteOns(), 1, 1.0, 2.0).size(), 0u);
+    // Loop back to the start
+    EXPECT_EQ(cursor.advance(timeline.getNoteOns(), 1, 0.0, 1.0).size(), 1u);
+}
+} // namespace audio_plugin_test
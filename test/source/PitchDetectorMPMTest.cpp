@@ -0,0 +1,204 @@
+#include <XenRoll/processor/audio/dsp/PitchDetectorMPM.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace audio_plugin_test {
+namespace {
+using audio_plugin::PitchDetectorMPM;
+using AnalysisMode = PitchDetectorMPM::AnalysisMode;
+
+constexpr int windowSize = 4096;
+constexpr double maxErrorCents = 5.0;
+
+///< Tone with a few harmonics
+std::vector<float> makeTone(double freq, double sampleRate) {
+    std::vector<float> tone(windowSize);
+    for (int i = 0; i < windowSize; ++i) {
+        const double phase = 2.0 * juce::MathConstants<double>::pi * freq * i / sampleRate;
+        tone[i] = static_cast<float>(0.5 * std::sin(phase) + 0.25 * std::sin(2.0 * phase) +
+                                     0.1 * std::sin(3.0 * phase));
+    }
+    return tone;
+}
+
+double centsError(float detectedFreq, double freq) {
+    return std::abs(1200.0 * std::log2(detectedFreq / freq));
+}
+
+struct TestSignal {
+    std::vector<float> samples;
+    std::vector<double> freqs; ///< True frequency at each sample
+};
+
+/**
+ * @brief Synthetic test signal (no recorded vocals are used)
+ * @param freqAt Frequency in Hz at time in seconds
+ * @param isVoice Harmonics with three formants and slow jitter, otherwise sine
+ */
+TestSignal makeSignal(double sampleRate, double duration,
+                      const std::function<double(double)> &freqAt, bool isVoice, double snrDb) {
+    const int numSamples = static_cast<int>(sampleRate * duration);
+    TestSignal signal{std::vector<float>(numSamples), std::vector<double>(numSamples)};
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    const double twoPi = 2.0 * juce::MathConstants<double>::pi;
+    auto formant = [](double f, double center, double width) {
+        return std::exp(-std::pow((f - center) / width, 2.0));
+    };
+    double phase = 0.0, jitter = 0.0;
+    for (int i = 0; i < numSamples; ++i) {
+        jitter = 0.999 * jitter + 0.0005 * gauss(rng);
+        const double freq = freqAt(i / sampleRate) * (isVoice ? 1.0 + 0.002 * jitter : 1.0);
+        signal.freqs[i] = freq;
+        phase += twoPi * freq / sampleRate;
+        const int numHarmonics =
+            isVoice ? std::min(40, static_cast<int>(std::min(8000.0, sampleRate / 2) / freq)) : 1;
+        double value = 0.0;
+        for (int k = 1; k <= numHarmonics; ++k) {
+            const double f = k * freq;
+            double amp = 1.0 / k;
+            if (isVoice) {
+                amp *= 0.2 + formant(f, 700.0, 150.0) + 0.7 * formant(f, 1200.0, 200.0) +
+                       0.4 * formant(f, 2600.0, 300.0);
+            }
+            value += amp * std::sin(k * phase);
+        }
+        signal.samples[i] = static_cast<float>(0.3 * value);
+    }
+    double power = 0.0;
+    for (const float v : signal.samples) {
+        power += v * v;
+    }
+    const double noiseAmp = std::sqrt(power / numSamples / std::pow(10.0, snrDb / 10.0));
+    for (float &v : signal.samples) {
+        v += static_cast<float>(noiseAmp * gauss(rng));
+    }
+    return signal;
+}
+} // namespace
+
+TEST(PitchDetectorMPM, DetectsVoiceRangeInBothModes) {
+    for (const AnalysisMode mode : {AnalysisMode::FullRate, AnalysisMode::Decimated}) {
+        for (const double sampleRate : {44100.0, 48000.0}) {
+            PitchDetectorMPM detector(windowSize);
+            detector.setAnalysisMode(mode);
+            detector.prepare(sampleRate);
+            for (const double freq : {110.0, 220.0, 440.0, 880.0}) {
+                const float detectedFreq =
+                    detector.detectPitch(makeTone(freq, sampleRate), sampleRate, true);
+                EXPECT_LT(centsError(detectedFreq, freq), maxErrorCents)
+                    << "mode = " << static_cast<int>(mode) << ", sampleRate = " << sampleRate
+                    << ", freq = " << freq;
+            }
+        }
+    }
+}
+
+TEST(PitchDetectorMPM, RingBufferPartsMatchContiguousWindow) {
+    const double sampleRate = 48000.0;
+    const std::vector<float> tone = makeTone(330.0, sampleRate);
+    // Same window, stored in a ring with the oldest sample at writePos
+    const int writePos = 1234;
+    std::vector<float> ring(windowSize);
+    for (int i = 0; i < windowSize; ++i) {
+        ring[(writePos + i) % windowSize] = tone[i];
+    }
+
+    for (const AnalysisMode mode : {AnalysisMode::FullRate, AnalysisMode::Decimated}) {
+        PitchDetectorMPM contiguousDetector(windowSize), ringDetector(windowSize);
+        contiguousDetector.setAnalysisMode(mode);
+        ringDetector.setAnalysisMode(mode);
+        EXPECT_EQ(contiguousDetector.detectPitch(tone, sampleRate, true),
+                  ringDetector.detectPitch(ring.data() + writePos, windowSize - writePos,
+                                           ring.data(), writePos, sampleRate, true));
+    }
+}
+
+TEST(PitchDetectorMPM, DetectsPitchAfterSilentWindow) {
+    const double sampleRate = 48000.0;
+    PitchDetectorMPM detector(windowSize);
+    EXPECT_EQ(detector.detectPitch(std::vector<float>(windowSize, 0.0f), sampleRate, true), 0.0f);
+    const float detectedFreq = detector.detectPitch(makeTone(220.0, sampleRate), sampleRate, true);
+    EXPECT_LT(centsError(detectedFreq, 220.0), maxErrorCents);
+}
+
+// Benchmark of accuracy and CPU (10 ms hop), run with --gtest_also_run_disabled_tests (in a
+//   release build). Errors above 50 cents are counted as gross and excluded from the median
+TEST(PitchDetectorMPM, DISABLED_BenchmarkAccuracyAndCpu) {
+    struct Case {
+        const char *name;
+        std::function<double(double)> freqAt;
+        bool isVoice;
+        double snrDb;
+    };
+    const double twoPi = 2.0 * juce::MathConstants<double>::pi;
+    const std::vector<Case> cases = {
+        {"sine sweep 80-1000 Hz", [](double t) { return 80.0 * std::pow(12.5, t / 10.0); },
+         false, 40.0},
+        {"voice glide 100-800 Hz, vibrato",
+         [twoPi](double t) {
+             const double u = t < 5.0 ? t / 5.0 : (10.0 - t) / 5.0;
+             return 100.0 * std::pow(8.0, u) * std::exp2(40.0 / 1200.0 * std::sin(twoPi * 5.5 * t));
+         },
+         true, 25.0},
+        {"low voice 75-220 Hz",
+         [twoPi](double t) {
+             return 75.0 * std::pow(220.0 / 75.0, 0.5 - 0.5 * std::cos(twoPi * t / 10.0));
+         },
+         true, 20.0},
+    };
+
+    for (const double sampleRate : {44100.0, 48000.0, 96000.0}) {
+        std::printf("%.1f kHz\n", sampleRate / 1000.0);
+        const int hop = static_cast<int>(std::lround(0.01 * sampleRate));
+        for (const Case &c : cases) {
+            const TestSignal signal = makeSignal(sampleRate, 10.0, c.freqAt, c.isVoice, c.snrDb);
+            std::printf(" %s\n", c.name);
+            for (const AnalysisMode mode : {AnalysisMode::FullRate, AnalysisMode::Decimated}) {
+                PitchDetectorMPM detector(windowSize);
+                detector.setAnalysisMode(mode);
+                detector.prepare(sampleRate);
+                std::vector<double> errors;
+                int numHops = 0, numVoiced = 0, numGross = 0;
+                double cpuUs = 0.0;
+                float prevFreq = 0.0f;
+                for (int end = windowSize; end <= static_cast<int>(signal.samples.size());
+                     end += hop) {
+                    ++numHops;
+                    const auto start = std::chrono::steady_clock::now();
+                    const float freq =
+                        detector.detectPitch(signal.samples.data() + end - windowSize,
+                                             windowSize, nullptr, 0, sampleRate, prevFreq == 0.0f);
+                    cpuUs += std::chrono::duration<double, std::micro>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+                    prevFreq = freq;
+                    if (freq <= 0.0f) {
+                        continue;
+                    }
+                    ++numVoiced;
+                    const double error = centsError(freq, signal.freqs[end - windowSize / 2]);
+                    if (error > 50.0) {
+                        ++numGross;
+                    } else {
+                        errors.push_back(error);
+                    }
+                }
+                std::sort(errors.begin(), errors.end());
+                const double median = errors.empty() ? 0.0 : errors[errors.size() / 2];
+                std::printf("  %-9s voiced %5.1f%%, median %5.2f cents, gross %4.1f%%, "
+                            "%6.1f us/hop\n",
+                            mode == AnalysisMode::FullRate ? "full rate" : "decimated",
+                            100.0 * numVoiced / numHops, median,
+                            100.0 * numGross / std::max(numVoiced, 1), cpuUs / numHops);
+            }
+        }
+    }
+}
+} // namespace audio_plugin_test
@@ -0,0 +1,61 @@
+#include <XenRoll/common/PitchMath.h>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace audio_plugin_test {
+namespace {
+// Whole piano roll (10 octaves, totalCents in [0, 12000)) relative to A4 (totalCents 5700),
+//   plus margin for bends and A4 frequency
+constexpr double minCents = -7000.0;
+constexpr double maxCents = 7000.0;
+constexpr double maxErrorCents = 1e-10;
+} // namespace
+
+TEST(PitchMath, CentsToRatioMatchesPow) {
+    for (double cents = minCents; cents <= maxCents; cents += 0.0137) {
+        const double expected = std::pow(2.0, cents / 1200.0);
+        const double actual = audio_plugin::centsToRatio(cents);
+        ASSERT_LT(std::abs(1200.0 * std::log2(actual / expected)), maxErrorCents)
+            << "cents = " << cents;
+    }
+}
+
+TEST(PitchMath, RatioToCentsMatchesLog2) {
+    for (double cents = minCents; cents <= maxCents; cents += 0.0137) {
+        const double ratio = std::pow(2.0, cents / 1200.0);
+        const double expected = 1200.0 * std::log2(ratio);
+        ASSERT_NEAR(audio_plugin::ratioToCents(ratio), expected, maxErrorCents)
+            << "ratio = " << ratio;
+    }
+}
+
+TEST(PitchMath, ExactPowersOfTwo) {
+    for (int octave = -10; octave <= 10; ++octave) {
+        EXPECT_DOUBLE_EQ(audio_plugin::centsToRatio(1200.0 * octave), std::ldexp(1.0, octave));
+        EXPECT_NEAR(audio_plugin::ratioToCents(std::ldexp(1.0, octave)), 1200.0 * octave,
+                    maxErrorCents);
+    }
+}
+
+TEST(PitchMath, BatchMatchesScalar) {
+    const double A4Freq = 432.0;
+    std::vector<double> cents;
+    for (double c = minCents; c <= maxCents; c += 3.7) {
+        cents.push_back(c);
+    }
+    std::vector<double> freqs(cents.size());
+    audio_plugin::centsToFreqs(cents.data(), freqs.data(), cents.size(), A4Freq);
+    for (size_t i = 0; i < cents.size(); ++i) {
+        ASSERT_DOUBLE_EQ(freqs[i], A4Freq * audio_plugin::centsToRatio(cents[i]));
+    }
+
+    // In place
+    std::vector<double> backToCents = freqs;
+    audio_plugin::freqsToCents(backToCents.data(), backToCents.data(), backToCents.size(),
+                               A4Freq);
+    for (size_t i = 0; i < cents.size(); ++i) {
+        ASSERT_NEAR(backToCents[i], cents[i], 1e-9);
+    }
+}
+} // namespace audio_plugin_test
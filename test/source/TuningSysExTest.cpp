@@ -0,0 +1,88 @@
+#include <XenRoll/processor/playback/TuningSysEx.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <gtest/gtest.h>
+
+namespace audio_plugin_test {
+namespace {
+constexpr double resolutionCents = 100.0 / audio_plugin::tuning_sysex::unitsPerSemitone;
+
+double centsBetween(double a, double b) { return 1200.0 * std::log2(a / b); }
+} // namespace
+
+TEST(TuningSysEx, EncodesTwelveEdoExactly) {
+    for (int key = 0; key < 128; ++key) {
+        const double freq = 440.0 * std::exp2((key - 69) / 12.0);
+        const auto bytes = audio_plugin::tuning_sysex::encodeFreq(freq);
+        EXPECT_EQ(bytes[0], key);
+        EXPECT_EQ(bytes[1], 0);
+        EXPECT_EQ(bytes[2], 0);
+    }
+}
+
+TEST(TuningSysEx, RoundTripIsWithinHalfUnit) {
+    for (double freq = 8.2; freq < 12000.0; freq *= 1.00731) {
+        const auto [semitone, fracMsb, fracLsb] = audio_plugin::tuning_sysex::encodeFreq(freq);
+        ASSERT_LT(fracMsb, 128);
+        ASSERT_LT(fracLsb, 128);
+        const double decoded = audio_plugin::tuning_sysex::decodeFreq(semitone, fracMsb, fracLsb);
+        ASSERT_LE(std::abs(centsBetween(decoded, freq)), resolutionCents / 2 + 1e-9)
+            << "freq = " << freq;
+    }
+}
+
+TEST(TuningSysEx, ClampsOutOfRangeFrequencies) {
+    const auto low = audio_plugin::tuning_sysex::encodeFreq(1.0);
+    EXPECT_EQ(low[0], 0);
+    EXPECT_EQ(low[1], 0);
+    EXPECT_EQ(low[2], 0);
+    // 7F 7F 7F is reserved for "no change"
+    const auto high = audio_plugin::tuning_sysex::encodeFreq(50000.0);
+    EXPECT_EQ(high[0], 0x7F);
+    EXPECT_EQ(high[1], 0x7F);
+    EXPECT_EQ(high[2], 0x7E);
+}
+
+TEST(TuningSysEx, WritesSingleNoteTuningChange) {
+    uint8_t out[audio_plugin::tuning_sysex::maxMessageSize];
+    const uint8_t keys[] = {60, 61};
+    const double freqs[] = {440.0, 440.0 * std::exp2(0.5 / 12.0)};
+    const int size = audio_plugin::tuning_sysex::writeSingleNoteTuningChange(out, keys, freqs, 2);
+    ASSERT_EQ(size, 7 + 2 * 4 + 1);
+    const uint8_t expected[] = {0xF0, 0x7F, 0x7F, 0x08, 0x02, 0x00, 0x02, 60,   69,
+                                0x00, 0x00, 61,   69,   0x40, 0x00, 0xF7};
+    for (int i = 0; i < size; ++i) {
+        EXPECT_EQ(out[i], expected[i]) << "byte " << i;
+    }
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests (in a release build)
+TEST(TuningSysEx, DISABLED_BenchmarkWriteFullMessage) {
+    constexpr int numMessages = 200'000;
+    constexpr int numKeys = audio_plugin::tuning_sysex::maxChangesPerMessage;
+    uint8_t out[audio_plugin::tuning_sysex::maxMessageSize];
+    uint8_t keys[numKeys];
+    double freqs[numKeys];
+    for (int i = 0; i < numKeys; ++i) {
+        keys[i] = static_cast<uint8_t>(i);
+    }
+    long long checksum = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int m = 0; m < numMessages; ++m) {
+        for (int i = 0; i < numKeys; ++i) {
+            freqs[i] = 440.0 * std::exp2((i - 69 + 0.001 * (m % 100)) / 12.0);
+        }
+        const int size =
+            audio_plugin::tuning_sysex::writeSingleNoteTuningChange(out, keys, freqs, numKeys);
+        checksum += out[size / 2];
+    }
+    const std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    // Includes computing the frequencies (exp2 per key)
+    std::printf("%d keys: %.2f us/message (checksum %lld)\n", numKeys,
+                elapsed.count() / numMessages, checksum);
+}
+} // namespace audio_plugin_test